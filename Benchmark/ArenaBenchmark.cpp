@@ -0,0 +1,120 @@
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/Arena.h"
+#include "../Header/IndexedSkipList.h"
+#include "../Header/LRUCache.h"
+#include "../Header/RBTree.h"
+
+// Request scoped containers: every request builds an RBTree, an IndexedSkipList, a small LRUCache and
+// a std::pmr::vector from a few hundred keys, looks them up and drops everything. Once with the
+// containers on the default resource (operator new), once on the thread's MonotonicArena rewound by an
+// ArenaScope after every request, which stops calling operator new after the first request.
+// The pool part creates and destroys fixed-size objects through ObjectPool vs new / delete.
+// usage: ArenaBenchmark [requests] [keysPerRequest]
+
+namespace
+{
+	struct Payload
+	{
+		uint64_t values[6];
+	};
+
+	uint64_t ServeRequest(const std::vector<uint64_t>& keys, std::pmr::memory_resource* resource)
+	{
+		RBTree<uint64_t, uint64_t> tree(resource);
+		IndexedSkipList<uint64_t> list(resource);
+		LRUCache<uint64_t, uint64_t> cache(keys.size() / 4 + 1, nullptr, resource);
+		std::pmr::vector<uint64_t> scratch(resource);
+
+		for (uint64_t key : keys)
+		{
+			tree.Insert(key, key * 3);
+			list.Insert(key);
+			cache.Put(key, key);
+			scratch.push_back(key ^ 0x9e3779b97f4a7c15ull);
+		}
+
+		uint64_t sum = 0;
+		for (uint64_t key : keys)
+		{
+			sum += *tree.Find(key);
+			sum += list.Contains(key + 1) ? 1 : 0;
+			auto handle = cache.Get(key);
+			if (handle.IsValid())
+				sum += handle.Get();
+		}
+		for (uint64_t value : scratch)
+			sum += value;
+		return sum;
+	}
+
+	void RunRequests(const char* name, size_t requests, const std::vector<uint64_t>& keys, bool useArena)
+	{
+		Stopwatch watch;
+		uint64_t sum = 0;
+		for (size_t r = 0; r < requests; r++)
+		{
+			if (useArena)
+			{
+				ArenaScope scope;
+				sum += ServeRequest(keys, &scope.Arena());
+			}
+			else
+			{
+				sum += ServeRequest(keys, std::pmr::get_default_resource());
+			}
+		}
+		DoNotOptimize(sum);
+		ReportBenchmark(name, requests, watch.ElapsedMs());
+	}
+
+	void RunPool(size_t rounds, size_t objects)
+	{
+		std::vector<Payload*> live(objects);
+
+		Stopwatch watch;
+		for (size_t r = 0; r < rounds; r++)
+		{
+			for (size_t i = 0; i < objects; i++)
+				live[i] = new Payload{ { i, r } };
+			for (Payload* payload : live)
+				delete payload;
+		}
+		ReportBenchmark("new / delete fixed-size objects", rounds * objects, watch.ElapsedMs());
+
+		ObjectPool<Payload> pool;
+		watch.Restart();
+		for (size_t r = 0; r < rounds; r++)
+		{
+			for (size_t i = 0; i < objects; i++)
+				live[i] = pool.Create(Payload{ { i, r } });
+			for (Payload* payload : live)
+				pool.Destroy(payload);
+		}
+		ReportBenchmark("ObjectPool fixed-size objects", rounds * objects, watch.ElapsedMs());
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t requests = argc > 1 ? static_cast<size_t>(std::atoll(args[1])) : 5000;
+	const size_t keysPerRequest = argc > 2 ? static_cast<size_t>(std::atoll(args[2])) : 256;
+
+	std::vector<uint64_t> keys(keysPerRequest);
+	std::mt19937_64 rng(42);
+	for (uint64_t& key : keys)
+		key = rng();
+
+	std::printf("arena benchmark: %zu requests, %zu keys each\n", requests, keysPerRequest);
+	RunRequests("request scoped containers, default resource", requests, keys, false);
+	RunRequests("request scoped containers, MonotonicArena", requests, keys, true);
+	std::printf("thread arena holds %zu bytes\n", MonotonicArena::ThreadLocal().Capacity());
+	RunPool(requests / 10 + 1, 10000);
+	ReportInstrumentation();
+	return 0;
+}
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/BPlusTree.h"
+#include "../Header/IndexedSkipList.h"
+#include "../Header/RBTree.h"
+
+// BPlusTree against RBTree and IndexedSkipList: random insert, random lookup and short range scans,
+// at every power of ten from 1K elements up to the given maximum (up to 100M; mind the memory).
+// IndexedSkipList has no range scan.
+// usage: BPlusTreeBenchmark [maxElements]
+
+namespace
+{
+	constexpr size_t kMinLookups = size_t(1) << 20; // small trees get more lookups than elements, for stable timings
+	constexpr size_t kRangeQueries = 100000;
+	constexpr uint64_t kRangeWidth = 64;
+
+	struct BPlusTreeAdapter
+	{
+		static constexpr const char* kName = "BPlusTree";
+		BPlusTree<uint64_t, uint64_t> tree;
+
+		void Insert(uint64_t k) { tree.Insert(k, k); }
+		bool Find(uint64_t k) const { return tree.Find(k) != nullptr; }
+
+		uint64_t SumRange(uint64_t lo, uint64_t hi) const
+		{
+			uint64_t sum = 0;
+			tree.RangeForEach(lo, hi, [&sum](uint64_t, uint64_t v) { sum += v; });
+			return sum;
+		}
+	};
+
+	struct RBTreeAdapter
+	{
+		static constexpr const char* kName = "RBTree";
+		RBTree<uint64_t, uint64_t> tree;
+
+		void Insert(uint64_t k) { tree.Insert(k, k); }
+		bool Find(uint64_t k) const { return tree.Find(k) != nullptr; }
+
+		uint64_t SumRange(uint64_t lo, uint64_t hi) const
+		{
+			uint64_t sum = 0;
+			tree.RangeForEach(lo, hi, [&sum](uint64_t, uint64_t v) { sum += v; });
+			return sum;
+		}
+	};
+
+	struct SkipListAdapter
+	{
+		static constexpr const char* kName = "IndexedSkipList";
+		IndexedSkipList<uint64_t> list;
+
+		void Insert(uint64_t k) { list.Insert(k); }
+		bool Find(uint64_t k) const { return list.Find(k) != nullptr; }
+	};
+
+	std::string Label(const char* container, const char* what, size_t elements)
+	{
+		return std::string(container) + " " + what + " @" + std::to_string(elements);
+	}
+
+	template<typename Container>
+	void Bench(const std::vector<uint64_t>& keys, const std::vector<uint64_t>& probes)
+	{
+		const size_t elements = keys.size();
+		Container container;
+		Stopwatch watch;
+		for (uint64_t k : keys)
+			container.Insert(k);
+		ReportBenchmark(Label(Container::kName, "insert", elements), elements, watch.ElapsedMs());
+
+		watch.Restart();
+		size_t hits = 0;
+		for (uint64_t k : probes)
+			hits += container.Find(k) ? 1 : 0;
+		DoNotOptimize(hits);
+		ReportBenchmark(Label(Container::kName, "find", elements), probes.size(), watch.ElapsedMs());
+
+		if constexpr (requires { container.SumRange(0, 0); })
+		{
+			std::mt19937_64 rng(7);
+			watch.Restart();
+			uint64_t sum = 0;
+			for (size_t q = 0; q < kRangeQueries; q++)
+			{
+				const uint64_t lo = rng() % (elements * 2);
+				sum += container.SumRange(lo, lo + kRangeWidth * 2);
+			}
+			DoNotOptimize(sum);
+			ReportBenchmark(Label(Container::kName, "range scan (64)", elements), kRangeQueries, watch.ElapsedMs());
+		}
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t maxElements = argc > 1 ? static_cast<size_t>(std::atoll(args[1])) : 1000000;
+
+	std::printf("BPlusTree benchmark: 1K .. %zu elements\n", maxElements);
+	for (size_t elements = 1000; elements <= maxElements; elements *= 10)
+	{
+		// even keys only, so range bounds fall between elements
+		std::vector<uint64_t> keys(elements);
+		for (size_t i = 0; i < elements; i++)
+			keys[i] = i * 2;
+		std::mt19937_64 rng(42);
+		std::shuffle(keys.begin(), keys.end(), rng);
+
+		std::vector<uint64_t> probes(std::max(elements, kMinLookups));
+		for (uint64_t& probe : probes)
+			probe = keys[rng() % elements];
+
+		Bench<BPlusTreeAdapter>(keys, probes);
+		Bench<RBTreeAdapter>(keys, probes);
+		Bench<SkipListAdapter>(keys, probes);
+		std::printf("\n");
+	}
+	ReportInstrumentation();
+	return 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <string_view>
+#include "../Header/Instrumentation.h"
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+// tiny helpers shared by the standalone benchmark programs in this folder
+
+class Stopwatch
+{
+	std::chrono::steady_clock::time_point _start;
+public:
+	Stopwatch() : _start(std::chrono::steady_clock::now()) {}
+
+	void Restart() { _start = std::chrono::steady_clock::now(); }
+
+	double ElapsedMs() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+	}
+};
+
+// keeps the optimizer from dropping a result we only compute for timing
+template<typename T>
+inline void DoNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const T* sink;
+	sink = &value;
+#endif
+}
+
+inline void ReportBenchmark(std::string_view name, uint64_t ops, double ms)
+{
+	const double opsPerSec = ms > 0.0 ? static_cast<double>(ops) * 1000.0 / ms : 0.0;
+	std::printf("%-48.*s %12llu ops %10.2f ms %14.0f ops/s\n",
+		static_cast<int>(name.size()), name.data(),
+		static_cast<unsigned long long>(ops), ms, opsPerSec);
+}
+
+// pins the calling thread to one logical cpu, returns false where that is not supported
+inline bool PinCurrentThread(unsigned cpu)
+{
+#if defined(_WIN32)
+	if (cpu >= sizeof(DWORD_PTR) * 8)
+		return false;
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+// resident set size of this process, 0 where that is not available
+inline size_t CurrentResidentBytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters{};
+	if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.WorkingSetSize;
+#elif defined(__linux__)
+	FILE* statm = std::fopen("/proc/self/statm", "r");
+	if (!statm)
+		return 0;
+	unsigned long long totalPages = 0;
+	unsigned long long residentPages = 0;
+	const int fields = std::fscanf(statm, "%llu %llu", &totalPages, &residentPages);
+	std::fclose(statm);
+	return fields == 2 ? static_cast<size_t>(residentPages) * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+	return 0;
+#endif
+}
+
+// what the hot-path counters saw during the run; silent unless built with CUCW_INSTRUMENTATION
+inline void ReportInstrumentation()
+{
+	if constexpr (Instrumentation::kEnabled)
+	{
+		std::printf("instrumentation:\n");
+		Instrumentation::Print(Instrumentation::Snapshot());
+	}
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/LRUCache.h"
+
+// replays a key trace through LRUCache with every eviction policy and reports hit ratio and ops/s.
+// Without a trace file two synthetic traces are used: a Zipf working set, and the same working set
+// interrupted by large one-off scans (the nightly reindex pattern).
+// usage: CachePolicyBenchmark [capacity] [trace file, one integer key per line]
+
+namespace
+{
+	std::vector<uint64_t> ZipfTrace(size_t keys, size_t length, double skew, uint64_t seed)
+	{
+		std::vector<double> cdf(keys);
+		double sum = 0.0;
+		for (size_t i = 0; i < keys; i++)
+		{
+			sum += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+			cdf[i] = sum;
+		}
+
+		std::mt19937_64 rng(seed);
+		std::uniform_real_distribution<double> uniform(0.0, sum);
+		std::vector<uint64_t> trace(length);
+		for (uint64_t& key : trace)
+			key = static_cast<uint64_t>(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+		return trace;
+	}
+
+	// every 'period' accesses, 'scanLength' never repeated keys are streamed through the cache
+	std::vector<uint64_t> WithScans(const std::vector<uint64_t>& base, size_t period, size_t scanLength)
+	{
+		std::vector<uint64_t> trace;
+		trace.reserve(base.size() + base.size() / period * scanLength);
+		uint64_t scanKey = uint64_t(1) << 40;
+		for (size_t i = 0; i < base.size(); i++)
+		{
+			trace.push_back(base[i]);
+			if ((i + 1) % period == 0)
+			{
+				for (size_t s = 0; s < scanLength; s++)
+					trace.push_back(scanKey++);
+			}
+		}
+		return trace;
+	}
+
+	std::vector<uint64_t> LoadTrace(const char* path)
+	{
+		std::vector<uint64_t> trace;
+		std::ifstream in(path);
+		uint64_t key = 0;
+		while (in >> key)
+			trace.push_back(key);
+		return trace;
+	}
+
+	template<typename Policy>
+	void Replay(const char* policyName, const std::string& traceName, const std::vector<uint64_t>& trace, int capacity)
+	{
+		LRUCache<uint64_t, uint64_t, DefaultValueDeleter<uint64_t>, std::hash<uint64_t>, std::equal_to<uint64_t>, Policy> cache(capacity);
+		uint64_t hits = 0;
+		Stopwatch watch;
+		for (uint64_t key : trace)
+		{
+			auto handle = cache.Get(key);
+			if (handle.IsValid())
+				hits++;
+			else
+				cache.Put(key, key);
+		}
+		const double ms = watch.ElapsedMs();
+
+		ReportBenchmark(traceName + ", " + policyName, trace.size(), ms);
+		std::printf("    hit ratio %.4f, evictions %zu\n",
+			static_cast<double>(hits) / static_cast<double>(trace.size()), cache.EvictionCount());
+	}
+
+	void ReplayAll(const std::string& traceName, const std::vector<uint64_t>& trace, int capacity)
+	{
+		Replay<LRUPolicy>("LRU", traceName, trace, capacity);
+		Replay<SLRUPolicy>("SLRU", traceName, trace, capacity);
+		Replay<WTinyLFUPolicy>("W-TinyLFU", traceName, trace, capacity);
+	}
+}
+
+int main(int argc, char** args)
+{
+	const int capacity = argc > 1 ? std::atoi(args[1]) : 10000;
+	std::printf("cache policy benchmark: capacity %d\n", capacity);
+
+	if (argc > 2)
+	{
+		const std::vector<uint64_t> trace = LoadTrace(args[2]);
+		ReplayAll(args[2], trace, capacity);
+		ReportInstrumentation();
+		return 0;
+	}
+
+	const size_t keys = static_cast<size_t>(capacity) * 20;
+	const std::vector<uint64_t> zipf = ZipfTrace(keys, 2000000, 0.9, 42);
+	ReplayAll("zipf(0.9)", zipf, capacity);
+	ReplayAll("zipf(0.9) + scans", WithScans(zipf, 100000, static_cast<size_t>(capacity) * 2), capacity);
+	ReportInstrumentation();
+	return 0;
+}
@@ -0,0 +1,162 @@
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/CoFSM.h"
+#include "../Header/CoFsmWorld.h"
+
+// Many CoFsm instances stepped at 60 fps, each with a number of coroutines that loop on
+// yield::wait with random durations of 0.5 .. 5 s, so only a small part of the pending timers is due
+// in any frame. This is the cost Step pays for timers that are not due yet.
+// The transition part has every FSM switch state each frame, every state calling a nested coroutine
+// that returns a value, which is what makes coroutine frames come and go; once naming the next
+// state by string, once through an enum handle.
+// The world part runs the same waiting FSMs inside a CoFsmWorld, on one thread and spread over a
+// ThreadPool with one worker per extra hardware thread.
+// usage: CoFsmBenchmark [fsms] [coroutinesPerFsm] [frames]
+
+namespace
+{
+	uint64_t g_resumes = 0;
+
+	fsm_coro<> Waiter(uint32_t seed)
+	{
+		std::minstd_rand rng(seed);
+		std::uniform_real_distribution<float> duration(0.5f, 5.0f);
+		while (true)
+		{
+			co_await yield::wait(duration(rng));
+			g_resumes++;
+		}
+	}
+
+	fsm_coro<> Idle(const float&, const float&)
+	{
+		while (true)
+			co_await yield::wait(1000.0f);
+	}
+
+	fsm_coro<uint64_t> Nested(uint64_t value)
+	{
+		co_await yield::ret(value + 1);
+	}
+
+	enum class PingPong : uint32_t
+	{
+		Ping,
+		Pong
+	};
+
+	template<bool ByName>
+	fsm_coro<> Ping(const float&, const float&)
+	{
+		g_resumes += co_await Nested(g_resumes);
+		if constexpr (ByName)
+			co_await yield::state("pong");
+		else
+			co_await yield::state(PingPong::Pong);
+	}
+
+	template<bool ByName>
+	fsm_coro<> Pong(const float&, const float&)
+	{
+		g_resumes -= co_await Nested(0);
+		if constexpr (ByName)
+			co_await yield::state("ping");
+		else
+			co_await yield::state(PingPong::Ping);
+	}
+
+	void BenchWaits(size_t fsmCount, size_t coroutines, size_t frames)
+	{
+		std::vector<CoFsm> fsms(fsmCount);
+		uint32_t seed = 1;
+		for (CoFsm& fsm : fsms)
+		{
+			fsm.AddState({ "idle", Idle, nullptr });
+			fsm.Run("idle");
+			for (size_t i = 0; i < coroutines; i++)
+				fsm.StartCoroutine(Waiter(seed++));
+		}
+
+		g_resumes = 0;
+		Stopwatch watch;
+		for (size_t frame = 0; frame < frames; frame++)
+		{
+			for (CoFsm& fsm : fsms)
+				fsm.Step(1.0f / 60.0f);
+		}
+		ReportBenchmark("CoFsm::Step, waiting coroutines", fsmCount * frames, watch.ElapsedMs());
+		std::printf("%-48s %12llu coroutine resumes\n", "", static_cast<unsigned long long>(g_resumes));
+	}
+
+	void BenchWorld(size_t fsmCount, size_t coroutines, size_t frames, ThreadPool* pool)
+	{
+		CoFsmWorld world(pool);
+		uint32_t seed = 1;
+		for (size_t i = 0; i < fsmCount; i++)
+		{
+			world.With(world.Create(), [&](CoFsm& fsm) {
+				fsm.AddState({ "idle", Idle, nullptr });
+				fsm.Run("idle");
+				for (size_t c = 0; c < coroutines; c++)
+					fsm.StartCoroutine(Waiter(seed++));
+			});
+		}
+
+		g_resumes = 0;
+		Stopwatch watch;
+		for (size_t frame = 0; frame < frames; frame++)
+			world.Step(1.0f / 60.0f);
+		const std::string name = pool ? "CoFsmWorld::Step, " + std::to_string(pool->WorkerCount() + 1) + " threads" : "CoFsmWorld::Step, 1 thread";
+		ReportBenchmark(name, fsmCount * frames, watch.ElapsedMs());
+		// resumes are only counted exactly on one thread
+		if (!pool)
+			std::printf("%-48s %12llu coroutine resumes\n", "", static_cast<unsigned long long>(g_resumes));
+	}
+
+	template<bool ByName>
+	void BenchTransitions(size_t fsmCount, size_t frames)
+	{
+		std::vector<CoFsm> fsms(fsmCount);
+		for (CoFsm& fsm : fsms)
+		{
+			fsm.AddState(PingPong::Ping, { "ping", Ping<ByName>, nullptr });
+			fsm.AddState(PingPong::Pong, { "pong", Pong<ByName>, nullptr });
+			fsm.Run(PingPong::Ping);
+		}
+
+		g_resumes = 0;
+		Stopwatch watch;
+		for (size_t frame = 0; frame < frames; frame++)
+		{
+			for (CoFsm& fsm : fsms)
+				fsm.Step(1.0f / 60.0f);
+		}
+		ReportBenchmark(ByName ? "CoFsm::Step, state change by name" : "CoFsm::Step, state change by handle", fsmCount * frames, watch.ElapsedMs());
+		DoNotOptimize(g_resumes);
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t fsmCount = argc > 1 ? static_cast<size_t>(std::atoll(args[1])) : 10000;
+	const size_t coroutines = argc > 2 ? static_cast<size_t>(std::atoll(args[2])) : 32;
+	const size_t frames = argc > 3 ? static_cast<size_t>(std::atoll(args[3])) : 600;
+
+	std::printf("CoFsm benchmark: %zu fsms x %zu waiting coroutines, %zu frames\n", fsmCount, coroutines, frames);
+	BenchWaits(fsmCount, coroutines, frames);
+	BenchWorld(fsmCount, coroutines, frames, nullptr);
+	if (std::thread::hardware_concurrency() > 1)
+	{
+		ThreadPool pool(std::thread::hardware_concurrency() - 1);
+		BenchWorld(fsmCount, coroutines, frames, &pool);
+	}
+	BenchTransitions<true>(fsmCount, frames);
+	BenchTransitions<false>(fsmCount, frames);
+	ReportInstrumentation();
+	return 0;
+}
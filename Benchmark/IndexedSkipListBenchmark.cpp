@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/IndexedSkipList.h"
+
+// IndexedSkipList footprint and lookup speed: resident memory per element after inserting
+// the elements in random order, then random Find, At and EraseAt.
+// usage: IndexedSkipListBenchmark [elements]
+
+int main(int argc, char** args)
+{
+	const size_t elements = argc > 1 ? static_cast<size_t>(std::atoll(args[1])) : 1000000;
+
+	std::vector<uint64_t> keys(elements);
+	for (size_t i = 0; i < elements; i++)
+		keys[i] = i * 2;
+	std::mt19937_64 rng(42);
+	std::shuffle(keys.begin(), keys.end(), rng);
+	std::vector<size_t> positions(elements);
+	for (size_t& position : positions)
+		position = rng() % elements;
+
+	std::printf("IndexedSkipList benchmark: %zu elements\n", elements);
+
+	const size_t residentBefore = CurrentResidentBytes();
+	IndexedSkipList<uint64_t> list;
+	Stopwatch watch;
+	for (uint64_t k : keys)
+		list.Insert(k);
+	ReportBenchmark("IndexedSkipList random insert", elements, watch.ElapsedMs());
+	const size_t residentAfter = CurrentResidentBytes();
+	if (residentBefore != 0 && residentAfter >= residentBefore)
+		std::printf("%-48s %12.1f bytes/element\n", "IndexedSkipList resident memory",
+			static_cast<double>(residentAfter - residentBefore) / static_cast<double>(elements));
+
+	watch.Restart();
+	size_t hits = 0;
+	for (uint64_t k : keys)
+		hits += list.Find(k) ? 1 : 0;
+	DoNotOptimize(hits);
+	ReportBenchmark("IndexedSkipList random find", elements, watch.ElapsedMs());
+
+	watch.Restart();
+	uint64_t sum = 0;
+	for (size_t position : positions)
+		sum += *list.At(position);
+	DoNotOptimize(sum);
+	ReportBenchmark("IndexedSkipList random At", elements, watch.ElapsedMs());
+
+	watch.Restart();
+	for (size_t i = 0; i < elements; i++)
+		list.EraseAt(positions[i] % list.Size());
+	ReportBenchmark("IndexedSkipList random EraseAt", elements, watch.ElapsedMs());
+	ReportInstrumentation();
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/Logger.h"
+
+// N threads log formatted records as fast as they can into a file, in both producer modes, until
+// Flush returns; ops/s is what made it to the worker. Built with CUCW_INSTRUMENTATION every run also
+// reports how long producers stalled waiting for buffer space (LogStallNs).
+// usage: LoggerBenchmark [recordsPerThread] [maxThreads]
+
+namespace
+{
+	void Run(const char* modeName, Logger::ProducerMode mode, size_t threads, size_t recordsPerThread, const std::filesystem::path& file)
+	{
+		Logger::Config config;
+		config.minLevel = Logger::Level::Info;
+		config.targetFile = file.string();
+		config.producerMode = mode;
+		config.fullPolicy = Logger::FullPolicy::Block;
+		Logger::Instance().Initialize(config);
+		Instrumentation::Reset();
+
+		Stopwatch watch;
+		std::vector<std::thread> producers;
+		for (size_t t = 0; t < threads; t++)
+		{
+			producers.emplace_back([t, recordsPerThread]
+			{
+				for (size_t i = 0; i < recordsPerThread; i++)
+					LOG_INFO_FMT("record {} from producer {}", i, t);
+			});
+		}
+		for (std::thread& producer : producers)
+			producer.join();
+		LOG_FLUSH();
+		const double ms = watch.ElapsedMs();
+		Logger::Instance().Shutdown();
+
+		ReportBenchmark(std::string(modeName) + ", " + std::to_string(threads) + " threads", threads * recordsPerThread, ms);
+		ReportInstrumentation();
+		std::error_code ignored;
+		std::filesystem::remove(file, ignored);
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t recordsPerThread = argc > 1 ? static_cast<size_t>(std::atoll(args[1])) : 200000;
+	const unsigned hardware = std::thread::hardware_concurrency();
+	const size_t maxThreads = argc > 2 ? static_cast<size_t>(std::atoll(args[2])) : (hardware > 4 ? hardware : 4);
+	const std::filesystem::path file = std::filesystem::temp_directory_path() / "LoggerBenchmark.log";
+
+	std::printf("logger benchmark: %zu records per thread into %s\n", recordsPerThread, file.string().c_str());
+	for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		Run("SharedBuffer", Logger::ProducerMode::SharedBuffer, threads, recordsPerThread, file);
+		Run("ThreadLocalBuffers", Logger::ProducerMode::ThreadLocalBuffers, threads, recordsPerThread, file);
+	}
+	return 0;
+}
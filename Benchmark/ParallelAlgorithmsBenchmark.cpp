@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/ParallelAlgorithms.h"
+
+// scaling of ParallelFor / ParallelReduce / ParallelSort from 1 to N threads (caller included)
+// usage: ParallelAlgorithmsBenchmark [maxThreads] [elements]
+
+namespace
+{
+	std::string Label(const char* name, size_t threads)
+	{
+		return std::string(name) + ", " + std::to_string(threads) + " thread(s)";
+	}
+
+	void BenchFor(size_t threads, std::vector<double>& data)
+	{
+		ThreadPool pool(threads - 1, ThreadPool::Mode::WorkStealing);
+		Stopwatch watch;
+		ParallelFor(pool, size_t(0), data.size(), [&data](size_t i) { data[i] = std::sqrt(data[i] + 1.0); });
+		ReportBenchmark(Label("ParallelFor sqrt", threads), data.size(), watch.ElapsedMs());
+	}
+
+	void BenchReduce(size_t threads, const std::vector<double>& data)
+	{
+		ThreadPool pool(threads - 1, ThreadPool::Mode::WorkStealing);
+		Stopwatch watch;
+		const double sum = ParallelReduce(pool, size_t(0), data.size(), 0.0,
+			[&data](size_t i) { return data[i] * data[i]; },
+			[](double a, double b) { return a + b; });
+		const double ms = watch.ElapsedMs();
+		DoNotOptimize(sum);
+		ReportBenchmark(Label("ParallelReduce sum of squares", threads), data.size(), ms);
+	}
+
+	void BenchSort(size_t threads, const std::vector<uint64_t>& source)
+	{
+		std::vector<uint64_t> data = source;
+		ThreadPool pool(threads - 1, ThreadPool::Mode::WorkStealing);
+		Stopwatch watch;
+		ParallelSort(pool, data.begin(), data.end());
+		const double ms = watch.ElapsedMs();
+		if (!std::is_sorted(data.begin(), data.end()))
+			std::printf("ParallelSort produced unsorted output!\n");
+		ReportBenchmark(Label("ParallelSort uint64", threads), data.size(), ms);
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t hw = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
+	const size_t maxThreads = argc > 1 ? std::strtoull(args[1], nullptr, 10) : hw;
+	const size_t elements = argc > 2 ? std::strtoull(args[2], nullptr, 10) : 4000000;
+
+	std::mt19937_64 rng(42);
+	std::vector<double> values(elements);
+	std::vector<uint64_t> keys(elements);
+	for (size_t i = 0; i < elements; i++)
+	{
+		values[i] = static_cast<double>(rng() % 1000);
+		keys[i] = rng();
+	}
+
+	{
+		std::vector<uint64_t> data = keys;
+		Stopwatch watch;
+		std::sort(data.begin(), data.end());
+		ReportBenchmark("std::sort baseline", data.size(), watch.ElapsedMs());
+	}
+
+	for (size_t threads = 1; threads <= maxThreads; threads++)
+	{
+		BenchFor(threads, values);
+		BenchReduce(threads, values);
+		BenchSort(threads, keys);
+	}
+	ReportInstrumentation();
+	return 0;
+}
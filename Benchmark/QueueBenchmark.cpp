@@ -0,0 +1,155 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/LockFreeQueue.h"
+#include "../Header/MPMCRingBuffer.h"
+#include "../Header/WaitableQueue.h"
+
+// many producers / many consumers through the multi-producer queues: LockFreeQueue and MPMCRingBuffer
+// polled with a yield when they are empty or full, and both behind WaitableQueue, whose consumers
+// block in Pop. Every configuration moves the same items and checks their sum.
+// usage: QueueBenchmark [itemsPerProducer] [maxThreadsPerSide]
+
+namespace
+{
+	constexpr size_t kRingCapacity = 4096;
+
+	template<typename Queue>
+	bool TryPushItem(Queue& queue, uint64_t value)
+	{
+		if constexpr (requires { queue.TryPush(value); })
+			return queue.TryPush(value);
+		else
+		{
+			queue.Enqueue(value);
+			return true;
+		}
+	}
+
+	template<typename Queue>
+	bool TryPopItem(Queue& queue, uint64_t& out)
+	{
+		if constexpr (requires { queue.TryPop(out); })
+			return queue.TryPop(out);
+		else
+			return queue.Dequeue(out);
+	}
+
+	// polling producers and consumers
+	template<typename Queue, typename ...Args>
+	void RunPolled(const std::string& name, size_t producers, size_t consumers, uint64_t itemsPerProducer, Args&&... args)
+	{
+		Queue queue(std::forward<Args>(args)...);
+		const uint64_t total = producers * itemsPerProducer;
+		std::atomic<uint64_t> received{ 0 };
+		std::atomic<uint64_t> checksum{ 0 };
+		std::vector<std::thread> threads;
+
+		Stopwatch watch;
+		for (size_t c = 0; c < consumers; c++)
+		{
+			threads.emplace_back([&]
+			{
+				uint64_t sum = 0;
+				uint64_t value = 0;
+				while (received.load(std::memory_order_relaxed) < total)
+				{
+					if (TryPopItem(queue, value))
+					{
+						sum += value;
+						received.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+				checksum.fetch_add(sum, std::memory_order_relaxed);
+			});
+		}
+		for (size_t p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&, p]
+			{
+				const uint64_t first = p * itemsPerProducer;
+				for (uint64_t i = 0; i < itemsPerProducer; i++)
+				{
+					while (!TryPushItem(queue, first + i))
+						std::this_thread::yield();
+				}
+			});
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+		const double ms = watch.ElapsedMs();
+
+		if (checksum.load() != total * (total - 1) / 2)
+			std::printf("%s: checksum mismatch\n", name.c_str());
+		ReportBenchmark(name + " " + std::to_string(producers) + "p/" + std::to_string(consumers) + "c", total, ms);
+	}
+
+	// producers Push, consumers block in Pop until the queue is closed and drained
+	template<typename Queue, typename ...Args>
+	void RunBlocking(const std::string& name, size_t producers, size_t consumers, uint64_t itemsPerProducer, Args&&... args)
+	{
+		WaitableQueue<uint64_t, Queue> queue(std::forward<Args>(args)...);
+		const uint64_t total = producers * itemsPerProducer;
+		std::atomic<uint64_t> checksum{ 0 };
+		std::vector<std::thread> consumerThreads;
+		std::vector<std::thread> producerThreads;
+
+		Stopwatch watch;
+		for (size_t c = 0; c < consumers; c++)
+		{
+			consumerThreads.emplace_back([&]
+			{
+				uint64_t sum = 0;
+				uint64_t value = 0;
+				while (queue.Pop(value))
+					sum += value;
+				checksum.fetch_add(sum, std::memory_order_relaxed);
+			});
+		}
+		for (size_t p = 0; p < producers; p++)
+		{
+			producerThreads.emplace_back([&, p]
+			{
+				const uint64_t first = p * itemsPerProducer;
+				for (uint64_t i = 0; i < itemsPerProducer; i++)
+					queue.Push(first + i);
+			});
+		}
+		for (std::thread& thread : producerThreads)
+			thread.join();
+		queue.Close();
+		for (std::thread& thread : consumerThreads)
+			thread.join();
+		const double ms = watch.ElapsedMs();
+
+		if (checksum.load() != total * (total - 1) / 2)
+			std::printf("%s: checksum mismatch\n", name.c_str());
+		ReportBenchmark(name + " " + std::to_string(producers) + "p/" + std::to_string(consumers) + "c", total, ms);
+	}
+}
+
+int main(int argc, char** args)
+{
+	const uint64_t itemsPerProducer = argc > 1 ? std::strtoull(args[1], nullptr, 10) : 1000000;
+	const unsigned hardware = std::thread::hardware_concurrency();
+	const size_t maxThreads = argc > 2 ? static_cast<size_t>(std::atoll(args[2])) : (hardware > 2 ? hardware / 2 : 1);
+
+	std::printf("queue benchmark: %llu items per producer\n", static_cast<unsigned long long>(itemsPerProducer));
+	for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		RunPolled<LockFreeQueue<uint64_t>>("LockFreeQueue", threads, threads, itemsPerProducer);
+		RunPolled<MPMCRingBuffer<uint64_t, true>>("MPMCRingBuffer", threads, threads, itemsPerProducer, kRingCapacity);
+		RunBlocking<LockFreeQueue<uint64_t>>("WaitableQueue<LockFreeQueue>", threads, threads, itemsPerProducer);
+		RunBlocking<MPMCRingBuffer<uint64_t, true>>("WaitableQueue<MPMCRingBuffer>", threads, threads, itemsPerProducer, kRingCapacity);
+	}
+	ReportInstrumentation();
+	return 0;
+}
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/IndexedSkipList.h"
+#include "../Header/RBTree.h"
+
+// RBTree (map and set) against std::map / std::set: random insert, lookup, full iteration, short
+// range scans (the time-range lookup pattern), bulk build from sorted input and random erase.
+// The order statistic section prices the subtree counts (insert/erase against the plain tree) and
+// compares positional access with IndexedSkipList.
+// usage: RBTreeBenchmark [elements]
+
+namespace
+{
+	constexpr uint64_t kRangeWidth = 64; // keys are dense, so a scan visits about this many elements
+	constexpr size_t kRangeQueries = 100000;
+
+	struct RBTreeMap
+	{
+		static constexpr const char* kName = "RBTree";
+		RBTree<uint64_t, uint64_t> tree;
+
+		void Insert(uint64_t k, uint64_t v) { tree.Insert(k, v); }
+		bool Find(uint64_t k) const { return tree.Find(k) != nullptr; }
+		void Erase(uint64_t k) { tree.Erase(k); }
+
+		uint64_t SumAll() const
+		{
+			uint64_t sum = 0;
+			for (const auto& entry : tree)
+				sum += entry.value;
+			return sum;
+		}
+
+		uint64_t SumRange(uint64_t lo, uint64_t hi) const
+		{
+			uint64_t sum = 0;
+			tree.RangeForEach(lo, hi, [&sum](uint64_t, uint64_t v) { sum += v; });
+			return sum;
+		}
+
+		void Build(const std::vector<std::pair<uint64_t, uint64_t>>& sorted) { tree.BuildFromSorted(sorted.begin(), sorted.end()); }
+	};
+
+	struct StdMap
+	{
+		static constexpr const char* kName = "std::map";
+		std::map<uint64_t, uint64_t> tree;
+
+		void Insert(uint64_t k, uint64_t v) { tree.insert_or_assign(k, v); }
+		bool Find(uint64_t k) const { return tree.find(k) != tree.end(); }
+		void Erase(uint64_t k) { tree.erase(k); }
+
+		uint64_t SumAll() const
+		{
+			uint64_t sum = 0;
+			for (const auto& entry : tree)
+				sum += entry.second;
+			return sum;
+		}
+
+		uint64_t SumRange(uint64_t lo, uint64_t hi) const
+		{
+			uint64_t sum = 0;
+			for (auto it = tree.lower_bound(lo); it != tree.end() && it->first < hi; ++it)
+				sum += it->second;
+			return sum;
+		}
+
+		void Build(const std::vector<std::pair<uint64_t, uint64_t>>& sorted) { tree = std::map<uint64_t, uint64_t>(sorted.begin(), sorted.end()); }
+	};
+
+	std::string Label(const char* container, const char* what)
+	{
+		return std::string(container) + " " + what;
+	}
+
+	template<typename Map>
+	void BenchMap(const std::vector<uint64_t>& keys, const std::vector<std::pair<uint64_t, uint64_t>>& sorted)
+	{
+		Map map;
+		Stopwatch watch;
+		for (uint64_t k : keys)
+			map.Insert(k, k);
+		ReportBenchmark(Label(Map::kName, "random insert"), keys.size(), watch.ElapsedMs());
+
+		watch.Restart();
+		size_t hits = 0;
+		for (uint64_t k : keys)
+			hits += map.Find(k) ? 1 : 0;
+		DoNotOptimize(hits);
+		ReportBenchmark(Label(Map::kName, "random find"), keys.size(), watch.ElapsedMs());
+
+		watch.Restart();
+		uint64_t sum = 0;
+		for (int pass = 0; pass < 10; pass++)
+			sum += map.SumAll();
+		DoNotOptimize(sum);
+		ReportBenchmark(Label(Map::kName, "full iteration x10"), keys.size() * 10, watch.ElapsedMs());
+
+		std::mt19937_64 rng(7);
+		const uint64_t keySpace = sorted.size() * 2;
+		watch.Restart();
+		sum = 0;
+		for (size_t q = 0; q < kRangeQueries; q++)
+		{
+			const uint64_t lo = rng() % keySpace;
+			sum += map.SumRange(lo, lo + kRangeWidth * 2);
+		}
+		DoNotOptimize(sum);
+		ReportBenchmark(Label(Map::kName, "range scan (64 elements)"), kRangeQueries, watch.ElapsedMs());
+
+		watch.Restart();
+		for (uint64_t k : keys)
+			map.Erase(k);
+		ReportBenchmark(Label(Map::kName, "random erase"), keys.size(), watch.ElapsedMs());
+
+		Map built;
+		watch.Restart();
+		built.Build(sorted);
+		ReportBenchmark(Label(Map::kName, "build from sorted"), sorted.size(), watch.ElapsedMs());
+
+		// a bulk built tree is laid out in key order, iteration is a linear walk over memory
+		watch.Restart();
+		sum = 0;
+		for (int pass = 0; pass < 10; pass++)
+			sum += built.SumAll();
+		DoNotOptimize(sum);
+		ReportBenchmark(Label(Map::kName, "iteration after build x10"), sorted.size() * 10, watch.ElapsedMs());
+	}
+
+	template<typename Set>
+	void BenchSet(const char* name, const std::vector<uint64_t>& keys)
+	{
+		Set set;
+		Stopwatch watch;
+		for (uint64_t k : keys)
+		{
+			if constexpr (requires { set.Insert(k); })
+				set.Insert(k);
+			else
+				set.insert(k);
+		}
+		ReportBenchmark(Label(name, "random insert"), keys.size(), watch.ElapsedMs());
+
+		watch.Restart();
+		size_t hits = 0;
+		for (uint64_t k : keys)
+		{
+			if constexpr (requires { set.Contains(k); })
+				hits += set.Contains(k) ? 1 : 0;
+			else
+				hits += set.count(k);
+		}
+		DoNotOptimize(hits);
+		ReportBenchmark(Label(name, "random contains"), keys.size(), watch.ElapsedMs());
+	}
+
+	void BenchOrderStatistics(const std::vector<uint64_t>& keys)
+	{
+		RBTree<uint64_t, void, std::less<uint64_t>, OrderStatisticPolicy> ranked;
+		Stopwatch watch;
+		for (uint64_t k : keys)
+			ranked.Insert(k);
+		ReportBenchmark("RBTree<OrderStatistic> random insert", keys.size(), watch.ElapsedMs());
+
+		IndexedSkipList<uint64_t> skipList;
+		watch.Restart();
+		for (uint64_t k : keys)
+			skipList.Insert(k);
+		ReportBenchmark("IndexedSkipList random insert", keys.size(), watch.ElapsedMs());
+
+		std::mt19937_64 rng(11);
+		std::vector<size_t> positions(keys.size());
+		for (size_t& position : positions)
+			position = rng() % keys.size();
+
+		watch.Restart();
+		uint64_t sum = 0;
+		for (size_t position : positions)
+			sum += *ranked.At(position);
+		DoNotOptimize(sum);
+		ReportBenchmark("RBTree<OrderStatistic> At", positions.size(), watch.ElapsedMs());
+
+		watch.Restart();
+		sum = 0;
+		for (size_t position : positions)
+			sum += *skipList.At(position);
+		DoNotOptimize(sum);
+		ReportBenchmark("IndexedSkipList At", positions.size(), watch.ElapsedMs());
+
+		watch.Restart();
+		sum = 0;
+		for (uint64_t k : keys)
+			sum += ranked.RankOf(k);
+		DoNotOptimize(sum);
+		ReportBenchmark("RBTree<OrderStatistic> RankOf", keys.size(), watch.ElapsedMs());
+
+		watch.Restart();
+		for (uint64_t k : keys)
+			ranked.Erase(k);
+		ReportBenchmark("RBTree<OrderStatistic> random erase", keys.size(), watch.ElapsedMs());
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t elements = argc > 1 ? static_cast<size_t>(std::atoll(args[1])) : 1000000;
+
+	// even keys only, so range bounds and misses fall between elements
+	std::vector<uint64_t> keys(elements);
+	for (size_t i = 0; i < elements; i++)
+		keys[i] = i * 2;
+	std::vector<std::pair<uint64_t, uint64_t>> sorted;
+	sorted.reserve(elements);
+	for (uint64_t k : keys)
+		sorted.emplace_back(k, k);
+	std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+
+	std::printf("RBTree benchmark: %zu elements\n", elements);
+	BenchMap<RBTreeMap>(keys, sorted);
+	BenchMap<StdMap>(keys, sorted);
+	BenchSet<RBTree<uint64_t, void>>("RBTree<void>", keys);
+	BenchSet<std::set<uint64_t>>("std::set", keys);
+	BenchOrderStatistics(keys);
+	ReportInstrumentation();
+	return 0;
+}
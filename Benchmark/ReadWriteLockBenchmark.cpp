@@ -0,0 +1,114 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/ReadMostly.h"
+#include "../Header/ReadWriteLock.h"
+
+// Reader scaling of the read-mostly primitives: 1, 2, 4 ... reader threads each read a small record
+// a fixed number of times while one writer replaces it every writeIntervalUs microseconds. Compares
+// ReadWriteLock (std::shared_mutex), ShardedReadWriteLock, SeqLock and ReadMostly; the interesting
+// number is how the ops/s grow with the thread count, which needs as many cores as reader threads.
+// usage: ReadWriteLockBenchmark [readsPerThread] [maxThreads] [writeIntervalUs]
+
+namespace
+{
+	struct Record
+	{
+		uint64_t values[8];
+	};
+
+	uint64_t Sum(const Record& record)
+	{
+		uint64_t sum = 0;
+		for (uint64_t value : record.values)
+			sum += value;
+		return sum;
+	}
+
+	Record MakeRecord(uint64_t version)
+	{
+		Record record{};
+		for (uint64_t& value : record.values)
+			value = version;
+		return record;
+	}
+
+	template<typename ReadFn, typename WriteFn>
+	void RunScaling(const std::string& name, size_t threads, size_t readsPerThread, unsigned writeIntervalUs, ReadFn read, WriteFn write)
+	{
+		std::atomic<bool> go{ false };
+		std::atomic<size_t> finished{ 0 };
+		std::vector<std::thread> readers;
+		for (size_t t = 0; t < threads; t++)
+		{
+			readers.emplace_back([&, t]
+			{
+				PinCurrentThread(static_cast<unsigned>(t));
+				while (!go.load(std::memory_order_acquire))
+					std::this_thread::yield();
+				uint64_t sum = 0;
+				for (size_t i = 0; i < readsPerThread; i++)
+					sum += read();
+				DoNotOptimize(sum);
+				finished.fetch_add(1, std::memory_order_release);
+			});
+		}
+
+		Stopwatch watch;
+		go.store(true, std::memory_order_release);
+		uint64_t version = 0;
+		while (finished.load(std::memory_order_acquire) < threads)
+		{
+			write(++version);
+			std::this_thread::sleep_for(std::chrono::microseconds(writeIntervalUs));
+		}
+		for (std::thread& reader : readers)
+			reader.join();
+		ReportBenchmark(name + ", " + std::to_string(threads) + " readers", threads * readsPerThread, watch.ElapsedMs());
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t readsPerThread = argc > 1 ? static_cast<size_t>(std::atoll(args[1])) : 2000000;
+	const unsigned hardware = std::thread::hardware_concurrency();
+	const size_t maxThreads = argc > 2 ? static_cast<size_t>(std::atoll(args[2])) : (hardware > 4 ? hardware : 4);
+	const unsigned writeIntervalUs = argc > 3 ? static_cast<unsigned>(std::atoi(args[3])) : 100;
+
+	for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		{
+			ReadWriteLock lock;
+			Record record = MakeRecord(0);
+			RunScaling("ReadWriteLock", threads, readsPerThread, writeIntervalUs,
+				[&] { auto hold = lock.OnRead(); return Sum(record); },
+				[&](uint64_t version) { auto hold = lock.OnWrite(); record = MakeRecord(version); });
+		}
+		{
+			ShardedReadWriteLock lock;
+			Record record = MakeRecord(0);
+			RunScaling("ShardedReadWriteLock", threads, readsPerThread, writeIntervalUs,
+				[&] { auto hold = lock.OnRead(); return Sum(record); },
+				[&](uint64_t version) { auto hold = lock.OnWrite(); record = MakeRecord(version); });
+		}
+		{
+			SeqLock<Record> lock(MakeRecord(0));
+			RunScaling("SeqLock", threads, readsPerThread, writeIntervalUs,
+				[&] { return Sum(lock.OnRead()); },
+				[&](uint64_t version) { lock.Store(MakeRecord(version)); });
+		}
+		{
+			ReadMostly<Record> holder(MakeRecord(0));
+			RunScaling("ReadMostly", threads, readsPerThread, writeIntervalUs,
+				[&] { auto snapshot = holder.OnRead(); return Sum(*snapshot); },
+				[&](uint64_t version) { holder.Store(MakeRecord(version)); });
+		}
+	}
+	ReportInstrumentation();
+	return 0;
+}
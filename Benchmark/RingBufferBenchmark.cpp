@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/MPMCRingBuffer.h"
+#include "../Header/SPSCRingBuffer.h"
+
+// one producer and one consumer pinned to a pair of cpus, for the default and the HighThroughput
+// configuration of both rings:
+//   throughput  single element TryPush / TryPop, and TryPushBulk / TryPopBulk in batches of kBatch
+//   latency     round trip of one element through a pair of rings (ping-pong)
+// The capacity is deliberately not a power of two, HighThroughput rounds it up.
+// usage: RingBufferBenchmark [items] [cpuA cpuB]...   (default pairs: 0-1, 0-2, 0-(n/2), 0-(n-1))
+
+namespace
+{
+	constexpr size_t kCapacity = 1000;
+	constexpr size_t kBatch = 64;
+
+	// both threads on one cpu can only make progress if the spinning side gives up its time slice
+	inline void Wait(bool sharedCpu)
+	{
+		if (sharedCpu)
+			std::this_thread::yield();
+	}
+
+	template<typename Ring>
+	void Throughput(const std::string& name, unsigned cpuA, unsigned cpuB, uint64_t items, bool bulk)
+	{
+		Ring ring(kCapacity);
+		uint64_t checksum = 0;
+		Stopwatch watch;
+
+		std::thread consumer([&]
+		{
+			PinCurrentThread(cpuB);
+			uint64_t received = 0;
+			uint64_t sum = 0;
+			uint64_t batch[kBatch];
+			while (received < items)
+			{
+				if (bulk)
+				{
+					const size_t n = ring.TryPopBulk(batch, kBatch);
+					for (size_t i = 0; i < n; i++)
+						sum += batch[i];
+					received += n;
+					if (n == 0)
+						Wait(cpuA == cpuB);
+				}
+				else
+				{
+					uint64_t value;
+					if (ring.TryPop(value))
+					{
+						sum += value;
+						received++;
+					}
+					else
+					{
+						Wait(cpuA == cpuB);
+					}
+				}
+			}
+			checksum = sum;
+		});
+
+		PinCurrentThread(cpuA);
+		uint64_t sent = 0;
+		uint64_t batch[kBatch];
+		while (sent < items)
+		{
+			if (bulk)
+			{
+				const size_t count = static_cast<size_t>(std::min<uint64_t>(kBatch, items - sent));
+				for (size_t i = 0; i < count; i++)
+					batch[i] = sent + i;
+				size_t pushed = 0;
+				while (pushed < count)
+				{
+					const size_t n = ring.TryPushBulk(batch + pushed, count - pushed);
+					if (n == 0)
+						Wait(cpuA == cpuB);
+					pushed += n;
+				}
+				sent += count;
+			}
+			else if (ring.TryPush(sent))
+			{
+				sent++;
+			}
+			else
+			{
+				Wait(cpuA == cpuB);
+			}
+		}
+		consumer.join();
+		const double ms = watch.ElapsedMs();
+
+		DoNotOptimize(checksum);
+		if (checksum != items * (items - 1) / 2)
+			std::printf("%s: checksum mismatch\n", name.c_str());
+		ReportBenchmark(name, items, ms);
+	}
+
+	template<typename Ring>
+	void Latency(const std::string& name, unsigned cpuA, unsigned cpuB, uint64_t roundTrips)
+	{
+		Ring ping(kCapacity);
+		Ring pong(kCapacity);
+
+		std::thread echo([&]
+		{
+			PinCurrentThread(cpuB);
+			for (uint64_t i = 0; i < roundTrips; i++)
+			{
+				uint64_t value;
+				while (!ping.TryPop(value)) Wait(cpuA == cpuB);
+				while (!pong.TryPush(value)) Wait(cpuA == cpuB);
+			}
+		});
+
+		PinCurrentThread(cpuA);
+		Stopwatch watch;
+		for (uint64_t i = 0; i < roundTrips; i++)
+		{
+			while (!ping.TryPush(i)) Wait(cpuA == cpuB);
+			uint64_t value;
+			while (!pong.TryPop(value)) Wait(cpuA == cpuB);
+		}
+		const double ms = watch.ElapsedMs();
+		echo.join();
+
+		std::printf("%-48s %12llu rtt %10.2f ms %14.1f ns/rtt\n", name.c_str(),
+			static_cast<unsigned long long>(roundTrips), ms, ms * 1e6 / static_cast<double>(roundTrips));
+	}
+
+	template<typename Ring>
+	void RunRing(const char* ringName, unsigned cpuA, unsigned cpuB, uint64_t items)
+	{
+		const std::string prefix = std::string(ringName) + " " + std::to_string(cpuA) + "-" + std::to_string(cpuB);
+		Throughput<Ring>(prefix + " push/pop", cpuA, cpuB, items, false);
+		Throughput<Ring>(prefix + " bulk " + std::to_string(kBatch), cpuA, cpuB, items, true);
+		Latency<Ring>(prefix + " ping-pong", cpuA, cpuB, items / 50);
+	}
+}
+
+int main(int argc, char** args)
+{
+	const uint64_t items = argc > 1 ? std::strtoull(args[1], nullptr, 10) : 20000000;
+
+	std::vector<std::pair<unsigned, unsigned>> pairs;
+	for (int i = 2; i + 1 < argc; i += 2)
+		pairs.emplace_back(static_cast<unsigned>(std::atoi(args[i])), static_cast<unsigned>(std::atoi(args[i + 1])));
+	if (pairs.empty())
+	{
+		const unsigned cpus = std::thread::hardware_concurrency();
+		for (unsigned other : { 1u, 2u, cpus / 2, cpus - 1 })
+		{
+			if (other == 0 || other >= cpus)
+				continue;
+			bool known = false;
+			for (const auto& pair : pairs)
+				known = known || pair.second == other;
+			if (!known)
+				pairs.emplace_back(0u, other);
+		}
+		if (pairs.empty())
+			pairs.emplace_back(0u, 0u); // single cpu machine, both threads share it
+	}
+
+	std::printf("ring buffer benchmark: %llu items, capacity %zu\n", static_cast<unsigned long long>(items), kCapacity);
+	for (const auto& [cpuA, cpuB] : pairs)
+	{
+		RunRing<SPSCRingBuffer<uint64_t>>("SPSC", cpuA, cpuB, items);
+		RunRing<SPSCRingBuffer<uint64_t, true>>("SPSC HighThroughput", cpuA, cpuB, items);
+		RunRing<MPMCRingBuffer<uint64_t>>("MPMC", cpuA, cpuB, items);
+		RunRing<MPMCRingBuffer<uint64_t, true>>("MPMC HighThroughput", cpuA, cpuB, items);
+	}
+	ReportInstrumentation();
+	return 0;
+}
@@ -0,0 +1,132 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/LRUCache.h"
+#include "../Header/ReadWriteLock.h"
+#include "../Header/ShardedLRUCache.h"
+
+// read-mostly cache traffic from N threads: LRUCache behind one ReadWriteLock (Get relinks the lists,
+// so every access takes the write side) vs ShardedLRUCache
+// usage: ShardedLRUCacheBenchmark [maxThreads] [opsPerThread]
+
+namespace
+{
+	constexpr int kCapacity = 1 << 16;
+	constexpr uint64_t kKeySpace = kCapacity * 2; // roughly half of the misses then turn into puts
+
+	class LockedLRUCache
+	{
+		LRUCache<uint64_t, uint64_t> _cache{ kCapacity };
+		ReadWriteLock _lock;
+
+	public:
+		bool Get(uint64_t k, uint64_t& out)
+		{
+			auto lock = _lock.OnWrite();
+			auto handle = _cache.Get(k);
+			if (!handle.IsValid())
+				return false;
+			out = handle.Get();
+			return true;
+		}
+
+		void Put(uint64_t k, uint64_t v)
+		{
+			auto lock = _lock.OnWrite();
+			auto handle = _cache.Put(k, v);
+		}
+	};
+
+	class ShardedCache
+	{
+		ShardedLRUCache<uint64_t, uint64_t> _cache{ kCapacity, 32 };
+
+	public:
+		bool Get(uint64_t k, uint64_t& out)
+		{
+			auto handle = _cache.Get(k);
+			if (!handle.IsValid())
+				return false;
+			out = handle.Get();
+			return true;
+		}
+
+		void Put(uint64_t k, uint64_t v)
+		{
+			auto handle = _cache.Put(k, v);
+		}
+
+		const ShardedLRUCache<uint64_t, uint64_t>& Inner() const { return _cache; }
+	};
+
+	// skewed keys: a 16-bit-ish hot set gets most of the traffic, the rest is spread over the key space
+	template<typename CacheT>
+	double Run(CacheT& cache, size_t threads, size_t opsPerThread)
+	{
+		std::atomic<bool> go{ false };
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads; t++)
+		{
+			workers.emplace_back([&cache, &go, t, opsPerThread]() {
+				std::mt19937_64 rng(t * 7919 + 1);
+				std::uniform_int_distribution<uint64_t> hot(0, kCapacity / 4);
+				std::uniform_int_distribution<uint64_t> cold(0, kKeySpace);
+				std::uniform_int_distribution<int> pick(0, 9);
+				while (!go.load(std::memory_order_acquire))
+					std::this_thread::yield();
+
+				uint64_t sum = 0;
+				for (size_t i = 0; i < opsPerThread; i++)
+				{
+					const uint64_t k = pick(rng) < 8 ? hot(rng) : cold(rng);
+					uint64_t v = 0;
+					if (cache.Get(k, v))
+						sum += v;
+					else
+						cache.Put(k, k);
+				}
+				DoNotOptimize(sum);
+			});
+		}
+
+		Stopwatch watch;
+		go.store(true, std::memory_order_release);
+		for (auto& w : workers)
+			w.join();
+		return watch.ElapsedMs();
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t hw = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
+	const size_t maxThreads = argc > 1 ? std::strtoull(args[1], nullptr, 10) : hw;
+	const size_t opsPerThread = argc > 2 ? std::strtoull(args[2], nullptr, 10) : 500000;
+
+	std::printf("ShardedLRUCache benchmark: capacity %d, up to %zu threads, %zu ops per thread\n",
+		kCapacity, maxThreads, opsPerThread);
+	for (size_t threads = 1; threads <= maxThreads; threads++)
+	{
+		{
+			LockedLRUCache cache;
+			const double ms = Run(cache, threads, opsPerThread);
+			ReportBenchmark("LRUCache + ReadWriteLock, " + std::to_string(threads) + " thread(s)", threads * opsPerThread, ms);
+		}
+		{
+			ShardedCache cache;
+			const double ms = Run(cache, threads, opsPerThread);
+			ReportBenchmark("ShardedLRUCache(32), " + std::to_string(threads) + " thread(s)", threads * opsPerThread, ms);
+			const auto stats = cache.Inner().GetStats();
+			std::printf("    hit rate %.3f, evictions %llu\n",
+				static_cast<double>(stats.hits) / static_cast<double>(stats.hits + stats.misses),
+				static_cast<unsigned long long>(stats.evictions));
+		}
+	}
+	ReportInstrumentation();
+	return 0;
+}
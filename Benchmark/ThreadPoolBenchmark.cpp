@@ -0,0 +1,125 @@
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/ThreadPool.h"
+
+// fan-out/fan-in with tiny tasks: global-queue pool vs work-stealing pool,
+// plus the per-task heap allocation count of EnqueueTask vs Post
+// usage: ThreadPoolBenchmark [threads] [tasks]
+
+static std::atomic<size_t> gHeapAllocations{ 0 };
+
+void* operator new(size_t bytes)
+{
+	gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(bytes == 0 ? 1 : bytes))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace
+{
+	const char* ModeName(ThreadPool::Mode mode)
+	{
+		return mode == ThreadPool::Mode::WorkStealing ? "work-stealing" : "global-queue";
+	}
+
+	// the caller submits every task and then blocks on all futures
+	void FlatFanOut(ThreadPool::Mode mode, size_t threads, size_t tasks)
+	{
+		ThreadPool pool(threads, mode);
+		std::atomic<size_t> counter{ 0 };
+		std::vector<std::future<void>> futures;
+		futures.reserve(tasks);
+
+		Stopwatch watch;
+		for (size_t i = 0; i < tasks; i++)
+			futures.emplace_back(pool.EnqueueTask([&counter]() { counter.fetch_add(1, std::memory_order_relaxed); }));
+		for (auto& f : futures)
+			f.get();
+		const double ms = watch.ElapsedMs();
+
+		ReportBenchmark(std::string("flat fan-out/fan-in, ") + ModeName(mode), tasks, ms);
+	}
+
+	// every root task fans out its children from inside a worker, which is where the local deques pay off
+	void NestedFanOut(ThreadPool::Mode mode, size_t threads, size_t tasks)
+	{
+		constexpr size_t kChildrenPerRoot = 64;
+		const size_t roots = tasks / kChildrenPerRoot;
+		const size_t total = roots * kChildrenPerRoot;
+
+		ThreadPool pool(threads, mode);
+		std::atomic<size_t> counter{ 0 };
+
+		Stopwatch watch;
+		for (size_t r = 0; r < roots; r++)
+		{
+			pool.EnqueueTask([&pool, &counter]() {
+				for (size_t c = 0; c < kChildrenPerRoot; c++)
+					pool.EnqueueTask([&counter]() { counter.fetch_add(1, std::memory_order_relaxed); });
+			});
+		}
+		while (counter.load(std::memory_order_acquire) < total)
+			std::this_thread::yield();
+		const double ms = watch.ElapsedMs();
+
+		ReportBenchmark(std::string("nested fan-out/fan-in, ") + ModeName(mode), total, ms);
+	}
+
+	// steady-state submit cost: warm the pool up first, then count heap allocations per task
+	template<bool UsePost>
+	void SubmitPath(ThreadPool::Mode mode, size_t threads, size_t tasks)
+	{
+		ThreadPool pool(threads, mode);
+		std::atomic<size_t> counter{ 0 };
+		auto run = [&](size_t count) {
+			const size_t target = counter.load(std::memory_order_relaxed) + count;
+			for (size_t i = 0; i < count; i++)
+			{
+				if constexpr (UsePost)
+					pool.Post([&counter]() { counter.fetch_add(1, std::memory_order_relaxed); });
+				else
+					pool.EnqueueTask([&counter]() { counter.fetch_add(1, std::memory_order_relaxed); });
+			}
+			while (counter.load(std::memory_order_acquire) < target)
+				std::this_thread::yield();
+		};
+
+		run(tasks);
+		const size_t allocBefore = gHeapAllocations.load(std::memory_order_relaxed);
+		Stopwatch watch;
+		run(tasks);
+		const double ms = watch.ElapsedMs();
+		const size_t allocs = gHeapAllocations.load(std::memory_order_relaxed) - allocBefore;
+
+		ReportBenchmark(std::string(UsePost ? "Post, " : "EnqueueTask, ") + ModeName(mode), tasks, ms);
+		std::printf("    heap allocations per task: %.3f\n", static_cast<double>(allocs) / static_cast<double>(tasks));
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t hw = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
+	const size_t threads = argc > 1 ? std::strtoull(args[1], nullptr, 10) : hw;
+	const size_t tasks = argc > 2 ? std::strtoull(args[2], nullptr, 10) : 200000;
+
+	std::printf("ThreadPool benchmark: %zu threads, %zu tasks\n", threads, tasks);
+	for (ThreadPool::Mode mode : { ThreadPool::Mode::GlobalQueue, ThreadPool::Mode::WorkStealing })
+	{
+		FlatFanOut(mode, threads, tasks);
+		NestedFanOut(mode, threads, tasks);
+		SubmitPath<false>(mode, threads, tasks);
+		SubmitPath<true>(mode, threads, tasks);
+	}
+	ReportInstrumentation();
+	return 0;
+}
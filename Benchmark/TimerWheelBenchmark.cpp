@@ -0,0 +1,98 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "BenchmarkUtil.h"
+#include "../Header/TimerWheel.h"
+
+// TimerWheel on a 1 ms tick holding long timeouts (1 s .. 1 h, log-uniform): the flat wheel against
+// the hierarchical one. The wheel is advanced 1 ms at a time, where the flat wheel keeps revisiting
+// timers that are not due yet, then one call fast-forwards the remaining hour and fires the rest.
+// The churn part models connection timeouts that are pushed back on every packet: each operation
+// cancels one pending timeout and schedules its replacement, and a set of repeating timers fires
+// on every few ticks meanwhile.
+// usage: TimerWheelBenchmark [timers] [simulatedSeconds]
+
+namespace
+{
+	constexpr uint32_t kSlotCount = 256;
+	constexpr uint32_t kMinDelayMs = 1000;
+	constexpr uint32_t kMaxDelayMs = 3600 * 1000;
+
+	void Bench(uint32_t levels, size_t timers, uint32_t simulatedSeconds)
+	{
+		TimerWheel wheel(1, kSlotCount, levels);
+		std::mt19937 rng(42);
+		std::vector<uint32_t> delays(timers);
+		for (uint32_t& delay : delays)
+		{
+			const double exponent = std::uniform_real_distribution<double>(std::log(kMinDelayMs), std::log(kMaxDelayMs))(rng);
+			delay = static_cast<uint32_t>(std::exp(exponent));
+		}
+
+		uint64_t fired = 0;
+		Stopwatch watch;
+		for (size_t i = 0; i < timers; i++)
+			wheel.ScheduleOnce(delays[i], [&fired]() { fired++; });
+		const std::string name = levels == 1 ? "flat wheel" : "hierarchical wheel (" + std::to_string(levels) + " levels)";
+		ReportBenchmark(name + " schedule", timers, watch.ElapsedMs());
+
+		watch.Restart();
+		const uint32_t ticks = simulatedSeconds * 1000;
+		for (uint32_t t = 0; t < ticks; t++)
+			wheel.AdvanceByElapsedMs(1);
+		ReportBenchmark(name + " 1 ms ticks", ticks, watch.ElapsedMs());
+		std::printf("%-48s %12llu timers fired\n", "", static_cast<unsigned long long>(fired));
+
+		// a long stall: one call covering everything that is left
+		watch.Restart();
+		wheel.AdvanceByElapsedMs(kMaxDelayMs);
+		ReportBenchmark(name + " 1 h fast-forward", kMaxDelayMs, watch.ElapsedMs());
+		std::printf("%-48s %12llu timers fired\n", "", static_cast<unsigned long long>(fired));
+	}
+
+	void BenchChurn(uint32_t levels, size_t timers, size_t operations)
+	{
+		constexpr uint32_t kTimeoutMs = 30 * 1000;
+		constexpr size_t kRepeating = 1000;
+		constexpr size_t kOperationsPerTick = 100;
+
+		TimerWheel wheel(1, kSlotCount, levels);
+		std::mt19937 rng(7);
+		uint64_t fired = 0;
+		std::vector<TimerWheel::TimerHandle> handles(timers);
+		// the captures are the size of a typical connection callback, beyond std::function's inline buffer
+		for (size_t i = 0; i < timers; i++)
+			handles[i] = wheel.ScheduleOnce(kTimeoutMs + static_cast<uint32_t>(rng() % 1000), [&fired, &wheel, i]() { fired += i != 0 || wheel.GetTickMs() != 0; });
+		for (size_t i = 0; i < kRepeating; i++)
+			wheel.ScheduleEvery(1 + static_cast<uint32_t>(i % 16), [&fired, &wheel, i]() { fired += i != 0 || wheel.GetTickMs() != 0; });
+
+		const std::string name = "churn (" + std::to_string(levels) + " levels, " + std::to_string(timers) + " timeouts)";
+		Stopwatch watch;
+		for (size_t op = 0; op < operations; op++)
+		{
+			const size_t i = rng() % timers;
+			wheel.Cancel(handles[i]);
+			handles[i] = wheel.ScheduleOnce(kTimeoutMs + static_cast<uint32_t>(rng() % 1000), [&fired, &wheel, i]() { fired += i != 0 || wheel.GetTickMs() != 0; });
+			if (op % kOperationsPerTick == 0)
+				wheel.AdvanceByElapsedMs(1);
+		}
+		ReportBenchmark(name + " cancel + reschedule", operations, watch.ElapsedMs());
+		std::printf("%-48s %12llu timers fired\n", "", static_cast<unsigned long long>(fired));
+	}
+}
+
+int main(int argc, char** args)
+{
+	const size_t timers = argc > 1 ? static_cast<size_t>(std::atoll(args[1])) : 100000;
+	const uint32_t simulatedSeconds = argc > 2 ? static_cast<uint32_t>(std::atoi(args[2])) : 60;
+
+	std::printf("TimerWheel benchmark: %zu timers, %u simulated seconds\n", timers, simulatedSeconds);
+	Bench(1, timers, simulatedSeconds);
+	Bench(4, timers, simulatedSeconds);
+	BenchChurn(4, timers * 10, timers * 20);
+	ReportInstrumentation();
+	return 0;
+}
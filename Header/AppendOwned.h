@@ -0,0 +1,14 @@
+#pragma once
+
+// Appends take() to a std::vector-like list, where take() hands over something that is lost if the
+// push_back throws, e.g. a chunk just allocated from a memory resource: room is made before take()
+// runs, so nothing can leak. The room doubles, reserve(size() + 1) instead would copy the list on
+// every call. Returns the appended element.
+template<typename List, typename Take>
+auto& AppendOwned(List& list, Take&& take)
+{
+	if (list.size() == list.capacity())
+		list.reserve(list.size() * 2 + 1);
+	list.push_back(take());
+	return list.back();
+}
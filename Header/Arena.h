@@ -0,0 +1,215 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+#include "AppendOwned.h"
+#include "NodePool.h"
+
+// Monotonic arena: a std::pmr::memory_resource that bumps a pointer through chunks taken from an
+// upstream resource, where deallocate does nothing and everything goes at once. Rewind(Mark()) frees
+// what was allocated after the mark and Reset frees everything, both keeping the chunks for the next
+// round, so a per-request or per-frame arena stops calling upstream once it has grown to the peak.
+// Hand it to the containers (RBTree, BPlusTree, IndexedSkipList, LRUCache, TimerWheel take a
+// memory_resource*, std::pmr containers a polymorphic_allocator) and drop them before the rewind.
+// Not thread safe; ThreadLocal() is an arena per thread, scoped with ArenaScope.
+class MonotonicArena : public std::pmr::memory_resource
+{
+	struct Chunk
+	{
+		unsigned char* data;
+		size_t bytes;
+	};
+
+	static constexpr size_t kMaxChunkBytes = size_t(16) << 20;
+
+	std::pmr::memory_resource* _upstream;
+	std::vector<Chunk> _chunks{}; // in the order they are carved
+	size_t _current = 0;          // chunk being carved, _chunks.size() when none is left
+	size_t _offset = 0;           // bytes used in the current chunk
+	size_t _nextChunkBytes;
+
+public:
+	struct Marker
+	{
+		size_t chunk = 0;
+		size_t offset = 0;
+	};
+
+	explicit MonotonicArena(size_t initialChunkBytes = 64 * 1024,
+		std::pmr::memory_resource* upstream = std::pmr::new_delete_resource()) :
+		_upstream(upstream),
+		_nextChunkBytes(initialChunkBytes == 0 ? 1024 : initialChunkBytes) {}
+
+	~MonotonicArena()
+	{
+		Release();
+	}
+
+	MonotonicArena(const MonotonicArena&) = delete;
+	MonotonicArena& operator= (const MonotonicArena&) = delete;
+
+	// the calling thread's arena
+	static MonotonicArena& ThreadLocal()
+	{
+		static thread_local MonotonicArena arena;
+		return arena;
+	}
+
+	Marker Mark() const
+	{
+		return Marker{ _current, _offset };
+	}
+
+	// frees everything allocated since 'mark' was taken
+	void Rewind(Marker mark)
+	{
+		assert((mark.chunk < _current || (mark.chunk == _current && mark.offset <= _offset)) && "MonotonicArena: rewinding forward");
+		_current = mark.chunk;
+		_offset = mark.offset;
+	}
+
+	// frees everything and keeps the chunks
+	void Reset()
+	{
+		Rewind(Marker{});
+	}
+
+	// frees everything and hands the chunks back upstream
+	void Release()
+	{
+		for (const Chunk& chunk : _chunks)
+			_upstream->deallocate(chunk.data, chunk.bytes, alignof(std::max_align_t));
+		_chunks.clear();
+		_current = 0;
+		_offset = 0;
+	}
+
+	// bytes held from upstream
+	size_t Capacity() const
+	{
+		size_t bytes = 0;
+		for (const Chunk& chunk : _chunks)
+			bytes += chunk.bytes;
+		return bytes;
+	}
+
+	std::pmr::memory_resource* Upstream() const { return _upstream; }
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		if (bytes == 0)
+			bytes = 1;
+		// kept chunks first, then a fresh one; a chunk too small for the request is skipped for this round
+		for (; _current < _chunks.size(); _current++, _offset = 0)
+		{
+			const Chunk& chunk = _chunks[_current];
+			const uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data);
+			const size_t start = static_cast<size_t>(((base + _offset + alignment - 1) & ~uintptr_t(alignment - 1)) - base);
+			if (start <= chunk.bytes && chunk.bytes - start >= bytes)
+			{
+				_offset = start + bytes;
+				return chunk.data + start;
+			}
+		}
+
+		size_t chunkBytes = _nextChunkBytes;
+		const size_t needed = bytes + (alignment > alignof(std::max_align_t) ? alignment : 0);
+		while (chunkBytes < needed)
+			chunkBytes *= 2;
+		if (_nextChunkBytes < kMaxChunkBytes)
+			_nextChunkBytes *= 2;
+
+		AppendOwned(_chunks, [&] {
+			return Chunk{ static_cast<unsigned char*>(_upstream->allocate(chunkBytes, alignof(std::max_align_t))), chunkBytes };
+		});
+		_current = _chunks.size() - 1;
+		_offset = 0;
+		return do_allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void*, size_t, size_t) override {}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+// Rewinds an arena (the thread's own by default) to where it was when the scope was entered, e.g.
+// around one request; whatever was built on it inside the scope has to be gone by then.
+class ArenaScope
+{
+	MonotonicArena& _arena;
+	MonotonicArena::Marker _mark;
+
+public:
+	explicit ArenaScope(MonotonicArena& arena = MonotonicArena::ThreadLocal()) :
+		_arena(arena),
+		_mark(arena.Mark()) {}
+
+	~ArenaScope()
+	{
+		_arena.Rewind(_mark);
+	}
+
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator= (const ArenaScope&) = delete;
+
+	MonotonicArena& Arena() { return _arena; }
+};
+
+// Fixed-size object pool: Create / Destroy recycle the slots of destroyed objects through a free
+// list and carve new ones from chunks in allocation order (NodePool), which come from the given
+// memory_resource. Objects still alive when the pool goes are not destroyed, only their memory is
+// released. Not thread safe.
+template<typename T>
+class ObjectPool
+{
+	NodePool<T> _nodes;
+	size_t _live = 0;
+
+public:
+	explicit ObjectPool(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+		_nodes(resource) {}
+
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator= (const ObjectPool&) = delete;
+
+	template<typename... Args>
+	T* Create(Args&&... args)
+	{
+		void* storage = _nodes.Allocate();
+		try
+		{
+			T* object = ::new (storage) T(std::forward<Args>(args)...);
+			_live++;
+			return object;
+		}
+		catch (...)
+		{
+			_nodes.Deallocate(storage);
+			throw;
+		}
+	}
+
+	void Destroy(T* object)
+	{
+		if (object == nullptr)
+			return;
+		object->~T();
+		_nodes.Deallocate(object);
+		_live--;
+	}
+
+	// makes the next 'count' Creates one contiguous run (while no destroyed slot is waiting for reuse)
+	void Reserve(size_t count) { _nodes.Reserve(count); }
+
+	// objects created and not destroyed yet
+	size_t Size() const { return _live; }
+	std::pmr::memory_resource* Resource() const { return _nodes.Resource(); }
+};
@@ -0,0 +1,1063 @@
+#pragma once
+#include <assert.h>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "NodePool.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BPLUSTREE_SIMD_LEVEL 3
+#elif defined(__SSE4_2__) || defined(__AVX__)
+#include <nmmintrin.h>
+#define BPLUSTREE_SIMD_LEVEL 2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BPLUSTREE_SIMD_LEVEL 1
+#else
+#define BPLUSTREE_SIMD_LEVEL 0
+#endif
+
+// B+-tree map (BPlusTree<KEY, VAL>) and set (BPlusTree<KEY, void>) with the RBTree interface.
+// Every node holds up to NodeBytes worth of keys in one sorted array, so a lookup touches a handful of
+// wide nodes instead of one cache miss per tree level. Elements live in the leaves, which are linked
+// in key order, so iteration and range scans walk arrays. Nodes come from per-tree NodePools.
+// For 32/64-bit integer keys ordered by std::less, the position inside a node is found by counting
+// the smaller keys with SSE2/SSE4.2/AVX2 compares (as far as the target enables them), other keys use
+// a binary search.
+// Unlike RBTree, elements move between nodes: Insert and Erase invalidate every iterator (Erase
+// returns a valid one). Map iterators dereference to BPlusTreeEntryRef { const KEY& key; VAL& value; },
+// set iterators to const KEY. Keys must be copyable, the inner nodes keep copies as separators.
+
+template<typename KEY, typename VAL>
+struct BPlusTreeEntryRef
+{
+	const KEY& key;
+	VAL& value;
+};
+
+namespace BPlusTreeDetail
+{
+	template<typename KEY, typename Compare>
+	inline constexpr bool kVectorRank = std::is_integral_v<KEY> && !std::is_same_v<KEY, bool> &&
+		(sizeof(KEY) == 4 || sizeof(KEY) == 8) &&
+		(std::is_same_v<Compare, std::less<KEY>> || std::is_same_v<Compare, std::less<>>);
+
+	// keys[0, count) is sorted; returns how many keys are < key (Upper = false) or <= key (Upper = true).
+	// At node widths comparing every key without a branch is cheaper than a mispredicted binary search.
+	template<bool Upper, typename KEY>
+	inline uint32_t VectorRank(const KEY* keys, uint32_t count, KEY key)
+	{
+		uint32_t i = 0;
+		uint32_t hits = 0; // keys before 'key' (lower) or after it (upper)
+#if BPLUSTREE_SIMD_LEVEL > 0
+		// the compares are signed, flipping the sign bit orders unsigned keys the same way
+		if constexpr (sizeof(KEY) == 4)
+		{
+			const int flipBits = std::is_signed_v<KEY> ? 0 : static_cast<int>(0x80000000u);
+#if BPLUSTREE_SIMD_LEVEL >= 3
+			const __m256i flip = _mm256_set1_epi32(flipBits);
+			const __m256i needle = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(key)), flip);
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i k = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), flip);
+				const __m256i mask = Upper ? _mm256_cmpgt_epi32(k, needle) : _mm256_cmpgt_epi32(needle, k);
+				hits += std::popcount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(mask))));
+			}
+#else
+			const __m128i flip = _mm_set1_epi32(flipBits);
+			const __m128i needle = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(key)), flip);
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i k = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), flip);
+				const __m128i mask = Upper ? _mm_cmpgt_epi32(k, needle) : _mm_cmpgt_epi32(needle, k);
+				hits += std::popcount(static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(mask))));
+			}
+#endif
+		}
+#if BPLUSTREE_SIMD_LEVEL >= 2
+		else
+		{
+			const long long flipBits = std::is_signed_v<KEY> ? 0 : static_cast<long long>(0x8000000000000000ull);
+#if BPLUSTREE_SIMD_LEVEL >= 3
+			const __m256i flip = _mm256_set1_epi64x(flipBits);
+			const __m256i needle = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(key)), flip);
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m256i k = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), flip);
+				const __m256i mask = Upper ? _mm256_cmpgt_epi64(k, needle) : _mm256_cmpgt_epi64(needle, k);
+				hits += std::popcount(static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(mask))));
+			}
+#else
+			const __m128i flip = _mm_set1_epi64x(flipBits);
+			const __m128i needle = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(key)), flip);
+			for (; i + 2 <= count; i += 2)
+			{
+				const __m128i k = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), flip);
+				const __m128i mask = Upper ? _mm_cmpgt_epi64(k, needle) : _mm_cmpgt_epi64(needle, k);
+				hits += std::popcount(static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(mask))));
+			}
+#endif
+		}
+#endif
+#endif
+		for (; i < count; i++)
+			hits += Upper ? (key < keys[i]) : (keys[i] < key);
+		return Upper ? count - hits : hits;
+	}
+
+	// uninitialized storage for N elements, the owning node tracks how many are alive
+	template<typename T, std::size_t N>
+	struct Slots
+	{
+		alignas(T) unsigned char bytes[sizeof(T) * N];
+
+		T* Data() { return std::launder(reinterpret_cast<T*>(bytes)); }
+		const T* Data() const { return std::launder(reinterpret_cast<const T*>(bytes)); }
+		T& operator[] (std::size_t i) { return Data()[i]; }
+		const T& operator[] (std::size_t i) const { return Data()[i]; }
+	};
+
+	struct NoSlots {};
+
+	// constructs a T at data[pos] of the 'count' alive elements, shifting the tail up by one
+	template<typename T, typename... Args>
+	inline void SlotInsert(T* data, uint32_t count, uint32_t pos, Args&&... args)
+	{
+		if (pos == count)
+		{
+			::new (static_cast<void*>(data + count)) T(std::forward<Args>(args)...);
+			return;
+		}
+		T value(std::forward<Args>(args)...);
+		::new (static_cast<void*>(data + count)) T(std::move(data[count - 1]));
+		std::move_backward(data + pos, data + count - 1, data + count);
+		data[pos] = std::move(value);
+	}
+
+	template<typename T>
+	inline void SlotErase(T* data, uint32_t count, uint32_t pos)
+	{
+		std::move(data + pos + 1, data + count, data + pos);
+		std::destroy_at(data + count - 1);
+	}
+
+	// moves src[from, to) into the raw storage at dst and ends the lifetime of the sources
+	template<typename T>
+	inline void SlotRelocate(T* src, uint32_t from, uint32_t to, T* dst)
+	{
+		std::uninitialized_move(src + from, src + to, dst);
+		std::destroy(src + from, src + to);
+	}
+
+	template<typename Ref>
+	struct ArrowProxy
+	{
+		Ref ref;
+		const Ref* operator-> () const { return &ref; }
+	};
+
+	// VAL = void makes a set
+	template<typename KEY, typename VAL, typename Compare, std::size_t NodeBytes>
+	class Tree
+	{
+		static_assert(std::is_copy_constructible_v<KEY>, "BPlusTree: keys are copied into the inner nodes");
+
+	protected:
+		static constexpr bool kIsSet = std::is_void_v<VAL>;
+		using Mapped = std::conditional_t<kIsSet, char, VAL>;
+
+		static constexpr uint32_t kNodeKeys = static_cast<uint32_t>(NodeBytes / sizeof(KEY) < 4 ? 4 : NodeBytes / sizeof(KEY));
+		static constexpr uint32_t kMinKeys = kNodeKeys / 2;
+		static constexpr int kMaxDepth = 48; // inner nodes keep at least kMinKeys - 1 keys, 48 levels outnumber any address space
+
+		struct NodeHeader
+		{
+			uint32_t count = 0;
+			bool leaf;
+
+			explicit NodeHeader(bool isLeaf) : leaf(isLeaf) {}
+		};
+
+		struct alignas(64) Leaf : NodeHeader
+		{
+			Slots<KEY, kNodeKeys> keys;
+			std::conditional_t<kIsSet, NoSlots, Slots<Mapped, kNodeKeys>> values;
+			Leaf* prev = nullptr;
+			Leaf* next = nullptr;
+
+			Leaf() : NodeHeader(true) {}
+		};
+
+		// every key in children[i + 1] is >= keys[i], every key in children[i] is < keys[i]
+		struct alignas(64) Inner : NodeHeader
+		{
+			Slots<KEY, kNodeKeys> keys;
+			NodeHeader* children[kNodeKeys + 1];
+
+			Inner() : NodeHeader(false) {}
+		};
+
+		NodeHeader* _root;
+		std::size_t _size;
+		Compare _comp;
+		NodePool<Leaf> _leaves;
+		NodePool<Inner> _inners;
+
+		static Leaf* AsLeaf(NodeHeader* node) { return static_cast<Leaf*>(node); }
+		static Inner* AsInner(NodeHeader* node) { return static_cast<Inner*>(node); }
+
+	public:
+		template<bool Const>
+		class Iterator
+		{
+			friend class Tree;
+
+			using TreePtr = std::conditional_t<Const, const Tree*, Tree*>;
+			using ValueRef = std::conditional_t<Const, const Mapped, Mapped>;
+
+			TreePtr _tree = nullptr;
+			Leaf* _leaf = nullptr; // nullptr: end()
+			uint32_t _index = 0;
+
+			Iterator(TreePtr tree, Leaf* leaf, uint32_t index) : _tree(tree), _leaf(leaf), _index(index)
+			{
+				// a position one past a leaf's last element is the next leaf's first
+				if (_leaf && _index == _leaf->count)
+				{
+					_leaf = _leaf->next;
+					_index = 0;
+				}
+			}
+
+		public:
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = std::conditional_t<kIsSet, KEY, BPlusTreeEntryRef<KEY, ValueRef>>;
+			using difference_type = std::ptrdiff_t;
+			using reference = std::conditional_t<kIsSet, const KEY&, BPlusTreeEntryRef<KEY, ValueRef>>;
+			using pointer = std::conditional_t<kIsSet, const KEY*, ArrowProxy<reference>>;
+
+			Iterator() = default;
+
+			// iterator -> const_iterator
+			template<bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+			Iterator(const Iterator<OtherConst>& other) : _tree(other._tree), _leaf(other._leaf), _index(other._index) {}
+
+			reference operator* () const
+			{
+				if constexpr (kIsSet)
+					return _leaf->keys[_index];
+				else
+					return reference{ _leaf->keys[_index], _leaf->values[_index] };
+			}
+
+			pointer operator-> () const
+			{
+				if constexpr (kIsSet)
+					return &_leaf->keys[_index];
+				else
+					return pointer{ **this };
+			}
+
+			Iterator& operator++ ()
+			{
+				assert(_leaf);
+				if (++_index == _leaf->count)
+				{
+					_leaf = _leaf->next;
+					_index = 0;
+				}
+				return *this;
+			}
+
+			Iterator operator++ (int)
+			{
+				Iterator old = *this;
+				++*this;
+				return old;
+			}
+
+			// --end() is the last element
+			Iterator& operator-- ()
+			{
+				if (!_leaf)
+				{
+					_leaf = _tree->LastLeaf();
+					_index = _leaf->count - 1;
+				}
+				else if (_index == 0)
+				{
+					_leaf = _leaf->prev;
+					_index = _leaf->count - 1;
+				}
+				else
+				{
+					_index--;
+				}
+				return *this;
+			}
+
+			Iterator operator-- (int)
+			{
+				Iterator old = *this;
+				--*this;
+				return old;
+			}
+
+			bool operator== (const Iterator& other) const { return _leaf == other._leaf && _index == other._index; }
+			bool operator!= (const Iterator& other) const { return !(*this == other); }
+
+			template<bool> friend class Iterator;
+		};
+
+		using iterator = Iterator<false>;
+		using const_iterator = Iterator<true>;
+
+		Tree() :
+			_root(nullptr),
+			_size(0),
+			_comp(Compare()) {}
+
+		explicit Tree(Compare comp) :
+			_root(nullptr),
+			_size(0),
+			_comp(std::move(comp)) {}
+
+		// nodes are carved from 'resource' (e.g. a MonotonicArena), which must outlive the tree
+		explicit Tree(std::pmr::memory_resource* resource, Compare comp = Compare()) :
+			_root(nullptr),
+			_size(0),
+			_comp(std::move(comp)),
+			_leaves(resource),
+			_inners(resource) {}
+
+		~Tree()
+		{
+			Clear();
+		}
+
+		Tree(const Tree&) = delete;
+		Tree& operator= (const Tree&) = delete;
+
+		Tree(Tree&& other) noexcept :
+			_root(std::exchange(other._root, nullptr)),
+			_size(std::exchange(other._size, 0)),
+			_comp(std::move(other._comp)),
+			_leaves(std::move(other._leaves)),
+			_inners(std::move(other._inners)) {}
+
+		Tree& operator= (Tree&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Clear();
+				_root = std::exchange(other._root, nullptr);
+				_size = std::exchange(other._size, 0);
+				_comp = std::move(other._comp);
+				_leaves = std::move(other._leaves);
+				_inners = std::move(other._inners);
+			}
+			return *this;
+		}
+
+		std::size_t Size() const { return _size; }
+		bool Empty() const { return _size == 0; }
+
+		void Clear()
+		{
+			if constexpr (!std::is_trivially_destructible_v<KEY> || !std::is_trivially_destructible_v<Mapped>)
+			{
+				if (_root)
+					DestroySubtree(_root);
+			}
+			_leaves.Release();
+			_inners.Release();
+			_root = nullptr;
+			_size = 0;
+		}
+
+		bool Contains(const KEY& key) const
+		{
+			uint32_t index = 0;
+			return FindSlot(key, index) != nullptr;
+		}
+
+		iterator begin() { return iterator(this, FirstLeaf(), 0); }
+		iterator end() { return iterator(this, nullptr, 0); }
+		const_iterator begin() const { return const_iterator(this, FirstLeaf(), 0); }
+		const_iterator end() const { return const_iterator(this, nullptr, 0); }
+
+		// first element not ordered before key
+		iterator LowerBound(const KEY& key)
+		{
+			uint32_t index = 0;
+			Leaf* leaf = LowerBoundSlot(key, index);
+			return iterator(this, leaf, index);
+		}
+
+		const_iterator LowerBound(const KEY& key) const
+		{
+			uint32_t index = 0;
+			Leaf* leaf = LowerBoundSlot(key, index);
+			return const_iterator(this, leaf, index);
+		}
+
+		// first element ordered after key
+		iterator UpperBound(const KEY& key)
+		{
+			uint32_t index = 0;
+			Leaf* leaf = UpperBoundSlot(key, index);
+			return iterator(this, leaf, index);
+		}
+
+		const_iterator UpperBound(const KEY& key) const
+		{
+			uint32_t index = 0;
+			Leaf* leaf = UpperBoundSlot(key, index);
+			return const_iterator(this, leaf, index);
+		}
+
+		// Calls fn for every element with lo <= key < hi, in order. fn may return bool, false stops the scan.
+		// Map callbacks take (key, value), set callbacks the key.
+		template<typename Fn>
+		void RangeForEach(const KEY& lo, const KEY& hi, Fn&& fn)
+		{
+			ForEachFrom(*this, lo, hi, fn);
+		}
+
+		template<typename Fn>
+		void RangeForEach(const KEY& lo, const KEY& hi, Fn&& fn) const
+		{
+			ForEachFrom(*this, lo, hi, fn);
+		}
+
+		bool Erase(const KEY& key)
+		{
+			Leaf* leaf = nullptr;
+			uint32_t index = 0;
+			return EraseKey(key, leaf, index);
+		}
+
+		// returns the iterator following the erased element
+		iterator Erase(const_iterator pos)
+		{
+			assert(pos._leaf);
+			const KEY key(pos._leaf->keys[pos._index]);
+			Leaf* leaf = nullptr;
+			uint32_t index = 0;
+			EraseKey(key, leaf, index);
+			return iterator(this, leaf, index);
+		}
+
+	protected:
+		Leaf* FirstLeaf() const
+		{
+			if (!_root)
+				return nullptr;
+			NodeHeader* node = _root;
+			while (!node->leaf)
+				node = AsInner(node)->children[0];
+			return AsLeaf(node);
+		}
+
+		Leaf* LastLeaf() const
+		{
+			assert(_root);
+			NodeHeader* node = _root;
+			while (!node->leaf)
+				node = AsInner(node)->children[node->count];
+			return AsLeaf(node);
+		}
+
+		// position of the first key in keys[0, count) not ordered before key
+		uint32_t LowerRank(const KEY* keys, uint32_t count, const KEY& key) const
+		{
+			if constexpr (kVectorRank<KEY, Compare>)
+				return VectorRank<false>(keys, count, key);
+			else
+				return static_cast<uint32_t>(std::lower_bound(keys, keys + count, key, _comp) - keys);
+		}
+
+		// position of the first key in keys[0, count) ordered after key
+		uint32_t UpperRank(const KEY* keys, uint32_t count, const KEY& key) const
+		{
+			if constexpr (kVectorRank<KEY, Compare>)
+				return VectorRank<true>(keys, count, key);
+			else
+				return static_cast<uint32_t>(std::upper_bound(keys, keys + count, key, _comp) - keys);
+		}
+
+		// the leaf whose key range covers key
+		Leaf* FindLeaf(const KEY& key) const
+		{
+			NodeHeader* node = _root;
+			while (!node->leaf)
+			{
+				Inner* inner = AsInner(node);
+				node = inner->children[UpperRank(inner->keys.Data(), inner->count, key)];
+			}
+			return AsLeaf(node);
+		}
+
+		Leaf* FindSlot(const KEY& key, uint32_t& index) const
+		{
+			if (!_root)
+				return nullptr;
+			Leaf* leaf = FindLeaf(key);
+			index = LowerRank(leaf->keys.Data(), leaf->count, key);
+			return index < leaf->count && !_comp(key, leaf->keys[index]) ? leaf : nullptr;
+		}
+
+		// index may equal the leaf's count, the iterator constructor moves that on to the next leaf
+		Leaf* LowerBoundSlot(const KEY& key, uint32_t& index) const
+		{
+			if (!_root)
+				return nullptr;
+			Leaf* leaf = FindLeaf(key);
+			index = LowerRank(leaf->keys.Data(), leaf->count, key);
+			return leaf;
+		}
+
+		Leaf* UpperBoundSlot(const KEY& key, uint32_t& index) const
+		{
+			if (!_root)
+				return nullptr;
+			Leaf* leaf = FindLeaf(key);
+			index = UpperRank(leaf->keys.Data(), leaf->count, key);
+			return leaf;
+		}
+
+		Leaf* NewLeaf() { return ::new (_leaves.Allocate()) Leaf(); }
+		Inner* NewInner() { return ::new (_inners.Allocate()) Inner(); }
+		// the node's keys and values must already be destroyed
+		void FreeLeaf(Leaf* leaf) { _leaves.Deallocate(leaf); }
+		void FreeInner(Inner* inner) { _inners.Deallocate(inner); }
+
+		template<typename K, typename... V>
+		void LeafInsertAt(Leaf* leaf, uint32_t pos, K&& key, V&&... value)
+		{
+			SlotInsert(leaf->keys.Data(), leaf->count, pos, std::forward<K>(key));
+			if constexpr (!kIsSet)
+			{
+				try
+				{
+					SlotInsert(leaf->values.Data(), leaf->count, pos, std::forward<V>(value)...);
+				}
+				catch (...)
+				{
+					SlotErase(leaf->keys.Data(), leaf->count + 1, pos);
+					throw;
+				}
+			}
+			leaf->count++;
+		}
+
+		void LeafEraseAt(Leaf* leaf, uint32_t pos)
+		{
+			SlotErase(leaf->keys.Data(), leaf->count, pos);
+			if constexpr (!kIsSet)
+				SlotErase(leaf->values.Data(), leaf->count, pos);
+			leaf->count--;
+		}
+
+		// moves from[first, from->count) to the end of 'to'
+		void LeafMoveTail(Leaf* from, uint32_t first, Leaf* to)
+		{
+			SlotRelocate(from->keys.Data(), first, from->count, to->keys.Data() + to->count);
+			if constexpr (!kIsSet)
+				SlotRelocate(from->values.Data(), first, from->count, to->values.Data() + to->count);
+			to->count += from->count - first;
+			from->count = first;
+		}
+
+		void LeafMoveEntry(Leaf* from, uint32_t fromPos, Leaf* to, uint32_t toPos)
+		{
+			if constexpr (kIsSet)
+				LeafInsertAt(to, toPos, std::move(from->keys[fromPos]));
+			else
+				LeafInsertAt(to, toPos, std::move(from->keys[fromPos]), std::move(from->values[fromPos]));
+			LeafEraseAt(from, fromPos);
+		}
+
+		// key goes to keys[pos], child to children[pos + 1]
+		template<typename K>
+		void InnerInsertAt(Inner* inner, uint32_t pos, K&& key, NodeHeader* child)
+		{
+			SlotInsert(inner->keys.Data(), inner->count, pos, std::forward<K>(key));
+			std::copy_backward(inner->children + pos + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+			inner->children[pos + 1] = child;
+			inner->count++;
+		}
+
+		// removes keys[pos] and children[pos + 1]
+		void InnerEraseAt(Inner* inner, uint32_t pos)
+		{
+			SlotErase(inner->keys.Data(), inner->count, pos);
+			std::copy(inner->children + pos + 2, inner->children + inner->count + 1, inner->children + pos + 1);
+			inner->count--;
+		}
+
+		// Inserts key if it is not present yet. An existing key gets 'value' assigned (maps) and
+		// false is returned.
+		template<typename K, typename... V>
+		bool InsertUnique(K&& key, V&&... value)
+		{
+			if (!_root)
+				_root = NewLeaf();
+
+			Inner* path[kMaxDepth];
+			uint32_t childIndex[kMaxDepth];
+			int depth = 0;
+			NodeHeader* node = _root;
+			while (!node->leaf)
+			{
+				Inner* inner = AsInner(node);
+				const uint32_t i = UpperRank(inner->keys.Data(), inner->count, key);
+				path[depth] = inner;
+				childIndex[depth] = i;
+				depth++;
+				node = inner->children[i];
+			}
+
+			Leaf* leaf = AsLeaf(node);
+			const uint32_t pos = LowerRank(leaf->keys.Data(), leaf->count, key);
+			if (pos < leaf->count && !_comp(key, leaf->keys[pos]))
+			{
+				if constexpr (!kIsSet)
+					((leaf->values[pos] = std::forward<V>(value)), ...);
+				return false;
+			}
+
+			if (leaf->count < kNodeKeys)
+			{
+				LeafInsertAt(leaf, pos, std::forward<K>(key), std::forward<V>(value)...);
+				_size++;
+				return true;
+			}
+
+			// split; appending past the last leaf starts a fresh leaf, so ascending inserts pack leaves full
+			Leaf* right = NewLeaf();
+			const uint32_t mid = pos == kNodeKeys && !leaf->next ? kNodeKeys : (kNodeKeys + 1) / 2;
+			LeafMoveTail(leaf, mid, right);
+			right->prev = leaf;
+			right->next = leaf->next;
+			if (leaf->next)
+				leaf->next->prev = right;
+			leaf->next = right;
+			if (pos < mid)
+				LeafInsertAt(leaf, pos, std::forward<K>(key), std::forward<V>(value)...);
+			else
+				LeafInsertAt(right, pos - mid, std::forward<K>(key), std::forward<V>(value)...);
+			_size++;
+
+			std::optional<KEY> separator(std::in_place, right->keys[0]);
+			NodeHeader* newChild = right;
+			while (depth > 0)
+			{
+				depth--;
+				Inner* parent = path[depth];
+				const uint32_t i = childIndex[depth];
+				if (parent->count < kNodeKeys)
+				{
+					InnerInsertAt(parent, i, std::move(*separator), newChild);
+					return true;
+				}
+
+				// keys[mid] moves up, the sibling takes keys (mid, count) and children (mid, count]
+				Inner* sibling = NewInner();
+				const uint32_t innerMid = kNodeKeys / 2;
+				std::optional<KEY> promoted(std::in_place, std::move(parent->keys[innerMid]));
+				SlotRelocate(parent->keys.Data(), innerMid + 1, parent->count, sibling->keys.Data());
+				std::destroy_at(&parent->keys[innerMid]);
+				std::copy(parent->children + innerMid + 1, parent->children + parent->count + 1, sibling->children);
+				sibling->count = parent->count - innerMid - 1;
+				parent->count = innerMid;
+				if (i <= innerMid)
+					InnerInsertAt(parent, i, std::move(*separator), newChild);
+				else
+					InnerInsertAt(sibling, i - innerMid - 1, std::move(*separator), newChild);
+
+				separator = std::move(promoted);
+				newChild = sibling;
+			}
+
+			Inner* root = NewInner();
+			root->children[0] = _root;
+			InnerInsertAt(root, 0, std::move(*separator), newChild);
+			_root = root;
+			return true;
+		}
+
+		// On success (leaf, index) is the position of the element that followed the erased one.
+		bool EraseKey(const KEY& key, Leaf*& nextLeaf, uint32_t& nextIndex)
+		{
+			if (!_root)
+				return false;
+
+			Inner* path[kMaxDepth];
+			uint32_t childIndex[kMaxDepth];
+			int depth = 0;
+			NodeHeader* node = _root;
+			while (!node->leaf)
+			{
+				Inner* inner = AsInner(node);
+				const uint32_t i = UpperRank(inner->keys.Data(), inner->count, key);
+				path[depth] = inner;
+				childIndex[depth] = i;
+				depth++;
+				node = inner->children[i];
+			}
+
+			Leaf* leaf = AsLeaf(node);
+			const uint32_t pos = LowerRank(leaf->keys.Data(), leaf->count, key);
+			if (pos == leaf->count || _comp(key, leaf->keys[pos]))
+				return false;
+
+			LeafEraseAt(leaf, pos);
+			_size--;
+			nextLeaf = leaf;
+			nextIndex = pos;
+
+			// refill underfull nodes from a sibling, or merge with it, from the leaf up
+			while (depth > 0 && node->count < kMinKeys)
+			{
+				depth--;
+				if (node->leaf)
+					FixLeaf(path[depth], childIndex[depth], nextLeaf, nextIndex);
+				else
+					FixInner(path[depth], childIndex[depth]);
+				node = path[depth];
+			}
+
+			if (_root->count == 0)
+			{
+				if (_root->leaf)
+				{
+					FreeLeaf(AsLeaf(_root));
+					_root = nullptr;
+					nextLeaf = nullptr;
+					nextIndex = 0;
+				}
+				else
+				{
+					Inner* old = AsInner(_root);
+					_root = old->children[0];
+					FreeInner(old);
+				}
+			}
+			return true;
+		}
+
+		// parent->children[i] is an underfull leaf; (cursor, cursorIndex) is kept pointing at the same element
+		void FixLeaf(Inner* parent, uint32_t i, Leaf*& cursor, uint32_t& cursorIndex)
+		{
+			Leaf* child = AsLeaf(parent->children[i]);
+			Leaf* left = i > 0 ? AsLeaf(parent->children[i - 1]) : nullptr;
+			Leaf* right = i < parent->count ? AsLeaf(parent->children[i + 1]) : nullptr;
+
+			if (left && left->count > kMinKeys)
+			{
+				LeafMoveEntry(left, left->count - 1, child, 0);
+				parent->keys[i - 1] = child->keys[0];
+				if (cursor == child)
+					cursorIndex++;
+			}
+			else if (right && right->count > kMinKeys)
+			{
+				LeafMoveEntry(right, 0, child, child->count);
+				parent->keys[i] = right->keys[0];
+			}
+			else if (left)
+			{
+				if (cursor == child)
+				{
+					cursor = left;
+					cursorIndex += left->count;
+				}
+				MergeLeaves(parent, i - 1);
+			}
+			else
+			{
+				MergeLeaves(parent, i);
+			}
+		}
+
+		// folds children[i + 1] into children[i]
+		void MergeLeaves(Inner* parent, uint32_t i)
+		{
+			Leaf* left = AsLeaf(parent->children[i]);
+			Leaf* right = AsLeaf(parent->children[i + 1]);
+			LeafMoveTail(right, 0, left);
+			left->next = right->next;
+			if (right->next)
+				right->next->prev = left;
+			FreeLeaf(right);
+			InnerEraseAt(parent, i);
+		}
+
+		// parent->children[i] is an underfull inner node
+		void FixInner(Inner* parent, uint32_t i)
+		{
+			Inner* child = AsInner(parent->children[i]);
+			Inner* left = i > 0 ? AsInner(parent->children[i - 1]) : nullptr;
+			Inner* right = i < parent->count ? AsInner(parent->children[i + 1]) : nullptr;
+
+			if (left && left->count > kMinKeys)
+			{
+				// rotate through the parent: its separator comes down, left's last key goes up
+				SlotInsert(child->keys.Data(), child->count, 0, std::move(parent->keys[i - 1]));
+				std::copy_backward(child->children, child->children + child->count + 1, child->children + child->count + 2);
+				child->children[0] = left->children[left->count];
+				child->count++;
+				parent->keys[i - 1] = std::move(left->keys[left->count - 1]);
+				std::destroy_at(&left->keys[left->count - 1]);
+				left->count--;
+			}
+			else if (right && right->count > kMinKeys)
+			{
+				::new (static_cast<void*>(&child->keys[child->count])) KEY(std::move(parent->keys[i]));
+				child->children[child->count + 1] = right->children[0];
+				child->count++;
+				parent->keys[i] = std::move(right->keys[0]);
+				SlotErase(right->keys.Data(), right->count, 0);
+				std::copy(right->children + 1, right->children + right->count + 1, right->children);
+				right->count--;
+			}
+			else
+			{
+				MergeInners(parent, left ? i - 1 : i);
+			}
+		}
+
+		// folds children[i + 1] and the separator between them into children[i]
+		void MergeInners(Inner* parent, uint32_t i)
+		{
+			Inner* left = AsInner(parent->children[i]);
+			Inner* right = AsInner(parent->children[i + 1]);
+			::new (static_cast<void*>(&left->keys[left->count])) KEY(std::move(parent->keys[i]));
+			SlotRelocate(right->keys.Data(), 0, right->count, left->keys.Data() + left->count + 1);
+			std::copy(right->children, right->children + right->count + 1, left->children + left->count + 1);
+			left->count += right->count + 1;
+			FreeInner(right);
+			InnerEraseAt(parent, i);
+		}
+
+		void DestroySubtree(NodeHeader* node)
+		{
+			if (node->leaf)
+			{
+				Leaf* leaf = AsLeaf(node);
+				std::destroy_n(leaf->keys.Data(), leaf->count);
+				if constexpr (!kIsSet)
+					std::destroy_n(leaf->values.Data(), leaf->count);
+				return;
+			}
+			Inner* inner = AsInner(node);
+			for (uint32_t i = 0; i <= inner->count; i++)
+				DestroySubtree(inner->children[i]);
+			std::destroy_n(inner->keys.Data(), inner->count);
+		}
+
+		// Replaces the content with the 'count' elements of [first, last), which must be strictly
+		// increasing, in O(n): leaves are filled in order from one contiguous run of nodes, then each
+		// inner level is built over the one below. makeEntry(leaf, item) appends item to leaf.
+		template<typename It, typename MakeEntry>
+		void BuildFrom(It first, It last, MakeEntry&& makeEntry)
+		{
+			Clear();
+			const std::size_t count = static_cast<std::size_t>(std::distance(first, last));
+			if (count == 0)
+				return;
+
+			// spread evenly, so every node stays at least half full
+			const std::size_t leafCount = (count + kNodeKeys - 1) / kNodeKeys;
+			std::vector<NodeHeader*> level;
+			std::vector<Leaf*> firstLeaf; // leftmost leaf under each node of 'level', for the separators
+			level.reserve(leafCount);
+			firstLeaf.reserve(leafCount);
+			_leaves.Reserve(leafCount);
+
+			Leaf* previous = nullptr;
+			for (std::size_t l = 0; l < leafCount; l++)
+			{
+				Leaf* leaf = NewLeaf();
+				const std::size_t take = count / leafCount + (l < count % leafCount ? 1 : 0);
+				for (std::size_t k = 0; k < take; k++, ++first)
+				{
+					makeEntry(leaf, *first);
+					assert((leaf->count < 2 || _comp(leaf->keys[leaf->count - 2], leaf->keys[leaf->count - 1])) &&
+						"BPlusTree::BuildFromSorted: input must be strictly increasing");
+				}
+				assert((!previous || _comp(previous->keys[previous->count - 1], leaf->keys[0])) &&
+					"BPlusTree::BuildFromSorted: input must be strictly increasing");
+				leaf->prev = previous;
+				if (previous)
+					previous->next = leaf;
+				previous = leaf;
+				level.push_back(leaf);
+				firstLeaf.push_back(leaf);
+			}
+
+			while (level.size() > 1)
+			{
+				const std::size_t nodes = level.size();
+				const std::size_t parentCount = (nodes + kNodeKeys) / (kNodeKeys + 1);
+				std::vector<NodeHeader*> parents;
+				std::vector<Leaf*> parentFirstLeaf;
+				parents.reserve(parentCount);
+				parentFirstLeaf.reserve(parentCount);
+
+				std::size_t next = 0;
+				for (std::size_t p = 0; p < parentCount; p++)
+				{
+					Inner* inner = NewInner();
+					const std::size_t take = nodes / parentCount + (p < nodes % parentCount ? 1 : 0);
+					inner->children[0] = level[next];
+					parentFirstLeaf.push_back(firstLeaf[next]);
+					for (std::size_t c = 1; c < take; c++)
+					{
+						::new (static_cast<void*>(&inner->keys[inner->count])) KEY(firstLeaf[next + c]->keys[0]);
+						inner->children[c] = level[next + c];
+						inner->count++;
+					}
+					next += take;
+					parents.push_back(inner);
+				}
+				level = std::move(parents);
+				firstLeaf = std::move(parentFirstLeaf);
+			}
+
+			_root = level[0];
+			_size = count;
+		}
+
+		template<typename Fn, typename K, typename V>
+		static decltype(auto) Visit(Fn& fn, K& key, V& value)
+		{
+			if constexpr (kIsSet)
+				return fn(key);
+			else
+				return fn(key, value);
+		}
+
+		template<typename Self, typename Fn>
+		static void ForEachFrom(Self& self, const KEY& lo, const KEY& hi, Fn& fn)
+		{
+			uint32_t index = 0;
+			Leaf* leaf = self.LowerBoundSlot(lo, index);
+			for (; leaf; leaf = leaf->next, index = 0)
+			{
+				// one rank per leaf instead of a compare per element; only the last leaf is cut short
+				const bool last = leaf->count > 0 && !self._comp(leaf->keys[leaf->count - 1], hi);
+				const uint32_t end = last ? self.LowerRank(leaf->keys.Data(), leaf->count, hi) : leaf->count;
+				for (; index < end; index++)
+				{
+					const KEY& key = leaf->keys[index];
+					auto& value = [&]() -> auto& {
+						if constexpr (kIsSet)
+							return key;
+						else if constexpr (std::is_const_v<Self>)
+							return std::as_const(leaf->values[index]);
+						else
+							return leaf->values[index];
+					}();
+					if constexpr (std::is_same_v<decltype(Visit(fn, key, value)), bool>)
+					{
+						if (!Visit(fn, key, value))
+							return;
+					}
+					else
+					{
+						Visit(fn, key, value);
+					}
+				}
+				if (last)
+					return;
+			}
+		}
+	};
+}
+
+template<typename KEY, typename VAL, typename Compare = std::less<KEY>, std::size_t NodeBytes = 256>
+class BPlusTree : public BPlusTreeDetail::Tree<KEY, VAL, Compare, NodeBytes>
+{
+	using Base = BPlusTreeDetail::Tree<KEY, VAL, Compare, NodeBytes>;
+	using typename Base::Leaf;
+
+public:
+	using Base::Base;
+
+	VAL* Find(const KEY& key)
+	{
+		uint32_t index = 0;
+		Leaf* leaf = this->FindSlot(key, index);
+		return leaf ? &leaf->values[index] : nullptr;
+	}
+
+	const VAL* Find(const KEY& key) const
+	{
+		uint32_t index = 0;
+		const Leaf* leaf = this->FindSlot(key, index);
+		return leaf ? &leaf->values[index] : nullptr;
+	}
+
+	template<typename K, typename V>
+	bool Insert(K&& key, V&& value)
+	{
+		static_assert(std::is_constructible_v<KEY, K&&>, "BPlusTree: Invalid key type");
+		static_assert(std::is_constructible_v<VAL, V&&>, "BPlusTree: Invalid value type");
+
+		return this->InsertUnique(KEY(std::forward<K>(key)), VAL(std::forward<V>(value)));
+	}
+
+	// Replaces the content with the (key, value) pairs of [first, last) (anything with .first/.second),
+	// which must be strictly increasing by key. O(n), with every node full but the last few.
+	template<typename It>
+	void BuildFromSorted(It first, It last)
+	{
+		this->BuildFrom(first, last, [this](Leaf* leaf, auto&& item) {
+			this->LeafInsertAt(leaf, leaf->count, KEY(item.first), VAL(item.second));
+		});
+	}
+};
+
+template<typename KEY, typename Compare, std::size_t NodeBytes>
+class BPlusTree<KEY, void, Compare, NodeBytes> : public BPlusTreeDetail::Tree<KEY, void, Compare, NodeBytes>
+{
+	using Base = BPlusTreeDetail::Tree<KEY, void, Compare, NodeBytes>;
+	using typename Base::Leaf;
+
+public:
+	using Base::Base;
+
+	bool Insert(const KEY& key)
+	{
+		return this->InsertUnique(key);
+	}
+
+	bool Insert(KEY&& key)
+	{
+		return this->InsertUnique(std::move(key));
+	}
+
+	// Replaces the content with the keys of [first, last), which must be strictly increasing. O(n).
+	template<typename It>
+	void BuildFromSorted(It first, It last)
+	{
+		this->BuildFrom(first, last, [this](Leaf* leaf, const auto& key) {
+			this->LeafInsertAt(leaf, leaf->count, KEY(key));
+		});
+	}
+};
+
+#undef BPLUSTREE_SIMD_LEVEL
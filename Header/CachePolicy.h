@@ -0,0 +1,335 @@
+#pragma once
+#include <assert.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Eviction / admission policies for LRUCache.
+// A policy owns the lists of unpinned entries; pinned entries are taken out with Remove and handed
+// back with Reinsert once their last Handle is gone. Segment sizes are in weight units, the same
+// units as the cache capacity (one per entry unless the cache has a weigher). Every policy provides:
+//   void Init(size_t capacity, size_t expectedEntries)   expectedEntries: a guess, in entries, never weight
+//   void OnAccess(size_t hash)        every lookup, hit or miss (frequency based policies)
+//   void OnInsert(CacheLink* link)    new entry, not pinned yet
+//   void OnHit(CacheLink* link)       lookup found the entry (pinned or not)
+//   void Remove(CacheLink* link)      entry gets pinned or evicted
+//   void Reinsert(CacheLink* link)    entry got unpinned
+//   CacheLink* Victim()               next unpinned entry to evict, nullptr if there is none
+
+struct CacheLink
+{
+	CacheLink* prev = nullptr;
+	CacheLink* next = nullptr;
+	size_t hash = 0;
+	size_t weight = 1;
+	uint8_t segment = 0; // policy defined
+};
+
+// intrusive doubly linked list with a sentinel, front is the oldest entry
+class CacheList
+{
+	CacheLink _head;
+	size_t _count = 0;
+	size_t _weight = 0;
+
+public:
+	CacheList() { _head.prev = _head.next = &_head; }
+	CacheList(const CacheList&) = delete;
+	CacheList& operator= (const CacheList&) = delete;
+
+	bool Empty() const { return _head.next == &_head; }
+	size_t Count() const { return _count; }
+	size_t Weight() const { return _weight; }
+	CacheLink* Front() const { return Empty() ? nullptr : _head.next; }
+
+	void PushBack(CacheLink* link)
+	{
+		link->prev = _head.prev;
+		link->next = &_head;
+		_head.prev->next = link;
+		_head.prev = link;
+		_count++;
+		_weight += link->weight;
+	}
+
+	// changes the weight of a linked entry
+	void Reweigh(CacheLink* link, size_t weight)
+	{
+		_weight = _weight - link->weight + weight;
+		link->weight = weight;
+	}
+
+	void Remove(CacheLink* link)
+	{
+		link->prev->next = link->next;
+		link->next->prev = link->prev;
+		link->prev = link->next = nullptr;
+		_count--;
+		_weight -= link->weight;
+	}
+};
+
+// plain LRU: evicts whatever was released the longest time ago
+class LRUPolicy
+{
+	CacheList _list;
+
+public:
+	void Init(size_t, size_t) {}
+	void OnAccess(size_t) {}
+	void OnInsert(CacheLink* link) { _list.PushBack(link); }
+	void OnHit(CacheLink*) {}
+	void Remove(CacheLink* link) { _list.Remove(link); }
+	void Reinsert(CacheLink* link) { _list.PushBack(link); }
+	CacheLink* Victim() const { return _list.Front(); }
+};
+
+// segmented LRU: new entries start on probation, a second hit promotes them to the protected
+// segment (80% of the capacity). A one-off scan only ever churns the probation segment.
+class SLRUPolicy
+{
+	enum : uint8_t { kProbation = 0, kProtected = 1 };
+
+	CacheList _probation;
+	CacheList _protected;
+	size_t _protectedMax = 0;
+
+	CacheList& ListOf(CacheLink* link) { return link->segment == kProtected ? _protected : _probation; }
+
+public:
+	void Init(size_t capacity, size_t) { _protectedMax = capacity - capacity / 5; }
+	void OnAccess(size_t) {}
+
+	void OnInsert(CacheLink* link)
+	{
+		link->segment = kProbation;
+		_probation.PushBack(link);
+	}
+
+	void OnHit(CacheLink* link)
+	{
+		if (link->segment == kProtected)
+			return;
+		const bool linked = link->next != nullptr;
+		if (linked)
+			_probation.Remove(link);
+		link->segment = kProtected;
+		if (linked)
+			Reinsert(link);
+	}
+
+	void Remove(CacheLink* link) { ListOf(link).Remove(link); }
+
+	void Reinsert(CacheLink* link)
+	{
+		ListOf(link).PushBack(link);
+		while (_protected.Weight() > _protectedMax)
+		{
+			CacheLink* demoted = _protected.Front();
+			_protected.Remove(demoted);
+			demoted->segment = kProbation;
+			_probation.PushBack(demoted);
+		}
+	}
+
+	CacheLink* Victim() const
+	{
+		return _probation.Empty() ? _protected.Front() : _probation.Front();
+	}
+};
+
+// count-min sketch with 4-bit counters, 16 per 64-bit word and 4 rows, one word per entry. All
+// counters are halved every 10 * entries increments so the estimate follows a shifting working set.
+// Sized in entries, never in weight units: a byte-weighted cache would otherwise get a sketch of
+// one word per byte of capacity. It grows (and starts over) when the cache holds more entries than
+// it was sized for.
+class FrequencySketch
+{
+	std::vector<uint64_t> _table;
+	size_t _mask = 0;
+	size_t _samples = 0;
+	size_t _sampleSize = 0;
+
+	static uint64_t Spread(uint64_t x)
+	{
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		return x;
+	}
+
+	// row i uses counter i*4 + (0..3) of its word, so the rows never share a nibble
+	void Locate(size_t hash, int row, size_t& word, int& shift) const
+	{
+		const uint64_t h = Spread(static_cast<uint64_t>(hash) + 0x9E3779B97F4A7C15ull * static_cast<uint64_t>(row + 1));
+		word = static_cast<size_t>(h) & _mask;
+		shift = (row * 4 + static_cast<int>((h >> 60) & 3)) * 4;
+	}
+
+public:
+	void Init(size_t entries)
+	{
+		size_t size = 16;
+		while (size < entries) size <<= 1;
+		_table.assign(size, 0);
+		_mask = size - 1;
+		_samples = 0;
+		_sampleSize = size * 10;
+	}
+
+	void EnsureCapacity(size_t entries)
+	{
+		if (entries > _table.size())
+			Init(entries);
+	}
+
+	unsigned Frequency(size_t hash) const
+	{
+		unsigned frequency = 15;
+		for (int row = 0; row < 4; row++)
+		{
+			size_t word; int shift;
+			Locate(hash, row, word, shift);
+			frequency = std::min(frequency, static_cast<unsigned>((_table[word] >> shift) & 0xF));
+		}
+		return frequency;
+	}
+
+	void Increment(size_t hash)
+	{
+		bool added = false;
+		for (int row = 0; row < 4; row++)
+		{
+			size_t word; int shift;
+			Locate(hash, row, word, shift);
+			if (((_table[word] >> shift) & 0xF) != 0xF)
+			{
+				_table[word] += uint64_t(1) << shift;
+				added = true;
+			}
+		}
+		if (added && ++_samples >= _sampleSize)
+			Reset();
+	}
+
+	void Reset()
+	{
+		for (uint64_t& word : _table)
+			word = (word >> 1) & 0x7777777777777777ull;
+		_samples /= 2;
+	}
+};
+
+// W-TinyLFU: a small LRU window (1%) in front of an SLRU main space. An entry leaving the window is
+// only admitted to the main space if the sketch says it is more popular than the main victim,
+// which keeps scans from flushing the frequently used entries.
+class WTinyLFUPolicy
+{
+	enum : uint8_t { kWindow = 0, kProbation = 1, kProtected = 2 };
+
+	CacheList _window;
+	CacheList _probation;
+	CacheList _protected;
+	size_t _windowMax = 1;
+	size_t _protectedMax = 0;
+	FrequencySketch _sketch;
+
+	size_t Entries() const { return _window.Count() + _probation.Count() + _protected.Count(); }
+
+	CacheList& ListOf(CacheLink* link)
+	{
+		switch (link->segment)
+		{
+		case kWindow: return _window;
+		case kProtected: return _protected;
+		default: return _probation;
+		}
+	}
+
+	void TrimProtected()
+	{
+		while (_protected.Weight() > _protectedMax)
+		{
+			CacheLink* demoted = _protected.Front();
+			_protected.Remove(demoted);
+			demoted->segment = kProbation;
+			_probation.PushBack(demoted);
+		}
+	}
+
+	CacheLink* MainVictim() const
+	{
+		return _probation.Empty() ? _protected.Front() : _probation.Front();
+	}
+
+public:
+	void Init(size_t capacity, size_t expectedEntries)
+	{
+		_windowMax = std::max<size_t>(capacity / 100, 1);
+		const size_t main = capacity > _windowMax ? capacity - _windowMax : 0;
+		_protectedMax = main - main / 5;
+		_sketch.Init(expectedEntries);
+	}
+
+	void OnAccess(size_t hash) { _sketch.Increment(hash); }
+
+	// while the cache still has room the window simply overflows into probation
+	void OnInsert(CacheLink* link)
+	{
+		link->segment = kWindow;
+		_window.PushBack(link);
+		_sketch.EnsureCapacity(Entries());
+		while (_window.Weight() > _windowMax && _window.Count() > 1)
+		{
+			CacheLink* moved = _window.Front();
+			_window.Remove(moved);
+			moved->segment = kProbation;
+			_probation.PushBack(moved);
+		}
+	}
+
+	void OnHit(CacheLink* link)
+	{
+		if (link->segment != kProbation)
+			return;
+		const bool linked = link->next != nullptr;
+		if (linked)
+			_probation.Remove(link);
+		link->segment = kProtected;
+		if (linked)
+		{
+			_protected.PushBack(link);
+			TrimProtected();
+		}
+	}
+
+	void Remove(CacheLink* link) { ListOf(link).Remove(link); }
+
+	void Reinsert(CacheLink* link)
+	{
+		ListOf(link).PushBack(link);
+		TrimProtected();
+	}
+
+	// not const: the window candidate may be moved into the main space on the way
+	CacheLink* Victim()
+	{
+		CacheLink* candidate = _window.Front();
+		CacheLink* victim = MainVictim();
+		if (candidate == nullptr || victim == nullptr)
+			return candidate != nullptr ? candidate : victim;
+		if (_window.Weight() < _windowMax)
+			return victim;
+
+		// the incoming entry will push the oldest window entry out, it has to compete for a main slot
+		if (_sketch.Frequency(candidate->hash) > _sketch.Frequency(victim->hash))
+		{
+			_window.Remove(candidate);
+			candidate->segment = kProbation;
+			_probation.PushBack(candidate);
+			return victim;
+		}
+		return candidate;
+	}
+};
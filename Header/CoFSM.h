@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <concepts>
 #include <vector>
 #include <optional>
@@ -8,6 +12,14 @@
 #include <coroutine>
 #include <functional>
 #include <map>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include "InplaceFunction.h"
+#include "PoolAllocator.h"
 
 struct transfer_awaitable
 {
@@ -22,6 +34,24 @@ struct transfer_awaitable
     void await_resume() noexcept {}
 };
 
+// a state's slot in its CoFsm, handed out by AddState. Any enum converts to a handle at compile time,
+// value + 1 (slot 0 is the empty state every CoFsm starts in), which turns an enum class into a
+// fixed state list: AddState(MyState::Walk, ...) fills that slot and transitions never look a name up.
+struct FsmStateHandle
+{
+    static constexpr uint32_t kInvalid = UINT32_MAX;
+    uint32_t index = kInvalid;
+
+    constexpr FsmStateHandle() = default;
+    constexpr explicit FsmStateHandle(uint32_t slot) : index(slot) {}
+
+    template<typename E> requires std::is_enum_v<E>
+    constexpr FsmStateHandle(E state) : index(static_cast<uint32_t>(state) + 1) {}
+
+    constexpr bool IsValid() const { return index != kInvalid; }
+    constexpr bool operator==(const FsmStateHandle&) const = default;
+};
+
 //-----------------------------
 // co_awaitable methods
 //-----------------------------
@@ -42,7 +72,8 @@ struct yield
 
     struct change_state
     {
-        std::string state;
+        FsmStateHandle state;
+        std::string_view name; // looked up when state is not valid
     };
     
     // wait for duration
@@ -51,12 +82,13 @@ struct yield
     // next frame
     static auto frame() { return wait(0); }
 
-    // state change
-    static auto state(const std::string& state) { return change_state{state}; }
+    // state change, by handle (or enum) or by name
+    static auto state(FsmStateHandle state) { return change_state{ state, {} }; }
+    static auto state(std::string_view name) { return change_state{ FsmStateHandle{}, name }; }
         
     // manually return
     template<typename T>
-    static auto ret(T&& v) { return ret_value<T>{ std::move(v)}; }
+    static auto ret(T&& v) { return ret_value<std::decay_t<T>>{ std::forward<T>(v) }; }
     
     static auto ret() { return ret_void{}; }
 };
@@ -74,17 +106,17 @@ struct fsm_coro
     {
         CoFsm* scheduler = nullptr;
         std::coroutine_handle<> awaiter_func;
-        T* ret_ptr = nullptr; // this is to allow void type
+        // the value of yield::ret lives in the frame; nullptr_t is only a placeholder for void
+        std::conditional_t<std::is_void_v<T>, std::nullptr_t, std::optional<T>> ret_slot{};
         bool returned = false;
         
-        // should not call delete on void*
-        template<typename U> static void manual_delete(U* t) { if(t) delete t; }
-        template<>           static void manual_delete<void>(void*){}
+        // frames come from the size-class pool: state changes and nested calls start new coroutines
+        // all the time, and the pool's per-thread free lists recycle the frames of the finished ones
+        static void* operator new(std::size_t size) { return SizeClassPool::Allocate(size); }
+        static void operator delete(void* ptr, std::size_t size) noexcept { SizeClassPool::Deallocate(ptr, size); }
         
         ~promise_type()
         {
-            manual_delete(ret_ptr);
-            ret_ptr = nullptr;
             if(awaiter_func)
                 awaiter_func.destroy();
 //            fmt::print("destroyed\n");
@@ -130,8 +162,8 @@ struct CoFsm
 {
     CoFsm()
     {
-        m_stateTable[""] = State {"", nullptr};
-        m_runtime.state = &m_stateTable[""];
+        AddState(State{ "", nullptr, nullptr });
+        m_runtime.state = FsmStateHandle{ 0 };
     }
     
     CoFsm(CoFsm&& other)
@@ -143,8 +175,11 @@ struct CoFsm
     {
         std::swap(m_runtime, other.m_runtime);
         std::swap(m_invokeList, other.m_invokeList);
+        std::swap(m_deferredList, other.m_deferredList);
+        std::swap(m_nextSeq, other.m_nextSeq);
         std::swap(m_destroyList, other.m_destroyList);
-        std::swap(m_stateTable, other.m_stateTable);
+        std::swap(m_states, other.m_states);
+        std::swap(m_stateIndex, other.m_stateIndex);
         return *this;
     }
     
@@ -164,53 +199,81 @@ struct CoFsm
         return m_invokeList.size() > 0;
     }
     
+    // the elapsed time at which Step next has a coroutine to resume, +infinity when none is waiting
+    float NextResumeTime() const
+    {
+        return m_invokeList.empty() ? std::numeric_limits<float>::infinity() : m_invokeList.front().time;
+    }
+    
     struct TimerInvoke
     {
         float time = 0.0f;
+        uint64_t seq = 0; // scheduling order, breaks ties and tells this frame's resumes from the next
         std::coroutine_handle<> handle;
     };
 
+    // std::push_heap/pop_heap build a max-heap, so "less" puts the earliest (time, seq) on top
+    struct LaterInvoke
+    {
+        bool operator()(const TimerInvoke& a, const TimerInvoke& b) const
+        {
+            return a.time != b.time ? a.time > b.time : a.seq > b.seq;
+        }
+    };
+
     
     //-------------------------------
+    // move-only, captures up to 48 bytes live inside the State
+    using StepFunction = InplaceFunction<fsm_coro<>(const float&, const float&)>;
+    using ExitFunction = InplaceFunction<void()>;
+
     struct State
     {
-        std::string name;
-        std::function<fsm_coro<>(const float&, const float&)> step;
-        std::function<void()> exit;
+        std::string name; // for AddState by name and DebugReportCurrentStateName
+        StepFunction step;
+        ExitFunction exit;
     };
     
     struct StateRuntime
     {
         float dt = 0.0f;
         float elapsed = 0.0f;
-        const State* state = nullptr;
+        FsmStateHandle state;
     };
     
     void Step(float dt)
     {
-        if(m_runtime.state)
-        {
-            m_runtime.dt = dt;
-            m_runtime.elapsed += dt;
-        }
-        
-        // timer and next frame tasks
-        auto transientList = std::move(m_invokeList);
-        m_invokeList.clear();
-        for(auto& timer : transientList)
+        m_runtime.dt = dt;
+        m_runtime.elapsed += dt;
+        ResumeDue();
+    }
+    
+    // the part of Step after the clock moved: resumes what is due at m_runtime.elapsed and destroys
+    // finished coroutines. CoFsmWorld keeps the clocks itself and calls this only when something is due.
+    void ResumeDue()
+    {
+        // timer and next frame tasks: m_invokeList is a min-heap on (time, seq), so only due entries
+        // are touched. Whatever gets scheduled while this frame runs (seq past the barrier) waits for
+        // the next Step even when it is already due, as yield::frame() expects.
+        const uint64_t barrier = m_nextSeq;
+        while(!m_invokeList.empty() && m_invokeList.front().time <= m_runtime.elapsed)
         {
-            if(timer.time <= m_runtime.elapsed)
+            std::pop_heap(m_invokeList.begin(), m_invokeList.end(), LaterInvoke{});
+            TimerInvoke timer = m_invokeList.back();
+            m_invokeList.pop_back();
+            if(timer.seq >= barrier)
             {
-                if(timer.handle && !timer.handle.done())
-                {
-                    timer.handle();
-                }
+                m_deferredList.push_back(timer);
+                continue;
             }
-            else
+            if(timer.handle && !timer.handle.done())
             {
-                m_invokeList.push_back(timer);
+                timer.handle();
             }
         }
+        for(auto& timer : m_deferredList)
+            PushInvoke(timer);
+        m_deferredList.clear();
         
         //-----------------------------
         // we could schedule continuation in a similar loop to avoid scattered destroys
@@ -234,46 +297,67 @@ struct CoFsm
     }
     
     // actual state step execution will be delayed to next frame
-    void ChangeState(const std::string& newState)
+    void ChangeState(FsmStateHandle newState)
     {
-        assert(m_stateTable.count(newState) > 0 && "state table does not contain state");
+        assert(newState.index < m_states.size() && "state table does not contain state");
+        if(newState.index >= m_states.size() || !m_states[newState.index].step)
+            throw "no step function";
 
-        if(m_runtime.state && m_runtime.state->exit)
-            m_runtime.state->exit();
+        if(m_states[m_runtime.state.index].exit)
+            m_states[m_runtime.state.index].exit();
 
-        m_runtime.state = &m_stateTable[newState];
+        m_runtime.state = newState;
         m_runtime.elapsed = 0.0f;
-
-        if(!m_runtime.state->step)
-            throw "no step function";
         
         for(auto timer : m_invokeList)
             m_destroyList.push_back(timer.handle);
         m_invokeList.clear();
+        for(auto timer : m_deferredList)
+            m_destroyList.push_back(timer.handle);
+        m_deferredList.clear();
 
-        StartCoroutine(m_runtime.state->step(m_runtime.dt, m_runtime.elapsed));
+        StartCoroutine(m_states[newState.index].step(m_runtime.dt, m_runtime.elapsed));
     }
-    void ChangeOtherState(const std::string& newState)
+    void ChangeState(std::string_view newState)
     {
-        if (m_runtime.state && m_runtime.state->name == newState) return;
+        ChangeState(FindState(newState));
+    }
+    void ChangeOtherState(FsmStateHandle newState)
+    {
+        if (m_runtime.state == newState) return;
 		ChangeState(newState);
     }
+    void ChangeOtherState(std::string_view newState)
+    {
+        ChangeOtherState(FindState(newState));
+    }
     
     std::string DebugReportCurrentStateName()
     {
-        if (m_runtime.state)
-            return m_runtime.state->name;
+        if (m_runtime.state.index < m_states.size())
+            return m_states[m_runtime.state.index].name;
         else return "null state";
     }
     
-    void Run(const std::string& state)
+    void Run(FsmStateHandle state)
     {
         ChangeState(state);
     }
+    void Run(std::string_view state)
+    {
+        ChangeState(FindState(state));
+    }
+    
+    // invalid when no state has that name
+    FsmStateHandle FindState(std::string_view name) const
+    {
+        auto it = m_stateIndex.find(name);
+        return it != m_stateIndex.end() ? FsmStateHandle{ it->second } : FsmStateHandle{};
+    }
     
     void ScheduleTimerResume(float duration, std::coroutine_handle<> h)
     {
-        m_invokeList.push_back({ m_runtime.elapsed + duration, h });
+        PushInvoke({ m_runtime.elapsed + duration, m_nextSeq++, h });
     }
     
     void ScheduleNextFrameResume(std::coroutine_handle<> h)
@@ -281,29 +365,67 @@ struct CoFsm
         ScheduleTimerResume(0, h);
     }
 
-    void AddState(const State& state)
+    // the name is interned here, once; adding a name again replaces that state and keeps its handle
+    FsmStateHandle AddState(State state)
     {
-        m_stateTable[state.name] = state;
+        auto it = m_stateIndex.find(std::string_view(state.name));
+        if(it != m_stateIndex.end())
+        {
+            m_states[it->second] = std::move(state);
+            return FsmStateHandle{ it->second };
+        }
+        const FsmStateHandle handle{ static_cast<uint32_t>(m_states.size()) };
+        m_stateIndex.emplace(state.name, handle.index);
+        m_states.push_back(std::move(state));
+        return handle;
     }
     
-    void AddState(std::initializer_list<State> states)
+    // fills a fixed slot, normally an enum value; add these before any state added by name alone,
+    // which takes the next slot past the end
+    FsmStateHandle AddState(FsmStateHandle slot, State state)
+    {
+        assert(slot.IsValid() && slot.index != 0 && "slot 0 is the empty state");
+        if(slot.index >= m_states.size())
+            m_states.resize(slot.index + 1);
+        auto previous = m_stateIndex.find(std::string_view(m_states[slot.index].name));
+        if(previous != m_stateIndex.end() && previous->second == slot.index)
+            m_stateIndex.erase(previous);
+        m_stateIndex[state.name] = slot.index;
+        m_states[slot.index] = std::move(state);
+        return slot;
+    }
+    
+    template<size_t N>
+    void AddState(State (&&states)[N])
     {
         for(auto& s : states)
-            AddState(s);
+            AddState(std::move(s));
     }
     
+    void PushInvoke(const TimerInvoke& timer)
+    {
+        m_invokeList.push_back(timer);
+        std::push_heap(m_invokeList.begin(), m_invokeList.end(), LaterInvoke{});
+    }
+
     StateRuntime m_runtime;
     
-    std::vector<TimerInvoke>               m_invokeList;
+    std::vector<TimerInvoke>               m_invokeList;   // heap, see LaterInvoke
+    std::vector<TimerInvoke>               m_deferredList; // due during Step but scheduled by it
+    uint64_t                               m_nextSeq = 0;
     std::vector<std::coroutine_handle<>>   m_destroyList;
-    std::unordered_map<std::string, State> m_stateTable;
-};
 
-template<typename X>
-inline auto co_deref(X* ptr) { return *ptr; }
+private:
+    // lets m_stateIndex.find take a string_view without building a string
+    struct NameHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+    };
 
-template<>
-inline auto co_deref<void>(void* ptr){ }
+    std::vector<State>                     m_states;     // indexed by FsmStateHandle
+    std::unordered_map<std::string, uint32_t, NameHash, std::equal_to<>> m_stateIndex;
+};
 
 template<typename T>
 auto fsm_coro<T>::promise_type::final_suspend() noexcept
@@ -339,7 +461,14 @@ auto fsm_coro<T>::promise_type::await_transform(fsm_coro<U>&& coro)
         bool await_ready() noexcept { return false; }
         // symetric transfer and immediately execute
         auto await_suspend(std::coroutine_handle<> self) noexcept { return cont_handle; }
-        auto await_resume() noexcept { return co_deref(cont_handle.promise().ret_ptr); }
+        auto await_resume() noexcept
+        {
+            if constexpr (!std::is_void_v<U>)
+            {
+                assert(cont_handle.promise().ret_slot && "coroutine finished without yield::ret");
+                return std::move(*cont_handle.promise().ret_slot);
+            }
+        }
     };
     return cont_awaitable { cont_handle };
 }
@@ -348,7 +477,7 @@ template<typename T>
 template<typename U>
 auto fsm_coro<T>::promise_type::await_transform(yield::ret_value<U>&& ret)
 {
-    ret_ptr = new U(std::move(ret.value));
+    ret_slot.emplace(std::move(ret.value));
     returned = true;
     scheduler->m_destroyList.push_back(get_handle());
     return transfer_awaitable { std::exchange(awaiter_func, nullptr) };
@@ -367,6 +496,9 @@ auto fsm_coro<T>::promise_type::await_transform(yield::change_state&& state)
 {
     returned = true;
     scheduler->m_destroyList.push_back(get_handle());
-    scheduler->ChangeState(state.state);
+    if(state.state.IsValid())
+        scheduler->ChangeState(state.state);
+    else
+        scheduler->ChangeState(state.name);
     return std::suspend_always{};
 }
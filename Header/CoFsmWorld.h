@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "CoFSM.h"
+#include "ParallelAlgorithms.h"
+#include "ThreadPool.h"
+
+// Owns many CoFsm and steps them together. The clock of every FSM (elapsed time of its state) and
+// the time its next coroutine is due live in two flat arrays, so a frame is one pass over those
+// arrays, and only the FSMs that have something to resume are touched at all; a CoFsm stepped by
+// the world behaves exactly as if Step(dt) had been called on it every frame.
+// With a ThreadPool the pass is split across its workers (ParallelFor), which requires the FSMs to be
+// independent: a coroutine may only touch its own FSM and data no other FSM touches in that frame.
+// FSMs never move once created (coroutines point at them), and are changed from outside a Step only
+// through With, which brings their clock up to date first and picks up what they scheduled.
+class CoFsmWorld
+{
+public:
+    using FsmId = uint32_t;
+    static constexpr FsmId kInvalidFsm = std::numeric_limits<FsmId>::max();
+
+    // pool nullptr: always step on the calling thread; grain: FSMs per claimed chunk, 0 picks one
+    explicit CoFsmWorld(ThreadPool* pool = nullptr, size_t grain = 0)
+        : m_pool(pool), m_grain(grain)
+    {
+    }
+
+    CoFsmWorld(const CoFsmWorld&) = delete;
+    CoFsmWorld& operator=(const CoFsmWorld&) = delete;
+
+    // a fresh, empty CoFsm; set it up (AddState, Run) through With
+    FsmId Create()
+    {
+        FsmId id = kInvalidFsm;
+        if(!m_freeIds.empty())
+        {
+            id = m_freeIds.back();
+            m_freeIds.pop_back();
+        }
+        else
+        {
+            id = static_cast<FsmId>(m_elapsed.size());
+            if((id & (kChunkFsms - 1)) == 0)
+                m_chunks.emplace_back(std::make_unique<CoFsm[]>(kChunkFsms));
+            m_elapsed.push_back(0.0f);
+            m_nextResume.push_back(kNever);
+            m_alive.push_back(0);
+        }
+        m_alive[id] = 1;
+        m_count++;
+        Sync(id);
+        return id;
+    }
+
+    // destroys every coroutine of the FSM; the id may be handed out again by Create
+    void Destroy(FsmId id)
+    {
+        assert(IsAlive(id) && "CoFsmWorld: destroying an unknown fsm");
+        FsmAt(id) = CoFsm();
+        m_elapsed[id] = 0.0f;
+        m_nextResume[id] = kNever;
+        m_alive[id] = 0;
+        m_freeIds.push_back(id);
+        m_count--;
+    }
+
+    // runs f(fsm) and returns what it returns; this is the way to AddState, Run, ChangeState or
+    // StartCoroutine on an FSM of the world. Not while the world is stepping.
+    template<typename F>
+    decltype(auto) With(FsmId id, F&& f)
+    {
+        assert(IsAlive(id) && "CoFsmWorld: unknown fsm");
+        CoFsm& fsm = FsmAt(id);
+        fsm.m_runtime.elapsed = m_elapsed[id];
+        if constexpr (std::is_void_v<std::invoke_result_t<F, CoFsm&>>)
+        {
+            std::forward<F>(f)(fsm);
+            Sync(id);
+        }
+        else
+        {
+            decltype(auto) result = std::forward<F>(f)(fsm);
+            Sync(id);
+            return result;
+        }
+    }
+
+    // read-only view; its m_runtime.elapsed is only current right after the FSM was stepped
+    const CoFsm& Get(FsmId id) const
+    {
+        assert(IsAlive(id) && "CoFsmWorld: unknown fsm");
+        return m_chunks[id >> kChunkShift][id & (kChunkFsms - 1)];
+    }
+
+    void Step(float dt)
+    {
+        const size_t count = m_elapsed.size();
+        auto stepOne = [this, dt](size_t i)
+        {
+            m_elapsed[i] += dt;
+            if(m_nextResume[i] <= m_elapsed[i])
+                Resume(static_cast<FsmId>(i), dt);
+        };
+
+        if(m_pool && m_pool->WorkerCount() > 0 && count > m_grain)
+        {
+            ParallelFor(*m_pool, size_t(0), count, stepOne, m_grain);
+        }
+        else
+        {
+            for(size_t i = 0; i < count; i++)
+                stepOne(i);
+        }
+    }
+
+    bool IsAlive(FsmId id) const { return id < m_alive.size() && m_alive[id] != 0; }
+    size_t Size() const { return m_count; }
+
+private:
+    static constexpr uint32_t kChunkShift = 10;
+    static constexpr uint32_t kChunkFsms = uint32_t(1) << kChunkShift;
+    static constexpr float kNever = std::numeric_limits<float>::infinity();
+
+    CoFsm& FsmAt(FsmId id) { return m_chunks[id >> kChunkShift][id & (kChunkFsms - 1)]; }
+
+    // same as CoFsm::Step on an FSM whose clock the world has just advanced
+    void Resume(FsmId id, float dt)
+    {
+        CoFsm& fsm = FsmAt(id);
+        fsm.m_runtime.dt = dt;
+        fsm.m_runtime.elapsed = m_elapsed[id];
+        fsm.ResumeDue();
+        Sync(id);
+    }
+
+    // a state change resets the clock, and resuming or scheduling moves the next resume time
+    void Sync(FsmId id)
+    {
+        const CoFsm& fsm = FsmAt(id);
+        m_elapsed[id] = fsm.m_runtime.elapsed;
+        m_nextResume[id] = fsm.NextResumeTime();
+    }
+
+    ThreadPool* m_pool = nullptr;
+    size_t m_grain = 0;
+    size_t m_count = 0;
+
+    // structure of arrays, indexed by FsmId
+    std::vector<float> m_elapsed;
+    std::vector<float> m_nextResume;
+    std::vector<uint8_t> m_alive;
+
+    std::vector<std::unique_ptr<CoFsm[]>> m_chunks; // kChunkFsms each, never moved
+    std::vector<FsmId> m_freeIds;
+};
@@ -3,68 +3,174 @@
 #include <cassert>
 #include <cstddef>
 #include <functional>
-#include <memory>
+#include <memory_resource>
+#include <new>
 #include <random>
+#include <type_traits>
 #include <utility>
-
+#include <vector>
+#include "AppendOwned.h"
+
+// Sorted set with positional access (At/EraseAt) through per-link spans, O(log n) expected.
+// Nodes are variable height: one allocation holds the value inline, followed by exactly as many
+// links as RandomLevel() gave the node, so an average node (two levels) costs the value plus four
+// words and a lookup compares values without another pointer chase. Nodes are carved from blocks
+// owned by the list; a freed node is reused by the next node of the same height, and Clear hands
+// every block back at once. The blocks come from a std::pmr::memory_resource, the default resource
+// unless one is given (e.g. a MonotonicArena from Arena.h).
 template<typename T, typename Compare = std::less<T>, int MaxLevel = 24>
 class IndexedSkipList
 {
 	static_assert(MaxLevel > 0, "IndexedSkipList: MaxLevel must be positive");
 
 private:
+	struct Node;
+
+	struct Link
+	{
+		Node* next;
+		std::size_t span; // level 0 steps from this node to 'next'
+	};
+
+	// the links follow the node in the same allocation, see NodeBytes
 	struct Node
 	{
-		std::unique_ptr<T> value;
-		std::array<Node*, MaxLevel> next;
-		std::array<std::size_t, MaxLevel> span;
+		alignas(T) unsigned char storage[sizeof(T)];
+		int level;
+
+		T& Value() { return *std::launder(reinterpret_cast<T*>(storage)); }
+		const T& Value() const { return *std::launder(reinterpret_cast<const T*>(storage)); }
+		Link* Links() { return std::launder(reinterpret_cast<Link*>(reinterpret_cast<unsigned char*>(this) + kLinksOffset)); }
+	};
+
+	static constexpr std::size_t kNodeAlignment = alignof(Node) > alignof(Link) ? alignof(Node) : alignof(Link);
+	static constexpr std::size_t kLinksOffset = (sizeof(Node) + alignof(Link) - 1) / alignof(Link) * alignof(Link);
+
+	static constexpr std::size_t NodeBytes(int level)
+	{
+		const std::size_t bytes = kLinksOffset + static_cast<std::size_t>(level) * sizeof(Link);
+		return (bytes + kNodeAlignment - 1) / kNodeAlignment * kNodeAlignment;
+	}
+
+	// bump allocation out of large blocks, with a free list per node height
+	class NodeArena
+	{
+		static constexpr std::size_t kBlockBytes = 64 * 1024;
+
+		struct FreeNode
+		{
+			FreeNode* next;
+		};
+
+		struct Block
+		{
+			void* memory;
+			std::size_t bytes;
+		};
+
+		std::pmr::memory_resource* _resource;
+		std::vector<Block> _blocks;
+		unsigned char* _cursor = nullptr;
+		std::size_t _remaining = 0;
+		std::array<FreeNode*, MaxLevel + 1> _free{};
+
+	public:
+		explicit NodeArena(std::pmr::memory_resource* resource) : _resource(resource) {}
+		NodeArena(const NodeArena&) = delete;
+		NodeArena& operator= (const NodeArena&) = delete;
+
+		~NodeArena()
+		{
+			Release();
+		}
+
+		void* Allocate(int level)
+		{
+			if (FreeNode* node = _free[level])
+			{
+				_free[level] = node->next;
+				return node;
+			}
 
-		Node() : value(nullptr)
+			const std::size_t bytes = NodeBytes(level);
+			if (_remaining < bytes)
+			{
+				const std::size_t blockBytes = bytes > kBlockBytes ? bytes : kBlockBytes;
+				const Block& block = AppendOwned(_blocks, [&] { return Block{ _resource->allocate(blockBytes, kNodeAlignment), blockBytes }; });
+				_cursor = static_cast<unsigned char*>(block.memory);
+				_remaining = blockBytes;
+			}
+			void* memory = _cursor;
+			_cursor += bytes;
+			_remaining -= bytes;
+			return memory;
+		}
+
+		void Deallocate(void* memory, int level)
 		{
-			next.fill(nullptr);
-			span.fill(0);
+			_free[level] = ::new (memory) FreeNode{ _free[level] };
 		}
 
-		template<typename U>
-		explicit Node(U&& v) : value(std::make_unique<T>(std::forward<U>(v)))
+		void Release()
 		{
-			next.fill(nullptr);
-			span.fill(0);
+			for (const Block& block : _blocks)
+			{
+				_resource->deallocate(block.memory, block.bytes, kNodeAlignment);
+			}
+			_blocks.clear();
+			_cursor = nullptr;
+			_remaining = 0;
+			_free.fill(nullptr);
 		}
 	};
 
-	Node* _head;
+	Node* _head; // MaxLevel links, never holds a value
 	std::size_t _size;
 	int _level;
 	Compare _comp;
 	std::mt19937 _rng;
 	std::uniform_real_distribution<double> _dist;
+	NodeArena _arena;
 
 public:
 	IndexedSkipList() :
-		_head(new Node()),
+		_head(NewHead()),
 		_size(0),
 		_level(1),
 		_comp(Compare()),
 		_rng(std::random_device{}()),
-		_dist(0.0, 1.0)
+		_dist(0.0, 1.0),
+		_arena(std::pmr::get_default_resource())
 	{
 	}
 
 	explicit IndexedSkipList(Compare comp) :
-		_head(new Node()),
+		_head(NewHead()),
+		_size(0),
+		_level(1),
+		_comp(std::move(comp)),
+		_rng(std::random_device{}()),
+		_dist(0.0, 1.0),
+		_arena(std::pmr::get_default_resource())
+	{
+	}
+
+	// nodes are carved from 'resource', which must outlive the list
+	explicit IndexedSkipList(std::pmr::memory_resource* resource, Compare comp = Compare()) :
+		_head(NewHead()),
 		_size(0),
 		_level(1),
 		_comp(std::move(comp)),
 		_rng(std::random_device{}()),
-		_dist(0.0, 1.0)
+		_dist(0.0, 1.0),
+		_arena(resource)
 	{
 	}
 
 	~IndexedSkipList()
 	{
 		Clear();
-		delete _head;
+		::operator delete(_head, std::align_val_t(kNodeAlignment));
 		_head = nullptr;
 	}
 
@@ -78,58 +184,37 @@ public:
 
 	void Clear()
 	{
-		Node* current = _head->next[0];
-		while (current)
+		if constexpr (!std::is_trivially_destructible_v<T>)
 		{
-			Node* next = current->next[0];
-			delete current;
-			current = next;
+			Node* current = _head->Links()[0].next;
+			while (current)
+			{
+				Node* next = current->Links()[0].next;
+				current->Value().~T();
+				current = next;
+			}
 		}
-		_head->next.fill(nullptr);
-		_head->span.fill(0);
+		_arena.Release();
+		ResetLinks(_head, MaxLevel);
 		_size = 0;
 		_level = 1;
 	}
 
 	bool Contains(const T& value) const
 	{
-		return Find(value) != nullptr;
+		return FindNode(value) != nullptr;
 	}
 
 	T* Find(const T& value)
 	{
-		Node* x = _head;
-		for (int i = _level - 1; i >= 0; --i)
-		{
-			while (x->next[i] && _comp(*x->next[i]->value, value))
-			{
-				x = x->next[i];
-			}
-		}
-		x = x->next[0];
-		if (x && Equals(*x->value, value))
-		{
-			return x->value.get();
-		}
-		return nullptr;
+		Node* node = FindNode(value);
+		return node ? &node->Value() : nullptr;
 	}
 
 	const T* Find(const T& value) const
 	{
-		const Node* x = _head;
-		for (int i = _level - 1; i >= 0; --i)
-		{
-			while (x->next[i] && _comp(*x->next[i]->value, value))
-			{
-				x = x->next[i];
-			}
-		}
-		x = x->next[0];
-		if (x && Equals(*x->value, value))
-		{
-			return x->value.get();
-		}
-		return nullptr;
+		const Node* node = FindNode(value);
+		return node ? &node->Value() : nullptr;
 	}
 
 	bool Insert(T value)
@@ -141,45 +226,47 @@ public:
 		for (int i = _level - 1; i >= 0; --i)
 		{
 			rank[i] = (i == _level - 1) ? 0 : rank[i + 1];
-			while (x->next[i] && _comp(*x->next[i]->value, value))
+			while (x->Links()[i].next && _comp(x->Links()[i].next->Value(), value))
 			{
-				rank[i] += x->span[i];
-				x = x->next[i];
+				rank[i] += x->Links()[i].span;
+				x = x->Links()[i].next;
 			}
 			update[i] = x;
 		}
 
-		x = x->next[0];
-		if (x && Equals(*x->value, value))
+		x = x->Links()[0].next;
+		if (x && Equals(x->Value(), value))
 		{
 			return false;
 		}
 
 		int newLevel = RandomLevel();
+		Node* node = NewNode(std::move(value), newLevel);
 		if (newLevel > _level)
 		{
 			for (int i = _level; i < newLevel; ++i)
 			{
 				rank[i] = 0;
 				update[i] = _head;
-				_head->span[i] = _size;
+				_head->Links()[i].span = _size;
 			}
 			_level = newLevel;
 		}
 
-		Node* node = new Node(std::move(value));
+		Link* links = node->Links();
 		for (int i = 0; i < newLevel; ++i)
 		{
-			node->next[i] = update[i]->next[i];
-			update[i]->next[i] = node;
+			Link& prev = update[i]->Links()[i];
+			links[i].next = prev.next;
+			prev.next = node;
 
-			node->span[i] = update[i]->span[i] - (rank[0] - rank[i]);
-			update[i]->span[i] = (rank[0] - rank[i]) + 1;
+			links[i].span = prev.span - (rank[0] - rank[i]);
+			prev.span = (rank[0] - rank[i]) + 1;
 		}
 
 		for (int i = newLevel; i < _level; ++i)
 		{
-			update[i]->span[i] += 1;
+			update[i]->Links()[i].span += 1;
 		}
 
 		_size++;
@@ -192,15 +279,15 @@ public:
 		Node* x = _head;
 		for (int i = _level - 1; i >= 0; --i)
 		{
-			while (x->next[i] && _comp(*x->next[i]->value, value))
+			while (x->Links()[i].next && _comp(x->Links()[i].next->Value(), value))
 			{
-				x = x->next[i];
+				x = x->Links()[i].next;
 			}
 			update[i] = x;
 		}
 
-		Node* target = x->next[0];
-		if (!target || !Equals(*target->value, value))
+		Node* target = x->Links()[0].next;
+		if (!target || !Equals(target->Value(), value))
 		{
 			return false;
 		}
@@ -220,15 +307,15 @@ public:
 		std::size_t traversed = 0;
 		for (int i = _level - 1; i >= 0; --i)
 		{
-			while (x->next[i] && traversed + x->span[i] <= index)
+			while (x->Links()[i].next && traversed + x->Links()[i].span <= index)
 			{
-				traversed += x->span[i];
-				x = x->next[i];
+				traversed += x->Links()[i].span;
+				x = x->Links()[i].next;
 			}
 			update[i] = x;
 		}
 
-		Node* target = update[0]->next[0];
+		Node* target = update[0]->Links()[0].next;
 		if (!target)
 		{
 			return false;
@@ -239,63 +326,107 @@ public:
 
 	T* At(std::size_t index)
 	{
-		if (index >= _size)
+		Node* node = NodeAt(index);
+		return node ? &node->Value() : nullptr;
+	}
+
+	const T* At(std::size_t index) const
+	{
+		const Node* node = NodeAt(index);
+		return node ? &node->Value() : nullptr;
+	}
+
+	T& operator[] (std::size_t index)
+	{
+		T* p = At(index);
+		assert(p && "IndexedSkipList: index out of range");
+		return *p;
+	}
+
+	const T& operator[] (std::size_t index) const
+	{
+		const T* p = At(index);
+		assert(p && "IndexedSkipList: index out of range");
+		return *p;
+	}
+
+private:
+	static Node* NewHead()
+	{
+		Node* head = ::new (::operator new(NodeBytes(MaxLevel), std::align_val_t(kNodeAlignment))) Node;
+		head->level = MaxLevel;
+		ResetLinks(head, MaxLevel);
+		return head;
+	}
+
+	static void ResetLinks(Node* node, int level)
+	{
+		Link* links = node->Links();
+		for (int i = 0; i < level; ++i)
 		{
-			return nullptr;
+			::new (static_cast<void*>(links + i)) Link{ nullptr, 0 };
+		}
+	}
+
+	Node* NewNode(T&& value, int level)
+	{
+		void* memory = _arena.Allocate(level);
+		Node* node = ::new (memory) Node;
+		try
+		{
+			::new (static_cast<void*>(node->storage)) T(std::move(value));
+		}
+		catch (...)
+		{
+			_arena.Deallocate(memory, level);
+			throw;
 		}
+		node->level = level;
+		ResetLinks(node, level);
+		return node;
+	}
+
+	void FreeNode(Node* node)
+	{
+		const int level = node->level;
+		node->Value().~T();
+		_arena.Deallocate(node, level);
+	}
 
+	Node* FindNode(const T& value) const
+	{
 		Node* x = _head;
-		std::size_t traversed = 0;
 		for (int i = _level - 1; i >= 0; --i)
 		{
-			while (x->next[i] && traversed + x->span[i] <= index)
+			while (x->Links()[i].next && _comp(x->Links()[i].next->Value(), value))
 			{
-				traversed += x->span[i];
-				x = x->next[i];
+				x = x->Links()[i].next;
 			}
 		}
-
-		Node* target = x->next[0];
-		return target ? target->value.get() : nullptr;
+		x = x->Links()[0].next;
+		return x && Equals(x->Value(), value) ? x : nullptr;
 	}
 
-	const T* At(std::size_t index) const
+	Node* NodeAt(std::size_t index) const
 	{
 		if (index >= _size)
 		{
 			return nullptr;
 		}
 
-		const Node* x = _head;
+		Node* x = _head;
 		std::size_t traversed = 0;
 		for (int i = _level - 1; i >= 0; --i)
 		{
-			while (x->next[i] && traversed + x->span[i] <= index)
+			while (x->Links()[i].next && traversed + x->Links()[i].span <= index)
 			{
-				traversed += x->span[i];
-				x = x->next[i];
+				traversed += x->Links()[i].span;
+				x = x->Links()[i].next;
 			}
 		}
-
-		const Node* target = x->next[0];
-		return target ? target->value.get() : nullptr;
-	}
-
-	T& operator[] (std::size_t index)
-	{
-		T* p = At(index);
-		assert(p && "IndexedSkipList: index out of range");
-		return *p;
-	}
-
-	const T& operator[] (std::size_t index) const
-	{
-		const T* p = At(index);
-		assert(p && "IndexedSkipList: index out of range");
-		return *p;
+		return x->Links()[0].next;
 	}
 
-private:
 	int RandomLevel()
 	{
 		constexpr double kP = 0.5;
@@ -314,22 +445,24 @@ private:
 
 	void RemoveNode(Node* target, std::array<Node*, MaxLevel>& update)
 	{
+		Link* targetLinks = target->Links();
 		for (int i = 0; i < _level; ++i)
 		{
-			if (update[i]->next[i] == target)
+			Link& prev = update[i]->Links()[i];
+			if (prev.next == target)
 			{
-				update[i]->span[i] += target->span[i] - 1;
-				update[i]->next[i] = target->next[i];
+				prev.span += targetLinks[i].span - 1;
+				prev.next = targetLinks[i].next;
 			}
 			else
 			{
-				update[i]->span[i] -= 1;
+				prev.span -= 1;
 			}
 		}
 
-		delete target;
+		FreeNode(target);
 		_size--;
-		while (_level > 1 && _head->next[_level - 1] == nullptr)
+		while (_level > 1 && _head->Links()[_level - 1].next == nullptr)
 		{
 			_level--;
 		}
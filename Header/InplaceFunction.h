@@ -0,0 +1,158 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "PoolAllocator.h"
+
+// Move-only type-erased callable with small buffer storage.
+// Callables up to InlineBytes live inside the object; bigger ones are boxed in a SizeClassPool
+// block, so constructing one never goes to the global heap in steady state.
+template<typename Signature, size_t InlineBytes = 48>
+class InplaceFunction;
+
+template<typename R, typename ...Args, size_t InlineBytes>
+class InplaceFunction<R(Args...), InlineBytes>
+{
+	struct Ops
+	{
+		R(*invoke)(void* storage, Args&&... args);
+		void(*move)(void* dst, void* src) noexcept; // move constructs into dst and destroys src
+		void(*destroy)(void* storage) noexcept;
+	};
+
+	template<typename F>
+	static constexpr bool kFitsInline =
+		sizeof(F) <= InlineBytes &&
+		alignof(F) <= alignof(std::max_align_t) &&
+		std::is_nothrow_move_constructible_v<F>;
+
+	template<typename F>
+	struct InlineOps
+	{
+		static R Invoke(void* storage, Args&&... args)
+		{
+			return std::invoke(*std::launder(reinterpret_cast<F*>(storage)), std::forward<Args>(args)...);
+		}
+		static void Move(void* dst, void* src) noexcept
+		{
+			F* from = std::launder(reinterpret_cast<F*>(src));
+			new (dst) F(std::move(*from));
+			from->~F();
+		}
+		static void Destroy(void* storage) noexcept
+		{
+			std::launder(reinterpret_cast<F*>(storage))->~F();
+		}
+		static constexpr Ops kOps{ &Invoke, &Move, &Destroy };
+	};
+
+	template<typename F>
+	struct BoxedOps
+	{
+		static F*& Box(void* storage) { return *std::launder(reinterpret_cast<F**>(storage)); }
+
+		static R Invoke(void* storage, Args&&... args)
+		{
+			return std::invoke(*Box(storage), std::forward<Args>(args)...);
+		}
+		static void Move(void* dst, void* src) noexcept
+		{
+			new (dst) F*(Box(src));
+		}
+		static void Destroy(void* storage) noexcept
+		{
+			F* f = Box(storage);
+			f->~F();
+			PoolAllocator<F>().deallocate(f, 1);
+		}
+		static constexpr Ops kOps{ &Invoke, &Move, &Destroy };
+	};
+
+	alignas(std::max_align_t) unsigned char _storage[InlineBytes < sizeof(void*) ? sizeof(void*) : InlineBytes];
+	const Ops* _ops = nullptr;
+
+public:
+	InplaceFunction() noexcept = default;
+	InplaceFunction(std::nullptr_t) noexcept {}
+
+	template<typename F>
+		requires (!std::is_same_v<std::remove_cvref_t<F>, InplaceFunction> &&
+			std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+	InplaceFunction(F&& f)
+	{
+		using Fn = std::decay_t<F>;
+		if constexpr (kFitsInline<Fn>)
+		{
+			new (_storage) Fn(std::forward<F>(f));
+			_ops = &InlineOps<Fn>::kOps;
+		}
+		else
+		{
+			PoolAllocator<Fn> alloc;
+			Fn* boxed = alloc.allocate(1);
+			try {
+				new (boxed) Fn(std::forward<F>(f));
+			} catch (...) {
+				alloc.deallocate(boxed, 1);
+				throw;
+			}
+			new (_storage) Fn*(boxed);
+			_ops = &BoxedOps<Fn>::kOps;
+		}
+	}
+
+	~InplaceFunction()
+	{
+		Reset();
+	}
+
+	InplaceFunction(const InplaceFunction&) = delete;
+	InplaceFunction& operator= (const InplaceFunction&) = delete;
+
+	InplaceFunction(InplaceFunction&& other) noexcept
+	{
+		if (other._ops)
+		{
+			other._ops->move(_storage, other._storage);
+			_ops = std::exchange(other._ops, nullptr);
+		}
+	}
+
+	InplaceFunction& operator= (InplaceFunction&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			if (other._ops)
+			{
+				other._ops->move(_storage, other._storage);
+				_ops = std::exchange(other._ops, nullptr);
+			}
+		}
+		return *this;
+	}
+
+	InplaceFunction& operator= (std::nullptr_t) noexcept
+	{
+		Reset();
+		return *this;
+	}
+
+	void Reset() noexcept
+	{
+		if (_ops)
+		{
+			_ops->destroy(_storage);
+			_ops = nullptr;
+		}
+	}
+
+	explicit operator bool() const noexcept { return _ops != nullptr; }
+
+	R operator() (Args... args)
+	{
+		return _ops->invoke(_storage, std::forward<Args>(args)...);
+	}
+};
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// Opt-in counters and histograms for the hot paths of the components (queue full / empty retries,
+// CAS failures, cache hits, log stall time...) behind one snapshot API.
+// They only exist when CUCW_INSTRUMENTATION is defined (CMake option of the same name): otherwise the
+// INSTRUMENT_* macros expand to nothing and do not evaluate their arguments, so an instrumented
+// component compiles to the same code as before. Snapshot, Reset and Print are always available and
+// report zeros in that case.
+// Every thread counts into a block of its own with plain relaxed load/store pairs, so counting costs
+// no lock prefix and no shared cache line; Snapshot sums the blocks of the live threads and what the
+// exited ones left behind.
+namespace Instrumentation
+{
+#if defined(CUCW_INSTRUMENTATION)
+    inline constexpr bool kEnabled = true;
+#else
+    inline constexpr bool kEnabled = false;
+#endif
+
+    enum class Counter : uint32_t
+    {
+        RingFullRetries,          // TryPush / TryPushBulk found an SPSC or MPMC ring full
+        RingEmptyRetries,         // TryPop / TryPopBulk found an SPSC or MPMC ring empty
+        RingCasFailures,          // an MPMC ring position CAS lost against another thread
+        LockFreeQueueCasFailures, // a LockFreeQueue link, tail or head CAS lost against another thread
+        LockFreeQueueEmpty,       // Dequeue found the queue empty
+        WaitableQueueParks,       // a WaitableQueue Push / Pop spun out and went to sleep
+        CacheHits,                // LRUCache::Get found a live entry
+        CacheMisses,              // LRUCache::Get found nothing, or an expired entry
+        ThreadPoolSteals,         // a WorkStealing worker took a task from another worker
+        LogRecordsDropped,        // Drop / DropAndCount discarded a record on a full thread ring
+        Count
+    };
+
+    enum class Histogram : uint32_t
+    {
+        LogStallNs, // a log producer waited for buffer space, per wait
+        Count
+    };
+
+    inline constexpr size_t kCounterCount = static_cast<size_t>(Counter::Count);
+    inline constexpr size_t kHistogramCount = static_cast<size_t>(Histogram::Count);
+    inline constexpr size_t kBucketCount = 65; // bucket b holds values of bit width b: 0, 1, 2-3, 4-7 ...
+
+    constexpr std::string_view Name(Counter counter)
+    {
+        constexpr std::string_view names[kCounterCount] = {
+            "RingFullRetries",
+            "RingEmptyRetries",
+            "RingCasFailures",
+            "LockFreeQueueCasFailures",
+            "LockFreeQueueEmpty",
+            "WaitableQueueParks",
+            "CacheHits",
+            "CacheMisses",
+            "ThreadPoolSteals",
+            "LogRecordsDropped",
+        };
+        return names[static_cast<size_t>(counter)];
+    }
+
+    constexpr std::string_view Name(Histogram histogram)
+    {
+        constexpr std::string_view names[kHistogramCount] = {
+            "LogStallNs",
+        };
+        return names[static_cast<size_t>(histogram)];
+    }
+
+    struct HistogramStats
+    {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        std::array<uint64_t, kBucketCount> buckets{};
+
+        double Mean() const { return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count); }
+
+        // upper bound of the bucket the p-th fraction (0..1) of the values falls in, 0 when empty
+        uint64_t Percentile(double p) const
+        {
+            if (count == 0)
+                return 0;
+            const uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(count - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t b = 0; b < kBucketCount; b++)
+            {
+                seen += buckets[b];
+                if (seen >= rank)
+                    return b == 0 ? 0 : b >= 64 ? UINT64_MAX : (uint64_t(1) << b) - 1;
+            }
+            return UINT64_MAX;
+        }
+    };
+
+    struct Stats
+    {
+        std::array<uint64_t, kCounterCount> counters{};
+        std::array<HistogramStats, kHistogramCount> histograms{};
+
+        uint64_t operator[] (Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+        const HistogramStats& operator[] (Histogram histogram) const { return histograms[static_cast<size_t>(histogram)]; }
+    };
+
+    namespace Detail
+    {
+        struct ThreadBlock
+        {
+            std::atomic<uint64_t> counters[kCounterCount]{};
+            std::atomic<uint64_t> histogramCount[kHistogramCount]{};
+            std::atomic<uint64_t> histogramSum[kHistogramCount]{};
+            std::atomic<uint64_t> buckets[kHistogramCount][kBucketCount]{};
+        };
+
+        // only the owning thread writes, so a relaxed load and store is enough and Snapshot still
+        // reads whole values
+        inline void Bump(std::atomic<uint64_t>& value, uint64_t n)
+        {
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        inline void AddTo(Stats& stats, const ThreadBlock& block)
+        {
+            for (size_t c = 0; c < kCounterCount; c++)
+                stats.counters[c] += block.counters[c].load(std::memory_order_relaxed);
+            for (size_t h = 0; h < kHistogramCount; h++)
+            {
+                HistogramStats& histogram = stats.histograms[h];
+                histogram.count += block.histogramCount[h].load(std::memory_order_relaxed);
+                histogram.sum += block.histogramSum[h].load(std::memory_order_relaxed);
+                for (size_t b = 0; b < kBucketCount; b++)
+                    histogram.buckets[b] += block.buckets[h][b].load(std::memory_order_relaxed);
+            }
+        }
+
+        struct Registry
+        {
+            std::mutex mutex{};
+            std::vector<ThreadBlock*> live{};
+            Stats exited{};   // folded in from blocks of threads that ended
+            Stats baseline{}; // subtracted by Snapshot, moved up by Reset
+        };
+
+        inline Registry& GlobalRegistry()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        struct LocalBlock
+        {
+            ThreadBlock block{};
+
+            LocalBlock()
+            {
+                Registry& registry = GlobalRegistry();
+                std::lock_guard<std::mutex> hold(registry.mutex);
+                registry.live.push_back(&block);
+            }
+
+            ~LocalBlock()
+            {
+                Registry& registry = GlobalRegistry();
+                std::lock_guard<std::mutex> hold(registry.mutex);
+                AddTo(registry.exited, block);
+                std::erase(registry.live, &block);
+            }
+        };
+
+        inline ThreadBlock& Local()
+        {
+            static thread_local LocalBlock local;
+            return local.block;
+        }
+
+        inline Stats Total(Registry& registry)
+        {
+            Stats stats = registry.exited;
+            for (const ThreadBlock* block : registry.live)
+                AddTo(stats, *block);
+            return stats;
+        }
+    }
+
+    inline void Add(Counter counter, uint64_t n = 1)
+    {
+        Detail::Bump(Detail::Local().counters[static_cast<size_t>(counter)], n);
+    }
+
+    inline void Record(Histogram histogram, uint64_t value)
+    {
+        Detail::ThreadBlock& block = Detail::Local();
+        const size_t h = static_cast<size_t>(histogram);
+        Detail::Bump(block.histogramCount[h], 1);
+        Detail::Bump(block.histogramSum[h], value);
+        Detail::Bump(block.buckets[h][std::bit_width(value)], 1);
+    }
+
+    // records the lifetime of the object in nanoseconds
+    class ScopedTimer
+    {
+        Histogram _histogram;
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+        explicit ScopedTimer(Histogram histogram)
+            : _histogram(histogram), _start(std::chrono::steady_clock::now())
+        {
+        }
+        ~ScopedTimer()
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - _start;
+            Record(_histogram, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+    };
+
+    // everything counted since the start or the last Reset, by all threads
+    inline Stats Snapshot()
+    {
+        Detail::Registry& registry = Detail::GlobalRegistry();
+        std::lock_guard<std::mutex> hold(registry.mutex);
+        Stats stats = Detail::Total(registry);
+        for (size_t c = 0; c < kCounterCount; c++)
+            stats.counters[c] -= registry.baseline.counters[c];
+        for (size_t h = 0; h < kHistogramCount; h++)
+        {
+            HistogramStats& histogram = stats.histograms[h];
+            const HistogramStats& base = registry.baseline.histograms[h];
+            histogram.count -= base.count;
+            histogram.sum -= base.sum;
+            for (size_t b = 0; b < kBucketCount; b++)
+                histogram.buckets[b] -= base.buckets[b];
+        }
+        return stats;
+    }
+
+    // starts counting from zero; the blocks are owned by their threads, so this moves a baseline
+    inline void Reset()
+    {
+        Detail::Registry& registry = Detail::GlobalRegistry();
+        std::lock_guard<std::mutex> hold(registry.mutex);
+        registry.baseline = Detail::Total(registry);
+    }
+
+    // one line per counter and histogram that saw something
+    inline void Print(const Stats& stats, std::FILE* out = stdout)
+    {
+        for (size_t c = 0; c < kCounterCount; c++)
+        {
+            if (stats.counters[c] == 0)
+                continue;
+            const std::string_view name = Name(static_cast<Counter>(c));
+            std::fprintf(out, "  %-32.*s %14llu\n", static_cast<int>(name.size()), name.data(),
+                static_cast<unsigned long long>(stats.counters[c]));
+        }
+        for (size_t h = 0; h < kHistogramCount; h++)
+        {
+            const HistogramStats& histogram = stats.histograms[h];
+            if (histogram.count == 0)
+                continue;
+            const std::string_view name = Name(static_cast<Histogram>(h));
+            std::fprintf(out, "  %-32.*s %14llu samples, mean %.0f, p50 <= %llu, p99 <= %llu\n",
+                static_cast<int>(name.size()), name.data(), static_cast<unsigned long long>(histogram.count),
+                histogram.Mean(), static_cast<unsigned long long>(histogram.Percentile(0.5)),
+                static_cast<unsigned long long>(histogram.Percentile(0.99)));
+        }
+    }
+}
+
+#if defined(CUCW_INSTRUMENTATION)
+#define INSTRUMENT_COUNT(counter) ::Instrumentation::Add(::Instrumentation::Counter::counter)
+#define INSTRUMENT_COUNT_N(counter, n) ::Instrumentation::Add(::Instrumentation::Counter::counter, (n))
+#define INSTRUMENT_RECORD(histogram, value) ::Instrumentation::Record(::Instrumentation::Histogram::histogram, (value))
+#define INSTRUMENT_CONCAT_IMPL(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_IMPL(a, b)
+#define INSTRUMENT_TIME_SCOPE(histogram) \
+    ::Instrumentation::ScopedTimer INSTRUMENT_CONCAT(instrumentTimer_, __LINE__)(::Instrumentation::Histogram::histogram)
+#else
+#define INSTRUMENT_COUNT(counter) ((void)0)
+#define INSTRUMENT_COUNT_N(counter, n) ((void)0)
+#define INSTRUMENT_RECORD(histogram, value) ((void)0)
+#define INSTRUMENT_TIME_SCOPE(histogram) ((void)0)
+#endif
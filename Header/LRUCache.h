@@ -1,7 +1,18 @@
 #pragma once
 #include <assert.h>
-#include <list>
-#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "AppendOwned.h"
+#include "CachePolicy.h"
+#include "Instrumentation.h"
+#include "TimerWheel.h"
 
 template<typename VAL>
 class DefaultValueDeleter
@@ -16,38 +27,84 @@ public:
 	}
 };
 
-template<typename KEY, typename VAL, class ValueDeleter = DefaultValueDeleter<VAL>>
+// default weigher: every entry costs 1, so the capacity is an entry count
+struct UnitWeigher
+{
+	template<typename K, typename V>
+	size_t operator() (const K&, const V&) const { return 1; }
+};
+
+// Nodes live in chunked slab storage and are linked intrusively: pinned nodes into one list,
+// unpinned nodes into the lists of the eviction Policy (see CachePolicy.h, plain LRU by default).
+// The key index is an open-addressing table of (hash, Node*) slots with linear probing, so an entry
+// costs no per-node heap allocation, the key is stored once, and a Handle reaches its node without
+// any lookup.
+// The capacity is charged through Weigher (size_t operator()(const KEY&, const VAL&)), e.g. bytes.
+// Entries put with a TTL are dropped by the TimerWheel passed to the constructor when it fires; an
+// entry that is pinned at that moment stops being visible and is dropped when its last Handle goes.
+template<typename KEY, typename VAL, class ValueDeleter = DefaultValueDeleter<VAL>,
+	class Hash = std::hash<KEY>, class KeyEqual = std::equal_to<KEY>, class Policy = LRUPolicy,
+	class Weigher = UnitWeigher>
 class LRUCache
 {
 private:
-	struct Node
+	struct Node : CacheLink
 	{
 		KEY k;
 		VAL v;
 		int refCount;
+		bool expired = false;
+		uint64_t expiryTimer = 0; // TimerWheel::TimerHandle id, 0: no TTL
 
-		Node(const KEY& k, VAL&& v) :
-			k(k), v(std::move(v)), refCount(1) {}
+		template<typename V>
+		Node(const KEY& k, V&& v, size_t hash) :
+			k(k), v(std::forward<V>(v)), refCount(1)
+		{
+			this->hash = hash;
+		}
+	};
 
-		Node(const KEY& k, const VAL& v) :
-			k(k), v(v), refCount(1) {}
+	struct Slot
+	{
+		size_t hash;
+		Node* node; // nullptr: empty
 	};
 
-public:
-	using Iter = typename std::list<Node>::iterator;
+	// raw node storage, a freed node is reused through the free list before a new chunk is carved
+	union NodeStorage
+	{
+		NodeStorage* nextFree;
+		alignas(Node) unsigned char bytes[sizeof(Node)];
+	};
 
-private:
-	int _cacheCapacity;
+	static constexpr size_t kMaxChunkNodes = 4096;
+
+	static constexpr bool kCountsEntries = std::is_same_v<Weigher, UnitWeigher>;
+
+	size_t _cacheCapacity;
 	int _size;
-	std::list<Node> _nodesNotInUse;
-	std::list<Node> _nodesInUse;
-	std::unordered_map<KEY, Iter> _kvMap;
+	size_t _weight = 0;
+	size_t _evictions = 0;
+	size_t _expirations = 0;
+	TimerWheel* _expiryWheel;
+	CacheList _nodesInUse;
+	Policy _policy;
+	std::pmr::memory_resource* _resource; // node chunks and the hash table
+	std::pmr::vector<Slot> _slots;
+	size_t _slotMask;
+	std::vector<NodeStorage*> _chunks; // _chunkNodes each
+	size_t _chunkNodes;
+	size_t _chunkUsed;
+	NodeStorage* _freeNodes = nullptr;
 	ValueDeleter _deleter;
+	Weigher _weigher;
+	Hash _hash;
+	KeyEqual _equal;
 
 public:
 	class Handle
 	{
-		friend class LRUCache<KEY, VAL>;
+		friend class LRUCache; // the injected name, so custom ValueDeleter caches can build handles too
 
 		LRUCache* _cache;
 		Node* _node;
@@ -98,47 +155,98 @@ public:
 
 	Handle Get(const KEY& k)
 	{
-		auto target = _kvMap.find(k);
-		if (target != _kvMap.end())
+		const size_t hash = HashOf(k);
+		_policy.OnAccess(hash);
+		Node* node = Find(k, hash);
+		if (node == nullptr || node->expired)
 		{
-			return Handle(this, &(*target->second));
+			INSTRUMENT_COUNT(CacheMisses);
+			return Handle();
 		}
-		return Handle();
+		INSTRUMENT_COUNT(CacheHits);
+		_policy.OnHit(node);
+		return Handle(this, node);
 	}
 
+	// ttlMs == 0: the entry never expires; putting an existing key replaces its value and its TTL
 	template <typename V>
-	Handle Put(const KEY& k, V&& v)
+	Handle Put(const KEY& k, V&& v, uint32_t ttlMs = 0)
 	{
 		static_assert(std::is_constructible_v<VAL, V&&>, "LRUCache: Invalid Put Arg Type");
+		assert((ttlMs == 0 || _expiryWheel != nullptr) && "LRUCache: TTL needs a TimerWheel");
 
-		auto target = _kvMap.find(k);
-		if (target != _kvMap.end())
+		const size_t hash = HashOf(k);
+		_policy.OnAccess(hash);
+		if (Node* existing = Find(k, hash))
 		{
-			target->second->v = std::forward<V>(v);
-			return Handle(this, &(*target->second));
+			existing->v = std::forward<V>(v);
+			existing->expired = false;
+			_policy.OnHit(existing);
+			Handle handle(this, existing); // pinned, so the trim below cannot pick it
+			const size_t weight = _weigher(existing->k, existing->v);
+			_weight = _weight - existing->weight + weight;
+			_nodesInUse.Reweigh(existing, weight);
+			ArmExpiry(existing, ttlMs);
+			OnNewNodeGenerated();
+			return handle;
 		}
 
+		void* storage = AllocateNode();
+		Node* newNode = nullptr;
+		try {
+			newNode = new (storage) Node(k, std::forward<V>(v), hash);
+		} catch (...) {
+			ReleaseStorage(storage);
+			throw;
+		}
+		newNode->weight = _weigher(newNode->k, newNode->v);
 		_size++;
-		OnNewNodeGenerated(); // trim the cache first to prevent removing the new node
+		_weight += newNode->weight;
+		OnNewNodeGenerated(); // trim before linking so the new node cannot be the victim
 
-		auto newNode = _nodesNotInUse.emplace(_nodesNotInUse.end(), k, std::forward<V>(v));
-		_kvMap[k] = newNode;
-		return Handle(this, &(*newNode));
+		_policy.OnInsert(newNode);
+		Insert(newNode);
+		ArmExpiry(newNode, ttlMs);
+		return Handle(this, newNode);
 	}
 
-	LRUCache(int cap) :
-		_cacheCapacity(cap),
+	int Size() const { return _size; }
+	size_t Weight() const { return _weight; }
+	size_t Capacity() const { return _cacheCapacity; }
+	size_t EvictionCount() const { return _evictions; }
+	size_t ExpirationCount() const { return _expirations; }
+
+	// capacity is in Weigher units; expiryWheel is only needed for Put with a TTL and must outlive the cache;
+	// the entries and the hash table are allocated from 'resource' (e.g. a MonotonicArena), which must
+	// outlive the cache as well
+	LRUCache(size_t capacity, TimerWheel* expiryWheel = nullptr,
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+		_cacheCapacity(capacity),
 		_size(0),
-		_nodesNotInUse(std::list<Node>()),
-		_nodesInUse(std::list<Node>()),
-		_kvMap(std::unordered_map<KEY, Iter>())
-	{ }
+		_expiryWheel(expiryWheel),
+		_resource(resource),
+		_slots(resource)
+	{
+		// an entry count sizes the table exactly, a weight capacity says little about the entry count
+		const size_t expectedEntries = kCountsEntries ? capacity : (capacity < 1024 ? capacity : 1024);
+		_policy.Init(capacity, expectedEntries);
+
+		size_t slots = 16;
+		while (slots < expectedEntries * 2) slots <<= 1; // load factor <= 0.5 while within capacity
+		_slots.assign(slots, Slot{ 0, nullptr });
+		_slotMask = slots - 1;
+
+		_chunkNodes = expectedEntries < 16 ? 16 : (expectedEntries > kMaxChunkNodes ? kMaxChunkNodes : expectedEntries);
+		_chunkUsed = _chunkNodes; // first chunk is carved on the first Put
+	}
 
 	~LRUCache()
 	{
-		assert(_nodesInUse.empty());
-		_cacheCapacity = 0;
-		OnNewNodeGenerated(); // reuse this code to clean up the list
+		assert(_nodesInUse.Empty());
+		while (CacheLink* victim = _policy.Victim())
+			EvictNode(static_cast<Node*>(victim), true);
+		for (NodeStorage* chunk : _chunks)
+			_resource->deallocate(chunk, _chunkNodes * sizeof(NodeStorage), alignof(NodeStorage));
 	}
 
 	LRUCache(const LRUCache&) = delete;
@@ -147,38 +255,177 @@ public:
 	LRUCache(LRUCache&& other) noexcept = delete;
 
 private:
+	size_t HashOf(const KEY& k) const
+	{
+		// std::hash is often the identity, spread it before masking
+		return static_cast<size_t>(static_cast<uint64_t>(_hash(k)) * 0x9E3779B97F4A7C15ull);
+	}
+
+	size_t Home(size_t hash) const
+	{
+		return (hash >> 16) & _slotMask;
+	}
+
+	Node* Find(const KEY& k, size_t hash) const
+	{
+		for (size_t i = Home(hash);; i = (i + 1) & _slotMask)
+		{
+			const Slot& slot = _slots[i];
+			if (slot.node == nullptr)
+				return nullptr;
+			if (slot.hash == hash && _equal(slot.node->k, k))
+				return slot.node;
+		}
+	}
+
+	void Insert(Node* node)
+	{
+		if (static_cast<size_t>(_size) * 4 > _slots.size() * 3)
+			GrowTable(); // only when pinned handles keep the cache far above capacity
+		size_t i = Home(node->hash);
+		while (_slots[i].node != nullptr)
+			i = (i + 1) & _slotMask;
+		_slots[i] = Slot{ node->hash, node };
+	}
+
+	// backward shift deletion, keeps probe sequences intact without tombstones
+	void Erase(Node* node)
+	{
+		size_t i = Home(node->hash);
+		while (_slots[i].node != node)
+			i = (i + 1) & _slotMask;
+
+		for (size_t j = (i + 1) & _slotMask;; j = (j + 1) & _slotMask)
+		{
+			if (_slots[j].node == nullptr)
+				break;
+			const size_t home = Home(_slots[j].hash);
+			// move slot j back into the hole unless its home lies cyclically in (i, j]
+			const bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+			if (!stays)
+			{
+				_slots[i] = _slots[j];
+				i = j;
+			}
+		}
+		_slots[i] = Slot{ 0, nullptr };
+	}
+
+	void GrowTable()
+	{
+		std::pmr::vector<Slot> old(_slots.size() * 2, Slot{ 0, nullptr }, _resource);
+		old.swap(_slots);
+		_slotMask = _slots.size() - 1;
+		for (const Slot& slot : old)
+		{
+			if (slot.node == nullptr)
+				continue;
+			size_t i = Home(slot.hash);
+			while (_slots[i].node != nullptr)
+				i = (i + 1) & _slotMask;
+			_slots[i] = slot;
+		}
+	}
+
+	void* AllocateNode()
+	{
+		if (_freeNodes != nullptr)
+		{
+			NodeStorage* storage = _freeNodes;
+			_freeNodes = storage->nextFree;
+			return storage->bytes;
+		}
+		if (_chunkUsed == _chunkNodes)
+		{
+			AppendOwned(_chunks, [&] {
+				return static_cast<NodeStorage*>(_resource->allocate(_chunkNodes * sizeof(NodeStorage), alignof(NodeStorage)));
+			});
+			_chunkUsed = 0;
+		}
+		return _chunks.back()[_chunkUsed++].bytes;
+	}
+
+	void ReleaseStorage(void* bytes)
+	{
+		NodeStorage* storage = reinterpret_cast<NodeStorage*>(bytes);
+		storage->nextFree = _freeNodes;
+		_freeNodes = storage;
+	}
+
+	void FreeNode(Node* node)
+	{
+		if (node->expiryTimer != 0)
+			_expiryWheel->Cancel(TimerWheel::TimerHandle{ node->expiryTimer });
+		node->~Node();
+		ReleaseStorage(node);
+	}
+
+	void EvictNode(Node* node, bool linkedInPolicy)
+	{
+		_deleter(node->v);
+		if (linkedInPolicy)
+			_policy.Remove(node);
+		Erase(node);
+		_size--;
+		_weight -= node->weight;
+		FreeNode(node);
+	}
+
+	void ArmExpiry(Node* node, uint32_t ttlMs)
+	{
+		if (node->expiryTimer != 0)
+		{
+			_expiryWheel->Cancel(TimerWheel::TimerHandle{ node->expiryTimer });
+			node->expiryTimer = 0;
+		}
+		if (ttlMs > 0)
+			node->expiryTimer = _expiryWheel->ScheduleOnce(ttlMs, [this, node]() { OnNodeExpired(node); }).id;
+	}
+
+	// freed nodes cancel their timer, so 'node' is always alive here
+	void OnNodeExpired(Node* node)
+	{
+		node->expiryTimer = 0;
+		_expirations++;
+		if (node->refCount > 1)
+			node->expired = true; // dropped by OnNodeRefFreed
+		else
+			EvictNode(node, true);
+	}
+
 	void OnNodeRefered(Node* node)
 	{
-		auto it = _kvMap.find(node->k); assert(it != _kvMap.end());
-		assert(_kvMap.contains(node->k));
 		if (node->refCount == 1)
 		{
-			_nodesInUse.splice(_nodesInUse.end(), _nodesNotInUse, it->second);
+			_policy.Remove(node);
+			_nodesInUse.PushBack(node);
 		}
 		node->refCount++;
 	}
 
 	void OnNodeRefFreed(Node* node)
 	{
-		auto it = _kvMap.find(node->k); assert(it != _kvMap.end());
 		assert(node->refCount > 1);
 		node->refCount--;
 		if (node->refCount == 1)
 		{
-			_nodesNotInUse.splice(_nodesNotInUse.end(), _nodesInUse, it->second);
+			_nodesInUse.Remove(node);
+			if (node->expired)
+				EvictNode(node, false);
+			else
+				_policy.Reinsert(node);
 		}
 	}
 
 	void OnNewNodeGenerated()
 	{
-		while (_size > _cacheCapacity && !_nodesNotInUse.empty())
+		while (_weight > _cacheCapacity)
 		{
-			auto toRemove = _nodesNotInUse.begin();
-			auto key = toRemove->k;
-			_deleter(toRemove->v);
-			_nodesNotInUse.erase(toRemove);
-			_kvMap.erase(key);
-			_size--;
+			CacheLink* victim = _policy.Victim();
+			if (victim == nullptr)
+				break; // everything left is pinned
+			EvictNode(static_cast<Node*>(victim), true);
+			_evictions++;
 		}
 	}
-};
\ No newline at end of file
+};
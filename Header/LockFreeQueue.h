@@ -1,90 +1,194 @@
 #pragma once
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
 #include <vector>
+#include "Instrumentation.h"
+#include "PoolAllocator.h"
 
-template <typename T>
+// Unbounded Michael-Scott queue with hazard pointer reclamation.
+// Nodes come from SizeClassPool, so once the per-thread pool caches are warm Enqueue/Dequeue do not
+// reach the global heap. The element lives in raw storage inside the node: it is constructed by
+// Enqueue/Emplace and moved out and destroyed by the Dequeue that wins it, which makes move-only
+// element types work.
+// Hazard slots belong to threads, not to the queue: a thread takes a free record on first use and
+// gives it back when it exits, so kMaxThreads bounds the threads using the queue at the same time,
+// not over the lifetime of the process.
+// Allocator (rebound to the node type) replaces SizeClassPool. It has to be stateless: retired nodes
+// are freed by whichever thread scans next, possibly after the queue is gone, so there is no queue
+// instance to take an allocator object or a memory_resource from.
+template <typename T, typename Allocator = PoolAllocator<T>>
 class LockFreeQueue
 {
 private:
     struct Node
     {
-        T data;
-        std::atomic<Node*> next;
-        Node() : next(nullptr) {}
-        Node(const T& val) : data(val), next(nullptr) {}
+        std::atomic<Node*> next{ nullptr };
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* Value() { return std::launder(reinterpret_cast<T*>(storage)); }
     };
 
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    static_assert(std::allocator_traits<NodeAllocator>::is_always_equal::value,
+        "LockFreeQueue: the allocator must be stateless, nodes are freed without the queue");
+
     static constexpr int kHazardSlotsPerThread = 2;
     static constexpr int kMaxThreads = 64;
     static constexpr int kMaxHazardPointers = kHazardSlotsPerThread * kMaxThreads;
-    static constexpr int kRetireThreshold = 64;
+    static constexpr size_t kRetireThreshold = 64;
 
-    static inline std::atomic<Node*> _hazards[kMaxHazardPointers]{};
-    static inline std::atomic<int> _hazardThreadCount{0};
+    struct alignas(64) HazardRecord
+    {
+        std::atomic<Node*> slots[kHazardSlotsPerThread]{};
+        std::atomic<bool> inUse{ false };
+    };
 
-    static int ThreadIndex()
+    // per-thread: the hazard record it owns and the nodes it retired but could not free yet
+    struct ThreadState
     {
-        static thread_local int index = -1;
-        if (index < 0)
+        HazardRecord* record = nullptr;
+        std::vector<Node*> retired;
+
+        ThreadState()
+        {
+            // the allocator's thread cache (SizeClassPool's by default) has to outlive this object, whose
+            // destructor still frees nodes; thread_locals are destroyed in reverse order of construction,
+            // so touch it first
+            NodeAllocator().deallocate(NodeAllocator().allocate(1), 1);
+            record = AcquireRecord();
+            retired.reserve(kRetireThreshold);
+        }
+
+        ~ThreadState()
         {
-            index = _hazardThreadCount.fetch_add(1, std::memory_order_relaxed);
-            assert(index < kMaxThreads && "LockFreeQueue hazard pointers: too many threads");
+            for (auto& slot : record->slots)
+            {
+                slot.store(nullptr, std::memory_order_release);
+            }
+            ScanAndReclaim(retired);
+            if (!retired.empty())
+            {
+                // still protected by another thread, whoever scans next takes them over
+                std::lock_guard<std::mutex> lock(_orphanMutex);
+                _orphans.insert(_orphans.end(), retired.begin(), retired.end());
+                _hasOrphans.store(true, std::memory_order_release);
+            }
+            record->inUse.store(false, std::memory_order_release);
+        }
+    };
+
+    static inline HazardRecord _records[kMaxThreads]{};
+    static inline std::atomic<int> _recordHighWater{ 0 };
+    static inline std::mutex _orphanMutex;
+    static inline std::vector<Node*> _orphans;
+    static inline std::atomic<bool> _hasOrphans{ false };
+
+    static HazardRecord* AcquireRecord()
+    {
+        for (int i = 0; i < kMaxThreads; ++i)
+        {
+            bool expected = false;
+            if (!_records[i].inUse.load(std::memory_order_relaxed) &&
+                _records[i].inUse.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+            {
+                int highWater = _recordHighWater.load(std::memory_order_relaxed);
+                while (highWater < i + 1 &&
+                       !_recordHighWater.compare_exchange_weak(highWater, i + 1, std::memory_order_acq_rel))
+                {
+                }
+                return &_records[i];
+            }
         }
-        return index;
+        assert(false && "LockFreeQueue hazard pointers: too many threads");
+        std::terminate();
     }
 
-    static std::atomic<Node*>& HazardSlot(int slot)
+    static ThreadState& Local()
     {
-        const int index = ThreadIndex() * kHazardSlotsPerThread + slot;
-        return _hazards[index];
+        static thread_local ThreadState state;
+        return state;
     }
 
     static void SetHazard(int slot, Node* ptr)
     {
-        HazardSlot(slot).store(ptr, std::memory_order_release);
+        Local().record->slots[slot].store(ptr, std::memory_order_seq_cst);
     }
 
     static void ClearHazard(int slot)
     {
-        HazardSlot(slot).store(nullptr, std::memory_order_release);
+        Local().record->slots[slot].store(nullptr, std::memory_order_release);
     }
 
-    static std::vector<Node*>& RetiredList()
+    template <typename... Args>
+    static Node* NewNode(Args&&... args)
     {
-        static thread_local std::vector<Node*> retired;
-        return retired;
+        Node* node = ::new (NodeAllocator().allocate(1)) Node;
+        try
+        {
+            ::new (node->storage) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            FreeNode(node);
+            throw;
+        }
+        return node;
+    }
+
+    // the node's element is already gone (dummy nodes never hold one)
+    static void FreeNode(Node* node)
+    {
+        node->~Node();
+        NodeAllocator().deallocate(node, 1);
     }
 
+    // frees every retired node no hazard slot points at: one pass over the live records into a sorted
+    // snapshot, then a binary search per retired node
     static void ScanAndReclaim(std::vector<Node*>& retired)
     {
-        std::vector<Node*> hazards;
-        hazards.reserve(kMaxHazardPointers);
-        for (int i = 0; i < kMaxHazardPointers; ++i)
+        if (_hasOrphans.load(std::memory_order_acquire))
         {
-            Node* p = _hazards[i].load(std::memory_order_acquire);
-            if (p) hazards.push_back(p);
+            std::unique_lock<std::mutex> lock(_orphanMutex, std::try_to_lock);
+            if (lock.owns_lock())
+            {
+                retired.insert(retired.end(), _orphans.begin(), _orphans.end());
+                _orphans.clear();
+                _hasOrphans.store(false, std::memory_order_relaxed);
+            }
         }
 
-        size_t keep = 0;
-        for (Node* node : retired)
+        Node* hazards[kMaxHazardPointers];
+        int count = 0;
+        const int records = _recordHighWater.load(std::memory_order_acquire);
+        for (int i = 0; i < records; ++i)
         {
-            bool protectedNode = false;
-            for (Node* h : hazards)
+            for (auto& slot : _records[i].slots)
             {
-                if (h == node)
+                Node* p = slot.load(std::memory_order_seq_cst);
+                if (p)
                 {
-                    protectedNode = true;
-                    break;
+                    hazards[count++] = p;
                 }
             }
-            if (protectedNode)
+        }
+        std::sort(hazards, hazards + count);
+
+        size_t keep = 0;
+        for (Node* node : retired)
+        {
+            if (std::binary_search(hazards, hazards + count, node))
             {
                 retired[keep++] = node;
             }
             else
             {
-                delete node;
+                FreeNode(node);
             }
         }
         retired.resize(keep);
@@ -92,41 +196,17 @@ private:
 
     static void RetireNode(Node* node)
     {
-        auto& retired = RetiredList();
+        auto& retired = Local().retired;
         retired.push_back(node);
-        if (retired.size() >= kRetireThreshold)
+        // scanning only after retiring more nodes than there can be hazards keeps the cost amortized O(1)
+        if (retired.size() >= kRetireThreshold + static_cast<size_t>(kHazardSlotsPerThread * _recordHighWater.load(std::memory_order_relaxed)))
         {
             ScanAndReclaim(retired);
         }
     }
 
-    std::atomic<Node*> _head;
-    std::atomic<Node*> _tail;
-
-public:
-    LockFreeQueue()
+    void Link(Node* newNode)
     {
-        Node* dummy = new Node();
-        _head.store(dummy, std::memory_order_relaxed);
-        _tail.store(dummy, std::memory_order_relaxed);
-    }
-    
-    ~LockFreeQueue()
-    {
-        Node* current = _head.load(std::memory_order_relaxed);
-        while (current)
-        {
-            Node* next = current->next.load(std::memory_order_relaxed);
-            delete current;
-            current = next;
-        }
-        _head.store(nullptr, std::memory_order_relaxed);
-        _tail.store(nullptr, std::memory_order_relaxed);
-    }
-    
-    void Enqueue(const T& data)
-    {
-        Node* newNode = new Node(data);
         Node* oldTail = nullptr;
         while (1)
         {
@@ -153,6 +233,7 @@ public:
                         ClearHazard(0);
                         return;
                     }
+                    INSTRUMENT_COUNT(LockFreeQueueCasFailures);
                 }
                 else
                 {
@@ -164,7 +245,54 @@ public:
             }
         }
     }
-    
+
+    std::atomic<Node*> _head;
+    std::atomic<Node*> _tail;
+
+public:
+    LockFreeQueue()
+    {
+        Node* dummy = ::new (NodeAllocator().allocate(1)) Node;
+        _head.store(dummy, std::memory_order_relaxed);
+        _tail.store(dummy, std::memory_order_relaxed);
+    }
+
+    // no other thread may still use the queue
+    ~LockFreeQueue()
+    {
+        Node* current = _head.load(std::memory_order_relaxed);
+        Node* next = current->next.load(std::memory_order_relaxed);
+        FreeNode(current);
+        while (next)
+        {
+            current = next;
+            next = current->next.load(std::memory_order_relaxed);
+            current->Value()->~T();
+            FreeNode(current);
+        }
+        _head.store(nullptr, std::memory_order_relaxed);
+        _tail.store(nullptr, std::memory_order_relaxed);
+    }
+
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+    template <typename... Args>
+    void Emplace(Args&&... args)
+    {
+        Link(NewNode(std::forward<Args>(args)...));
+    }
+
+    void Enqueue(const T& data)
+    {
+        Emplace(data);
+    }
+
+    void Enqueue(T&& data)
+    {
+        Emplace(std::move(data));
+    }
+
     bool Dequeue(T& out)
     {
         while (1)
@@ -179,7 +307,7 @@ public:
 
             Node* headNext = currentHead->next.load(std::memory_order_acquire);
             SetHazard(1, headNext);
-            
+
             if (currentHead == _head.load(std::memory_order_acquire))
             {
                 if (currentHead == currentTail)
@@ -188,6 +316,7 @@ public:
                     {
                         ClearHazard(1);
                         ClearHazard(0);
+                        INSTRUMENT_COUNT(LockFreeQueueEmpty);
                         return false;
                     }
                     _tail.compare_exchange_weak(
@@ -202,12 +331,16 @@ public:
                             std::memory_order_acq_rel,
                             std::memory_order_relaxed))
                     {
-                        out = headNext->data;
+                        // headNext is the new dummy, its element belongs to whoever won the CAS
+                        T* value = headNext->Value();
+                        out = std::move(*value);
+                        value->~T();
                         ClearHazard(1);
                         ClearHazard(0);
                         RetireNode(currentHead);
                         return true;
                     }
+                    INSTRUMENT_COUNT(LockFreeQueueCasFailures);
                 }
             }
         }
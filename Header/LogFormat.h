@@ -0,0 +1,415 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Deferred formatting and binary log layout shared by Logger and Tools/LogDecoder.
+// LOG_*_FMT call sites serialize their arguments with a type tag instead of formatting them;
+// the worker thread (or the offline decoder) turns the tagged blob back into text.
+class LogFormat
+{
+public:
+    enum class ArgType : uint8_t
+    {
+        Bool = 1,
+        Char = 2,
+        Int64 = 3,
+        UInt64 = 4,
+        Double = 5,
+        String = 6,
+        Pointer = 7,
+        Float = 8
+    };
+
+    static constexpr size_t kMaxArgs = 16;
+
+    struct ArgValue
+    {
+        ArgType type = ArgType::Int64;
+        union
+        {
+            bool b;
+            char c;
+            int64_t i;
+            uint64_t u;
+            double d;
+            float f;
+        };
+        std::string_view s{};
+
+        ArgValue() : i(0) {}
+    };
+
+    // ---- encoding (producer side) ----
+
+    template<typename T>
+    static constexpr ArgType TypeOf()
+    {
+        using U = std::remove_cvref_t<T>;
+        if constexpr (std::is_same_v<U, bool>)
+            return ArgType::Bool;
+        else if constexpr (std::is_same_v<U, char>)
+            return ArgType::Char;
+        else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+            return ArgType::Int64;
+        else if constexpr (std::is_integral_v<U>)
+            return ArgType::UInt64;
+        else if constexpr (std::is_same_v<U, float>)
+            return ArgType::Float; // formatted as float, widening would print 1.1f as 1.100000023841858
+        else if constexpr (std::is_floating_point_v<U>)
+            return ArgType::Double;
+        else if constexpr (std::is_convertible_v<const U&, std::string_view>)
+            return ArgType::String;
+        else if constexpr (std::is_pointer_v<U> || std::is_null_pointer_v<U>)
+            return ArgType::Pointer;
+        else
+            static_assert(sizeof(U) == 0, "LogFormat: argument type not supported by deferred formatting, format it on the call site");
+    }
+
+    template<typename... Args>
+    static size_t EncodedSize(const Args&... args)
+    {
+        return (size_t(0) + ... + EncodedSizeOne(args));
+    }
+
+    // 'out' must hold EncodedSize(args...) bytes
+    template<typename... Args>
+    static void Encode(char* out, const Args&... args)
+    {
+        ((out = EncodeOne(out, args)), ...);
+    }
+
+    // ---- decoding / formatting (worker or decoder side) ----
+
+    // returns the number of arguments, or kMaxArgs + 1 if the blob is malformed
+    static size_t Decode(std::string_view blob, ArgValue* out, size_t maxArgs)
+    {
+        size_t count = 0;
+        size_t pos = 0;
+        while (pos < blob.size())
+        {
+            if (count == maxArgs)
+                return kMaxArgs + 1;
+
+            ArgValue& value = out[count];
+            value.type = static_cast<ArgType>(blob[pos++]);
+            const size_t left = blob.size() - pos;
+            switch (value.type)
+            {
+            case ArgType::Bool:
+                if (left < 1) return kMaxArgs + 1;
+                value.b = blob[pos] != 0;
+                pos += 1;
+                break;
+            case ArgType::Char:
+                if (left < 1) return kMaxArgs + 1;
+                value.c = blob[pos];
+                pos += 1;
+                break;
+            case ArgType::Float:
+                if (left < 4) return kMaxArgs + 1;
+                std::memcpy(&value.f, blob.data() + pos, 4);
+                pos += 4;
+                break;
+            case ArgType::Int64:
+            case ArgType::UInt64:
+            case ArgType::Double:
+            case ArgType::Pointer:
+                if (left < 8) return kMaxArgs + 1;
+                std::memcpy(&value.u, blob.data() + pos, 8);
+                pos += 8;
+                break;
+            case ArgType::String:
+            {
+                if (left < 4) return kMaxArgs + 1;
+                uint32_t size = 0;
+                std::memcpy(&size, blob.data() + pos, 4);
+                pos += 4;
+                if (blob.size() - pos < size) return kMaxArgs + 1;
+                value.s = blob.substr(pos, size);
+                pos += size;
+                break;
+            }
+            default:
+                return kMaxArgs + 1;
+            }
+            count++;
+        }
+        return count;
+    }
+
+    // std::format replacement-field syntax ("{}", "{1}", "{:>8.3f}", "{{"), nested dynamic width/precision is not supported
+    static void FormatTo(std::string& out, std::string_view fmt, const ArgValue* args, size_t count)
+    {
+        size_t autoIndex = 0;
+        size_t i = 0;
+        while (i < fmt.size())
+        {
+            const char c = fmt[i];
+            if (c == '{')
+            {
+                if (i + 1 < fmt.size() && fmt[i + 1] == '{')
+                {
+                    out.push_back('{');
+                    i += 2;
+                    continue;
+                }
+
+                const size_t close = fmt.find('}', i + 1);
+                if (close == std::string_view::npos)
+                {
+                    out.append(fmt.substr(i));
+                    return;
+                }
+
+                const std::string_view field = fmt.substr(i + 1, close - i - 1);
+                const size_t colon = field.find(':');
+                const std::string_view indexPart = field.substr(0, colon);
+                const std::string_view spec = colon == std::string_view::npos ? std::string_view() : field.substr(colon + 1);
+
+                size_t index = 0;
+                if (indexPart.empty())
+                {
+                    index = autoIndex++;
+                }
+                else
+                {
+                    for (char digit : indexPart)
+                        index = index * 10 + static_cast<size_t>(digit - '0');
+                }
+
+                if (index < count)
+                    AppendArg(out, args[index], spec);
+                else
+                    out.append("{?}");
+                i = close + 1;
+            }
+            else if (c == '}')
+            {
+                out.push_back('}');
+                i += (i + 1 < fmt.size() && fmt[i + 1] == '}') ? 2 : 1;
+            }
+            else
+            {
+                size_t next = fmt.find_first_of("{}", i);
+                if (next == std::string_view::npos)
+                    next = fmt.size();
+                out.append(fmt.substr(i, next - i));
+                i = next;
+            }
+        }
+    }
+
+    static void FormatTo(std::string& out, std::string_view fmt, std::string_view blob)
+    {
+        ArgValue args[kMaxArgs];
+        const size_t count = Decode(blob, args, kMaxArgs);
+        if (count > kMaxArgs)
+        {
+            out.append("<malformed log arguments> ");
+            out.append(fmt);
+            return;
+        }
+        FormatTo(out, fmt, args, count);
+    }
+
+    static const char* LevelText(uint8_t level)
+    {
+        switch (level)
+        {
+        case 0:  return "TRACE";
+        case 1:  return "DEBUG";
+        case 2:  return "INFO";
+        case 3:  return "WARN";
+        case 4:  return "ERROR";
+        case 5:  return "FATAL";
+        default: return "UNKNOWN";
+        }
+    }
+
+    // ---- timestamps ----
+    // Records carry FILETIME ticks: 100 ns intervals since 1601-01-01 UTC.
+
+    static constexpr uint64_t kTicksPerMillisecond = 10000;
+    static constexpr uint64_t kTicksPerSecond = kTicksPerMillisecond * 1000;
+
+    struct CivilTime
+    {
+        int64_t year;
+        unsigned month, day, hour, minute, second, millisecond;
+    };
+
+    // UTC calendar date of a tick count, days-to-civil after H. Hinnant
+    static CivilTime TicksToCivil(uint64_t ticks)
+    {
+        constexpr int64_t kDaysFrom1601To1970 = 134774;
+
+        const uint64_t totalMs = ticks / kTicksPerMillisecond;
+        const int64_t days = static_cast<int64_t>(totalMs / 86400000ull) - kDaysFrom1601To1970;
+        const uint64_t msOfDay = totalMs % 86400000ull;
+
+        const int64_t z = days + 719468;
+        const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        const unsigned doe = static_cast<unsigned>(z - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        const unsigned day = doy - (153 * mp + 2) / 5 + 1;
+        const unsigned month = mp < 10 ? mp + 3 : mp - 9;
+        const int64_t year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2 ? 1 : 0);
+
+        return CivilTime{
+            year, month, day,
+            static_cast<unsigned>(msOfDay / 3600000),
+            static_cast<unsigned>(msOfDay / 60000 % 60),
+            static_cast<unsigned>(msOfDay / 1000 % 60),
+            static_cast<unsigned>(msOfDay % 1000) };
+    }
+
+    // ---- binary file layout ----
+    //
+    // file   := magic entry*
+    // entry  := 'S' u32 id u32 size bytes                                  (string table entry)
+    //         | 'R' u64 seq u64 timestamp u8 level u32 threadId i32 line
+    //               u32 fileId u32 formatId u32 payloadSize payload         (record)
+    // formatId 0 means the payload is plain message text, otherwise it is the encoded argument blob.
+    // Integers are little endian. String ids are only valid within the file that defined them.
+    static constexpr char kBinaryMagic[8] = { 'C', 'U', 'C', 'W', 'L', 'O', 'G', '1' };
+    static constexpr char kStringEntry = 'S';
+    static constexpr char kRecordEntry = 'R';
+
+    template<typename T>
+    static void AppendRaw(std::string& out, T value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+private:
+    template<typename T>
+    static size_t EncodedSizeOne(const T& value)
+    {
+        constexpr ArgType type = TypeOf<T>();
+        if constexpr (type == ArgType::Bool || type == ArgType::Char)
+            return 2;
+        else if constexpr (type == ArgType::Float)
+            return 1 + 4;
+        else if constexpr (type == ArgType::String)
+            return 1 + 4 + ToStringView(value).size();
+        else
+            return 1 + 8;
+    }
+
+    template<typename T>
+    static std::string_view ToStringView(const T& value)
+    {
+        using U = std::remove_cvref_t<T>;
+        if constexpr (std::is_pointer_v<U>)
+            return value == nullptr ? std::string_view("(null)") : std::string_view(value);
+        else
+            return std::string_view(value);
+    }
+
+    template<typename T>
+    static char* EncodeOne(char* out, const T& value)
+    {
+        constexpr ArgType type = TypeOf<T>();
+        *out++ = static_cast<char>(type);
+        if constexpr (type == ArgType::Bool)
+        {
+            *out++ = value ? 1 : 0;
+        }
+        else if constexpr (type == ArgType::Char)
+        {
+            *out++ = value;
+        }
+        else if constexpr (type == ArgType::Float)
+        {
+            std::memcpy(out, &value, 4);
+            out += 4;
+        }
+        else if constexpr (type == ArgType::String)
+        {
+            const std::string_view text = ToStringView(value);
+            const uint32_t size = static_cast<uint32_t>(text.size());
+            std::memcpy(out, &size, 4);
+            std::memcpy(out + 4, text.data(), text.size());
+            out += 4 + text.size();
+        }
+        else
+        {
+            uint64_t bits = 0;
+            if constexpr (type == ArgType::Double)
+            {
+                const double d = static_cast<double>(value);
+                std::memcpy(&bits, &d, 8);
+            }
+            else if constexpr (type == ArgType::Pointer)
+            {
+                bits = reinterpret_cast<uintptr_t>(static_cast<const void*>(value));
+            }
+            else
+            {
+                // sign-extended for Int64
+                const auto widened = static_cast<std::conditional_t<type == ArgType::Int64, int64_t, uint64_t>>(value);
+                std::memcpy(&bits, &widened, 8);
+            }
+            std::memcpy(out, &bits, 8);
+            out += 8;
+        }
+        return out;
+    }
+
+    template<typename T>
+    static void AppendValue(std::string& out, const T& value, std::string_view spec)
+    {
+        if (spec.empty())
+        {
+            std::format_to(std::back_inserter(out), "{}", value);
+            return;
+        }
+
+        std::string pattern;
+        pattern.reserve(spec.size() + 3);
+        pattern.append("{:").append(spec).push_back('}');
+        try
+        {
+            std::vformat_to(std::back_inserter(out), pattern, std::make_format_args(value));
+        }
+        catch (const std::format_error&)
+        {
+            out.append("{!}");
+        }
+    }
+
+    static void AppendArg(std::string& out, const ArgValue& arg, std::string_view spec)
+    {
+        switch (arg.type)
+        {
+        case ArgType::Bool:    AppendValue(out, arg.b, spec); break;
+        case ArgType::Char:    AppendValue(out, arg.c, spec); break;
+        case ArgType::Int64:   AppendValue(out, arg.i, spec); break;
+        case ArgType::UInt64:  AppendValue(out, arg.u, spec); break;
+        case ArgType::Double:  AppendValue(out, arg.d, spec); break;
+        case ArgType::Float:   AppendValue(out, arg.f, spec); break;
+        case ArgType::String:  AppendValue(out, arg.s, spec); break;
+        case ArgType::Pointer:
+        {
+            const void* p = reinterpret_cast<const void*>(static_cast<uintptr_t>(arg.u));
+            AppendValue(out, p, spec);
+            break;
+        }
+        default:
+            out.append("{?}");
+            break;
+        }
+    }
+};
@@ -1,23 +1,32 @@
 #pragma once
 
-#ifndef NOMINMAX
-#define NOMINMAX
-#endif
-#include <Windows.h>
-
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <format>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "Instrumentation.h"
+#include "LogFormat.h"
+#include "LoggerPlatform.h"
+#include "SPSCRingBuffer.h"
+#include "ThreadPool.h"
+#include "WaitableQueue.h"
+
 class Logger
 {
 public:
@@ -31,10 +40,41 @@ public:
         Fatal = 5
     };
 
+    enum class ProducerMode : uint8_t
+    {
+        SharedBuffer = 0,       // every producer appends to one double buffer under _mutex
+        ThreadLocalBuffers = 1  // every producer thread owns an SPSC ring, the worker merges them by seq
+    };
+
+    // what a producer does when its thread-local ring is full (ThreadLocalBuffers only)
+    enum class FullPolicy : uint8_t
+    {
+        Block = 0,        // wake the worker and spin until there is room
+        Drop = 1,         // discard the record silently
+        DropAndCount = 2  // discard the record, count it and report the count in the log
+    };
+
+    enum class OutputFormat : uint8_t
+    {
+        Text = 0,   // human readable lines
+        Binary = 1  // compact LogFormat entries, decode with Tools/LogDecoder (file targets only)
+    };
+
     struct Config
     {
         Level minLevel = Level::Info;
         std::string targetFile{};
+        OutputFormat outputFormat = OutputFormat::Text;
+        ProducerMode producerMode = ProducerMode::SharedBuffer;
+        FullPolicy fullPolicy = FullPolicy::Block;
+        size_t threadBufferCapacity = kDefaultThreadBufferCapacity; // records per producer thread
+
+        // rotation of targetFile, checked by the worker before every batch; 0 disables either trigger
+        uint64_t rotateSizeBytes = 0;        // roll once the file reached this size
+        uint32_t rotateIntervalSeconds = 0;  // roll on UTC multiples of this interval, e.g. 3600 for hourly files
+        // called with the path of every rolled file on ThreadPool::Inst(), e.g. to compress or upload it;
+        // call Shutdown() before static destruction when this is set
+        std::function<void(const std::string& rolledPath)> onFileRolled{};
     };
 
     static Logger& Instance()
@@ -68,9 +108,13 @@ public:
         _activeBuffer.reserve(kInitialRecordReserve);
         _flushBuffer.reserve(kInitialRecordReserve);
         _activeBytes = 0;
+        _producerMode.store(_config.producerMode, std::memory_order_release);
+        _fullPolicy.store(_config.fullPolicy, std::memory_order_release);
+        _reportedDrops = _droppedRecords.load(std::memory_order_acquire);
         OpenTargetFileLocked();
 
         _running = true;
+        _isRunning.store(true, std::memory_order_release);
         _worker = std::thread(&Logger::WorkerLoop, this);
     }
 
@@ -84,11 +128,13 @@ public:
             }
 
             _running = false;
+            _isRunning.store(false, std::memory_order_release);
             TrySwapActiveToFlushLocked();
         }
 
-        _wakeUp.notify_one();
+        _wakeUp.NotifyOne();
         _spaceAvailable.notify_all();
+        _ringSpace.NotifyAll();
         if (_worker.joinable())
         {
             _worker.join();
@@ -117,32 +163,41 @@ public:
         }
 
         Record record;
-        record.seq = _nextSeq.fetch_add(1, std::memory_order_acq_rel);
-        record.level = level;
-        record.timestampUtc = QueryUtcFileTime();
-        record.threadId = ::GetCurrentThreadId();
-        record.file = (file == nullptr) ? "<unknown>" : file;
-        record.line = line;
+        FillRecordHeader(record, level, file, line);
         record.message.assign(message.data(), message.size());
-        const size_t recordBytes = EstimateRecordBytes(record);
-        bool needWake = false;
+        SubmitRecord(std::move(record), forceFlush);
+    }
+
+    // deferred variant: only the format string pointer and the tagged arguments are captured here,
+    // the text is produced on the worker thread (or never, with OutputFormat::Binary)
+    template<typename... Args>
+    void LogFmt(Level level, const char* file, int line, std::format_string<Args...> fmt, Args&&... args)
+    {
+        static_assert(sizeof...(Args) <= LogFormat::kMaxArgs, "Logger::LogFmt: too many arguments");
+        EnsureInitialized();
+        if (!ShouldLog(level))
         {
-            std::unique_lock<std::mutex> lock(_mutex);
-            needWake = EnqueueRecordLocked(lock, std::move(record), recordBytes);
-            if (!_running)
-            {
-                return;
-            }
+            return;
         }
 
-        if (needWake)
+        Record record;
+        FillRecordHeader(record, level, file, line);
+        const std::string_view format = fmt.get();
+        record.format = format.data();
+        record.formatSize = static_cast<uint32_t>(format.size());
+
+        const size_t argBytes = LogFormat::EncodedSize(args...);
+        if (argBytes <= kInlineArgBytes)
         {
-            _wakeUp.notify_one();
+            LogFormat::Encode(record.inlineArgs, args...);
+            record.inlineArgBytes = static_cast<uint16_t>(argBytes);
         }
-        if (forceFlush)
+        else
         {
-            Flush();
+            record.message.resize(argBytes);
+            LogFormat::Encode(record.message.data(), args...);
         }
+        SubmitRecord(std::move(record), false);
     }
 
     void Flush()
@@ -170,26 +225,58 @@ public:
             TrySwapActiveToFlushLocked();
         }
 
-        _wakeUp.notify_one();
+        _wakeUp.NotifyOne();
         std::unique_lock<std::mutex> lock(_mutex);
         _flushDone.wait(lock, [this, targetSeq]() { return !_running || _flushedSeq >= targetSeq; });
     }
 
+    // records discarded by FullPolicy::Drop / DropAndCount since the process started
+    [[nodiscard]] uint64_t DroppedRecordCount() const
+    {
+        return _droppedRecords.load(std::memory_order_acquire);
+    }
+
 private:
+    static constexpr size_t kInlineArgBytes = 48;
+
     struct Record
     {
         uint64_t seq = 0;
         Level level = Level::Info;
-        FILETIME timestampUtc{};
-        DWORD threadId = 0;
+        uint64_t timestamp = 0; // FILETIME ticks, UTC
+        uint32_t threadId = 0;
         const char* file = "<unknown>";
         int line = 0;
+        const char* format = nullptr; // set for LOG_*_FMT records, arguments are in inlineArgs or message
+        uint32_t formatSize = 0;
+        uint16_t inlineArgBytes = 0;
+        char inlineArgs[kInlineArgBytes];
         std::string message;
+
+        bool IsDeferred() const { return format != nullptr; }
+
+        std::string_view ArgBlob() const
+        {
+            return inlineArgBytes > 0 ? std::string_view(inlineArgs, inlineArgBytes) : std::string_view(message);
+        }
+    };
+
+    struct ProducerBuffer
+    {
+        explicit ProducerBuffer(size_t capacity) : records(capacity) {}
+
+        SPSCRingBuffer<Record> records;
+        // lowest seq the owning thread may still push, 0 while it holds none; stored before the seq is
+        // taken and cleared once the record is in the ring (or dropped), so the worker knows how far
+        // the records it drained are complete
+        std::atomic<uint64_t> pendingSeq{ 0 };
+        std::atomic<bool> retired{ false }; // owning thread exited, free once drained
     };
 
     static constexpr uint32_t kBufferTimeoutMs = 100;
     static constexpr size_t kBufferSizeBytes = 4096ull * 1024ull;
     static constexpr size_t kInitialRecordReserve = 1024;
+    static constexpr size_t kDefaultThreadBufferCapacity = 8192;
 
     Logger() = default;
 
@@ -199,62 +286,98 @@ private:
         Shutdown();
     }
 
-    static FILETIME QueryUtcFileTime()
+    static const char* LevelToText(Level level)
+    {
+        return LogFormat::LevelText(static_cast<uint8_t>(level));
+    }
+
+    // the seq is taken on submission
+    void FillRecordHeader(Record& record, Level level, const char* file, int line)
+    {
+        record.level = level;
+        record.timestamp = LoggerPlatform::NowTicks();
+        record.threadId = LoggerPlatform::CurrentThreadId();
+        record.file = (file == nullptr) ? "<unknown>" : file;
+        record.line = line;
+    }
+
+    void SubmitRecord(Record&& record, bool forceFlush)
     {
-        FILETIME fileTime{};
-        using PreciseClockFn = VOID(WINAPI*)(LPFILETIME);
-        static PreciseClockFn preciseFn = []() -> PreciseClockFn {
-            HMODULE module = ::GetModuleHandleW(L"kernel32.dll");
-            if (module == nullptr)
+        if (_producerMode.load(std::memory_order_acquire) == ProducerMode::ThreadLocalBuffers)
+        {
+            EnqueueThreadLocal(std::move(record));
+            if (forceFlush)
             {
-                return nullptr;
+                Flush();
             }
-            return reinterpret_cast<PreciseClockFn>(::GetProcAddress(module, "GetSystemTimePreciseAsFileTime"));
-        }();
+            return;
+        }
 
-        if (preciseFn != nullptr)
+        record.seq = _nextSeq.fetch_add(1, std::memory_order_acq_rel);
+        const size_t recordBytes = EstimateRecordBytes(record);
+        bool needWake = false;
         {
-            preciseFn(&fileTime);
+            std::unique_lock<std::mutex> lock(_mutex);
+            needWake = EnqueueRecordLocked(lock, std::move(record), recordBytes);
+            if (!_running)
+            {
+                return;
+            }
         }
-        else
+
+        if (needWake)
         {
-            ::GetSystemTimeAsFileTime(&fileTime);
+            _wakeUp.NotifyOne();
+        }
+        if (forceFlush)
+        {
+            Flush();
         }
-        return fileTime;
     }
 
-    static const char* LevelToText(Level level)
+    // "[YYYY-MM-DD HH:MM:SS." only changes once a second, so it is formatted once and reused (worker thread only)
+    void AppendTimestampPrefix(std::string& out, uint64_t ticks)
     {
-        switch (level)
+        const uint64_t second = ticks / LogFormat::kTicksPerSecond;
+        if (second != _cachedSecond)
         {
-        case Level::Trace: return "TRACE";
-        case Level::Debug: return "DEBUG";
-        case Level::Info:  return "INFO";
-        case Level::Warn:  return "WARN";
-        case Level::Error: return "ERROR";
-        case Level::Fatal: return "FATAL";
-        default:           return "UNKNOWN";
+            const LogFormat::CivilTime utc = LogFormat::TicksToCivil(second * LogFormat::kTicksPerSecond);
+            const auto result = std::format_to_n(
+                _cachedPrefix, sizeof(_cachedPrefix), "[{:04}-{:02}-{:02} {:02}:{:02}:{:02}.",
+                utc.year, utc.month, utc.day, utc.hour, utc.minute, utc.second);
+            _cachedPrefixSize = static_cast<size_t>(result.out - _cachedPrefix);
+            _cachedSecond = second;
         }
+        out.append(_cachedPrefix, _cachedPrefixSize);
+
+        const unsigned millis = static_cast<unsigned>((ticks / LogFormat::kTicksPerMillisecond) % 1000);
+        out.push_back(static_cast<char>('0' + millis / 100));
+        out.push_back(static_cast<char>('0' + millis / 10 % 10));
+        out.push_back(static_cast<char>('0' + millis % 10));
     }
 
-    std::string FormatRecord(const Record& record) const
+    // appends one text line to 'out', the batch buffer is reused so steady state does not allocate
+    void AppendFormattedRecord(std::string& out, const Record& record)
     {
-        SYSTEMTIME utc{};
-        ::FileTimeToSystemTime(&record.timestampUtc, &utc);
-        return std::format(
-            "[{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}] [{}] [T{}] [{}:{}] {}\n",
-            static_cast<unsigned>(utc.wYear),
-            static_cast<unsigned>(utc.wMonth),
-            static_cast<unsigned>(utc.wDay),
-            static_cast<unsigned>(utc.wHour),
-            static_cast<unsigned>(utc.wMinute),
-            static_cast<unsigned>(utc.wSecond),
-            static_cast<unsigned>(utc.wMilliseconds),
-            LevelToText(record.level),
-            static_cast<unsigned long>(record.threadId),
-            record.file,
-            record.line,
-            record.message);
+        AppendTimestampPrefix(out, record.timestamp);
+        out.append("] [");
+        out.append(LevelToText(record.level));
+        out.append("] [T");
+        std::format_to(std::back_inserter(out), "{}", record.threadId);
+        out.append("] [");
+        out.append(record.file);
+        out.push_back(':');
+        std::format_to(std::back_inserter(out), "{}", record.line);
+        out.append("] ");
+        if (record.IsDeferred())
+        {
+            LogFormat::FormatTo(out, std::string_view(record.format, record.formatSize), record.ArgBlob());
+        }
+        else
+        {
+            out.append(record.message);
+        }
+        out.push_back('\n');
     }
 
     static size_t EstimateRecordBytes(const Record& record)
@@ -284,7 +407,8 @@ private:
         bool needWake = false;
         while (_running && _pendingSwap && (_activeBytes + recordBytes > kBufferSizeBytes))
         {
-            _wakeUp.notify_one();
+            _wakeUp.NotifyOne();
+            INSTRUMENT_TIME_SCOPE(LogStallNs);
             _spaceAvailable.wait(lock, [this, recordBytes]() {
                 return !_running || !_pendingSwap || (_activeBytes + recordBytes <= kBufferSizeBytes);
             });
@@ -309,6 +433,163 @@ private:
         return needWake;
     }
 
+    ProducerBuffer* LocalProducerBuffer()
+    {
+        struct Registration
+        {
+            ProducerBuffer* buffer = nullptr;
+            ~Registration()
+            {
+                if (buffer != nullptr)
+                {
+                    buffer->retired.store(true, std::memory_order_release);
+                }
+            }
+        };
+
+        static thread_local Registration registration;
+        if (registration.buffer == nullptr)
+        {
+            size_t capacity = kDefaultThreadBufferCapacity;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                capacity = _config.threadBufferCapacity == 0 ? kDefaultThreadBufferCapacity : _config.threadBufferCapacity;
+            }
+            auto buffer = std::make_unique<ProducerBuffer>(capacity);
+            registration.buffer = buffer.get();
+            std::lock_guard<std::mutex> lock(_producersMutex);
+            _producers.emplace_back(std::move(buffer));
+        }
+        return registration.buffer;
+    }
+
+    // wait-free unless the ring is full and the policy is Block
+    void EnqueueThreadLocal(Record&& record)
+    {
+        ProducerBuffer* buffer = LocalProducerBuffer();
+        // the release of the fetch_add publishes the bound to whoever sees the seq in _nextSeq
+        buffer->pendingSeq.store(_nextSeq.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        record.seq = _nextSeq.fetch_add(1, std::memory_order_acq_rel);
+        while (!buffer->records.TryPush(std::move(record)))
+        {
+            switch (_fullPolicy.load(std::memory_order_relaxed))
+            {
+            case FullPolicy::Drop:
+                INSTRUMENT_COUNT(LogRecordsDropped);
+                buffer->pendingSeq.store(0, std::memory_order_release);
+                return;
+            case FullPolicy::DropAndCount:
+                INSTRUMENT_COUNT(LogRecordsDropped);
+                _droppedRecords.fetch_add(1, std::memory_order_relaxed);
+                buffer->pendingSeq.store(0, std::memory_order_release);
+                return;
+            case FullPolicy::Block:
+            default:
+            {
+                if (!_isRunning.load(std::memory_order_acquire))
+                {
+                    buffer->pendingSeq.store(0, std::memory_order_release);
+                    return;
+                }
+                WakeWorkerForProducers();
+                INSTRUMENT_TIME_SCOPE(LogStallNs);
+                const EventCount::Key key = _ringSpace.PrepareWait();
+                if (buffer->records.Full() && _isRunning.load(std::memory_order_acquire))
+                {
+                    _ringSpace.WaitFor(key, std::chrono::milliseconds(kBufferTimeoutMs));
+                }
+                else
+                {
+                    _ringSpace.CancelWait();
+                }
+                break;
+            }
+            }
+        }
+        buffer->pendingSeq.store(0, std::memory_order_release);
+
+        if (buffer->records.Size() * 2 >= buffer->records.Capacity())
+        {
+            WakeWorkerForProducers();
+        }
+    }
+
+    void WakeWorkerForProducers()
+    {
+        // no lock: the worker registers on _wakeUp before it checks _producerWake, so it cannot miss this
+        if (!_producerWake.exchange(true, std::memory_order_acq_rel))
+        {
+            _wakeUp.NotifyOne();
+        }
+    }
+
+    // moves the thread-local records that are ready into 'batch', in seq order, and frees the rings of
+    // exited threads. Returns how far the seqs are complete: every record up to it was written before,
+    // is in 'batch' or was dropped. A record past that point waits in _carryOver for the lower seqs
+    // still on their way, so the file stays in seq order across batches; 'stopping' writes it anyway.
+    // 'issuedUpto' has to be read from _nextSeq before the call; a seq taken later is not covered.
+    uint64_t DrainProducerBuffers(std::vector<Record>& batch, uint64_t issuedUpto, bool stopping)
+    {
+        std::lock_guard<std::mutex> lock(_producersMutex);
+        // a producer still pushing holds back its seq; whatever it pushed before is drained below
+        uint64_t completeUpto = issuedUpto;
+        for (const auto& producer : _producers)
+        {
+            const uint64_t pending = producer->pendingSeq.load(std::memory_order_acquire);
+            if (pending != 0 && pending - 1 < completeUpto)
+            {
+                completeUpto = pending - 1;
+            }
+        }
+
+        for (size_t i = 0; i < _producers.size();)
+        {
+            ProducerBuffer& producer = *_producers[i];
+            const bool retired = producer.retired.load(std::memory_order_acquire);
+            producer.records.TryPopBulk(std::back_inserter(batch), producer.records.Capacity());
+
+            if (retired)
+            {
+                _producers[i] = std::move(_producers.back());
+                _producers.pop_back();
+                continue;
+            }
+            ++i;
+        }
+
+        batch.insert(batch.end(), std::make_move_iterator(_carryOver.begin()), std::make_move_iterator(_carryOver.end()));
+        _carryOver.clear();
+        std::sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) { return a.seq < b.seq; });
+        if (!stopping)
+        {
+            const auto ready = std::partition_point(batch.begin(), batch.end(),
+                [completeUpto](const Record& record) { return record.seq <= completeUpto; });
+            _carryOver.insert(_carryOver.end(), std::make_move_iterator(ready), std::make_move_iterator(batch.end()));
+            batch.erase(ready, batch.end());
+        }
+        return completeUpto;
+    }
+
+    void AppendDropReport(std::vector<Record>& batch)
+    {
+        const uint64_t dropped = _droppedRecords.load(std::memory_order_acquire);
+        if (dropped == _reportedDrops || _fullPolicy.load(std::memory_order_relaxed) != FullPolicy::DropAndCount)
+        {
+            return;
+        }
+
+        Record report;
+        report.seq = batch.empty() ? 0 : batch.back().seq;
+        report.level = Level::Warn;
+        report.timestamp = LoggerPlatform::NowTicks();
+        report.threadId = LoggerPlatform::CurrentThreadId();
+        report.file = "Logger";
+        report.line = 0;
+        report.message = std::format("dropped {} records, thread buffers were full", dropped - _reportedDrops);
+        batch.emplace_back(std::move(report));
+        _reportedDrops = dropped;
+    }
+
     void UpdateFlushStateLocked(uint64_t flushedUpto)
     {
         if (flushedUpto > _flushedSeq)
@@ -330,14 +611,31 @@ private:
         for (;;)
         {
             bool shouldExit = false;
+            bool stopping = false;
             uint64_t flushedUpto = 0;
+            uint64_t issuedUpto = 0;
+            // park until signalled; the timeout still bounds how long records below the wake-up thresholds wait
+            const EventCount::Key key = _wakeUp.PrepareWait();
+            bool hasWork = false;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                hasWork = !_running || _pendingSwap || _flushRequested || _producerWake.load(std::memory_order_acquire);
+            }
+            if (hasWork)
+            {
+                _wakeUp.CancelWait();
+            }
+            else
+            {
+                _wakeUp.WaitFor(key, std::chrono::milliseconds(kBufferTimeoutMs));
+            }
+
             {
                 std::unique_lock<std::mutex> lock(_mutex);
-                _wakeUp.wait_for(
-                    lock,
-                    std::chrono::milliseconds(kBufferTimeoutMs),
-                    [this]() { return !_running || _pendingSwap || _flushRequested; });
+                _producerWake.store(false, std::memory_order_release);
 
+                // thread-local records are drained after this point, up to what their producers finished pushing
+                issuedUpto = _nextSeq.load(std::memory_order_acquire) - 1;
                 TrySwapActiveToFlushLocked();
                 flushedUpto = _flushedSeq;
 
@@ -353,9 +651,23 @@ private:
                     localBatch.clear();
                 }
 
-                shouldExit = (!_running && localBatch.empty() && _activeBuffer.empty());
+                stopping = !_running;
+                shouldExit = (stopping && localBatch.empty() && _activeBuffer.empty());
             }
 
+            const bool threadLocal = _producerMode.load(std::memory_order_acquire) == ProducerMode::ThreadLocalBuffers;
+            if (threadLocal || stopping)
+            {
+                const uint64_t completeUpto = DrainProducerBuffers(localBatch, issuedUpto, stopping);
+                _ringSpace.NotifyAll();
+                if (threadLocal && flushedUpto < completeUpto)
+                {
+                    flushedUpto = completeUpto;
+                }
+            }
+            AppendDropReport(localBatch);
+            shouldExit = shouldExit && localBatch.empty();
+
             if (!localBatch.empty())
             {
                 WriteBatch(localBatch);
@@ -380,46 +692,159 @@ private:
 
     void WriteBatch(const std::vector<Record>& batch)
     {
-        if (_targetFile == nullptr)
+        if (_targetFile.IsOpen() && ShouldRotateTargetFile())
         {
-            for (const Record& record : batch)
-            {
-                std::cout << FormatRecord(record);
-            }
+            RotateTargetFile();
+        }
+
+        if (_targetFile.IsOpen() && _config.outputFormat == OutputFormat::Binary)
+        {
+            WriteBinaryBatch(batch);
+            return;
+        }
+
+        std::string& out = _batchBuffer;
+        out.clear();
+        for (const Record& record : batch)
+        {
+            AppendFormattedRecord(out, record);
+        }
+
+        // one write per batch instead of one per line
+        if (!_targetFile.IsOpen())
+        {
+            std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
             std::cout.flush();
             return;
         }
+        WriteToTargetFile(out.data(), out.size());
+    }
 
+    // returns the id of 'text' in the current file's string table, defining it first if needed
+    uint32_t InternBinaryString(const char* text, size_t size, std::string& out)
+    {
+        const std::string_view view(text, size);
+        auto it = _binaryStrings.find(text);
+        if (it != _binaryStrings.end() && it->second.text == view)
+        {
+            return it->second.id;
+        }
+
+        const uint32_t id = _nextBinaryStringId++;
+        out.push_back(LogFormat::kStringEntry);
+        LogFormat::AppendRaw<uint32_t>(out, id);
+        LogFormat::AppendRaw<uint32_t>(out, static_cast<uint32_t>(size));
+        out.append(view);
+        _binaryStrings[text] = BinaryString{ id, std::string(view) };
+        return id;
+    }
+
+    void WriteBinaryBatch(const std::vector<Record>& batch)
+    {
+        std::string& out = _batchBuffer;
+        out.clear();
         for (const Record& record : batch)
         {
-            const std::string line = FormatRecord(record);
-            std::fwrite(line.data(), 1, line.size(), _targetFile);
+            const uint32_t fileId = InternBinaryString(record.file, std::strlen(record.file), out);
+            const uint32_t formatId = record.IsDeferred() ? InternBinaryString(record.format, record.formatSize, out) : 0;
+            const std::string_view payload = record.IsDeferred() ? record.ArgBlob() : std::string_view(record.message);
+
+            out.push_back(LogFormat::kRecordEntry);
+            LogFormat::AppendRaw<uint64_t>(out, record.seq);
+            LogFormat::AppendRaw<uint64_t>(out, record.timestamp);
+            LogFormat::AppendRaw<uint8_t>(out, static_cast<uint8_t>(record.level));
+            LogFormat::AppendRaw<uint32_t>(out, record.threadId);
+            LogFormat::AppendRaw<int32_t>(out, record.line);
+            LogFormat::AppendRaw<uint32_t>(out, fileId);
+            LogFormat::AppendRaw<uint32_t>(out, formatId);
+            LogFormat::AppendRaw<uint32_t>(out, static_cast<uint32_t>(payload.size()));
+            out.append(payload);
         }
-        std::fflush(_targetFile);
+        WriteToTargetFile(out.data(), out.size());
     }
 
     void OpenTargetFileLocked()
     {
         CloseTargetFileLocked();
+        _binaryStrings.clear();
+        _nextBinaryStringId = 1;
         if (_config.targetFile.empty())
         {
             return;
         }
-        fopen_s(&_targetFile, _config.targetFile.c_str(), "ab");
+        if (_targetFile.Open(_config.targetFile) && _config.outputFormat == OutputFormat::Binary && _targetFile.Size() == 0)
+        {
+            _targetFile.Write(LogFormat::kBinaryMagic, sizeof(LogFormat::kBinaryMagic));
+        }
+        _targetFileBytes = _targetFile.IsOpen() ? static_cast<uint64_t>(std::max<int64_t>(_targetFile.Size(), 0)) : 0;
+        _rotateDeadline = 0;
+        if (_config.rotateIntervalSeconds > 0)
+        {
+            const uint64_t interval = _config.rotateIntervalSeconds * LogFormat::kTicksPerSecond;
+            _rotateDeadline = (LoggerPlatform::NowTicks() / interval + 1) * interval;
+        }
     }
 
-    void CloseTargetFileLocked()
+    void WriteToTargetFile(const char* data, size_t size)
+    {
+        _targetFile.Write(data, size);
+        _targetFile.Flush();
+        _targetFileBytes += size;
+    }
+
+    bool ShouldRotateTargetFile() const
     {
-        if (_targetFile != nullptr)
+        if (_config.rotateSizeBytes > 0 && _targetFileBytes >= _config.rotateSizeBytes)
         {
-            std::fflush(_targetFile);
-            std::fclose(_targetFile);
-            _targetFile = nullptr;
+            return true;
         }
+        return _rotateDeadline != 0 && LoggerPlatform::NowTicks() >= _rotateDeadline;
+    }
+
+    // "<target>.<YYYYMMDD-HHMMSS>", with a counter appended if several files roll within one second
+    std::string MakeRolledFileName() const
+    {
+        const LogFormat::CivilTime utc = LogFormat::TicksToCivil(LoggerPlatform::NowTicks());
+        const std::string base = std::format("{}.{:04}{:02}{:02}-{:02}{:02}{:02}",
+            _config.targetFile, utc.year, utc.month, utc.day, utc.hour, utc.minute, utc.second);
+
+        std::error_code error;
+        std::string name = base;
+        for (unsigned suffix = 1; std::filesystem::exists(name, error); suffix++)
+        {
+            name = std::format("{}.{}", base, suffix);
+        }
+        return name;
+    }
+
+    // worker thread only: the sink is owned by the worker while it runs, so no lock is needed.
+    // Only the rename happens here, anything slow is left to onFileRolled on the thread pool.
+    void RotateTargetFile()
+    {
+        CloseTargetFileLocked();
+        const std::string rolledName = MakeRolledFileName();
+        std::error_code error;
+        std::filesystem::rename(_config.targetFile, rolledName, error);
+        OpenTargetFileLocked();
+
+        if (!error && _config.onFileRolled)
+        {
+            ThreadPool::Inst().Post([callback = _config.onFileRolled, rolledName]() { callback(rolledName); });
+        }
+    }
+
+    void CloseTargetFileLocked()
+    {
+        _targetFile.Close();
     }
 
     void EnsureInitialized()
     {
+        if (_isRunning.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
         bool needInit = false;
         {
             std::lock_guard<std::mutex> lock(_mutex);
@@ -433,7 +858,8 @@ private:
 
 private:
     mutable std::mutex _mutex;
-    std::condition_variable _wakeUp;
+    EventCount _wakeUp;       // worker parks here, producers signal it without _mutex
+    EventCount _ringSpace;    // FullPolicy::Block producers wait here for their thread-local ring to drain
     std::condition_variable _flushDone;
     std::condition_variable _spaceAvailable;
     std::thread _worker;
@@ -445,12 +871,38 @@ private:
     uint64_t _flushedSeq = 0;
 
     Config _config{};
+    std::atomic<bool> _isRunning{ false };
     std::atomic<Level> _minLevel{ Level::Info };
     std::atomic<uint64_t> _nextSeq{ 1 };
     std::vector<Record> _activeBuffer;
     std::vector<Record> _flushBuffer;
     size_t _activeBytes = 0;
-    FILE* _targetFile = nullptr;
+    LoggerPlatform::FileSink _targetFile;
+
+    std::atomic<ProducerMode> _producerMode{ ProducerMode::SharedBuffer };
+    std::atomic<FullPolicy> _fullPolicy{ FullPolicy::Block };
+    std::atomic<bool> _producerWake{ false };
+    std::atomic<uint64_t> _droppedRecords{ 0 };
+    uint64_t _reportedDrops = 0; // worker thread only
+    std::mutex _producersMutex;
+    std::vector<std::unique_ptr<ProducerBuffer>> _producers;
+    std::vector<Record> _carryOver; // worker thread only, drained records whose lower seqs are not all in yet
+
+    struct BinaryString
+    {
+        uint32_t id = 0;
+        std::string text; // content check, 'file' pointers are not guaranteed to be literals
+    };
+
+    // worker thread only
+    std::unordered_map<const char*, BinaryString> _binaryStrings;
+    uint32_t _nextBinaryStringId = 1;
+    std::string _batchBuffer;
+    uint64_t _targetFileBytes = 0;
+    uint64_t _rotateDeadline = 0; // FILETIME ticks, 0 when time based rotation is off
+    uint64_t _cachedSecond = UINT64_MAX;
+    char _cachedPrefix[32]{};
+    size_t _cachedPrefixSize = 0;
 };
 
 #define LOG_TRACE(msg) ::Logger::Instance().Log(::Logger::Level::Trace, __FILE__, __LINE__, (msg))
@@ -462,3 +914,11 @@ private:
 #define LOG_ERROR_FLUSH(msg) ::Logger::Instance().Log(::Logger::Level::Error, __FILE__, __LINE__, (msg), true)
 #define LOG_FATAL_FLUSH(msg) ::Logger::Instance().Log(::Logger::Level::Fatal, __FILE__, __LINE__, (msg), true)
 #define LOG_FLUSH() ::Logger::Instance().Flush()
+
+// deferred formatting: LOG_INFO_FMT("{} took {:.2f} ms", name, ms), arguments are formatted on the worker
+#define LOG_TRACE_FMT(...) ::Logger::Instance().LogFmt(::Logger::Level::Trace, __FILE__, __LINE__, __VA_ARGS__)
+#define LOG_DEBUG_FMT(...) ::Logger::Instance().LogFmt(::Logger::Level::Debug, __FILE__, __LINE__, __VA_ARGS__)
+#define LOG_INFO_FMT(...)  ::Logger::Instance().LogFmt(::Logger::Level::Info,  __FILE__, __LINE__, __VA_ARGS__)
+#define LOG_WARN_FMT(...)  ::Logger::Instance().LogFmt(::Logger::Level::Warn,  __FILE__, __LINE__, __VA_ARGS__)
+#define LOG_ERROR_FMT(...) ::Logger::Instance().LogFmt(::Logger::Level::Error, __FILE__, __LINE__, __VA_ARGS__)
+#define LOG_FATAL_FMT(...) ::Logger::Instance().LogFmt(::Logger::Level::Fatal, __FILE__, __LINE__, __VA_ARGS__)
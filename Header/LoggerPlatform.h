@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// The only OS-specific parts of Logger: wall clock, thread id and the file sink.
+// Timestamps are FILETIME ticks (100 ns since 1601-01-01 UTC) on every platform, which is what the
+// binary log layout stores, so files written on Linux and Windows decode the same way.
+//
+// On Linux the clock defaults to CLOCK_REALTIME_COARSE (a vDSO read of the last tick, ~1-4 ms
+// resolution). Define LOGGER_PRECISE_CLOCK to use CLOCK_REALTIME when sub-millisecond stamps matter.
+namespace LoggerPlatform
+{
+    // seconds between 1601-01-01 and 1970-01-01
+    inline constexpr uint64_t kUnixEpochSeconds = 11644473600ull;
+
+    inline uint64_t NowTicks()
+    {
+#if defined(_WIN32)
+        using PreciseClockFn = VOID(WINAPI*)(LPFILETIME);
+        static PreciseClockFn preciseFn = []() -> PreciseClockFn {
+            HMODULE module = ::GetModuleHandleW(L"kernel32.dll");
+            if (module == nullptr)
+            {
+                return nullptr;
+            }
+            return reinterpret_cast<PreciseClockFn>(::GetProcAddress(module, "GetSystemTimePreciseAsFileTime"));
+        }();
+
+        FILETIME fileTime{};
+        if (preciseFn != nullptr)
+        {
+            preciseFn(&fileTime);
+        }
+        else
+        {
+            ::GetSystemTimeAsFileTime(&fileTime);
+        }
+        return (static_cast<uint64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+#else
+#if defined(LOGGER_PRECISE_CLOCK) || !defined(CLOCK_REALTIME_COARSE)
+        constexpr clockid_t kClock = CLOCK_REALTIME;
+#else
+        constexpr clockid_t kClock = CLOCK_REALTIME_COARSE;
+#endif
+        timespec now{};
+        ::clock_gettime(kClock, &now);
+        return (static_cast<uint64_t>(now.tv_sec) + kUnixEpochSeconds) * 10000000ull +
+            static_cast<uint64_t>(now.tv_nsec) / 100;
+#endif
+    }
+
+    inline uint32_t CurrentThreadId()
+    {
+#if defined(_WIN32)
+        return static_cast<uint32_t>(::GetCurrentThreadId());
+#else
+        // gettid is a real syscall, cache it per thread
+        static thread_local const uint32_t id = static_cast<uint32_t>(::syscall(SYS_gettid));
+        return id;
+#endif
+    }
+
+    // append-only log file; Write is blocking and writes everything it is given
+    class FileSink
+    {
+    public:
+        FileSink() = default;
+        FileSink(const FileSink&) = delete;
+        FileSink& operator= (const FileSink&) = delete;
+        ~FileSink() { Close(); }
+
+        bool Open(const std::string& path)
+        {
+            Close();
+#if defined(_WIN32)
+            fopen_s(&_file, path.c_str(), "ab");
+            return _file != nullptr;
+#else
+            do
+            {
+                _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            } while (_fd < 0 && errno == EINTR);
+            return _fd >= 0;
+#endif
+        }
+
+        bool IsOpen() const
+        {
+#if defined(_WIN32)
+            return _file != nullptr;
+#else
+            return _fd >= 0;
+#endif
+        }
+
+        // current file size, -1 if it is not open
+        int64_t Size() const
+        {
+#if defined(_WIN32)
+            if (_file == nullptr)
+            {
+                return -1;
+            }
+            std::fflush(_file);
+            struct _stat64 info{};
+            return _fstat64(_fileno(_file), &info) == 0 ? static_cast<int64_t>(info.st_size) : -1;
+#else
+            struct stat info{};
+            return (_fd >= 0 && ::fstat(_fd, &info) == 0) ? static_cast<int64_t>(info.st_size) : -1;
+#endif
+        }
+
+        void Write(const char* data, size_t size)
+        {
+#if defined(_WIN32)
+            if (_file != nullptr)
+            {
+                std::fwrite(data, 1, size, _file);
+            }
+#else
+            while (_fd >= 0 && size > 0)
+            {
+                const ssize_t written = ::write(_fd, data, size);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return; // nothing sensible to report from the logger's own sink
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+#endif
+        }
+
+        // hands buffered bytes to the OS, no fsync
+        void Flush()
+        {
+#if defined(_WIN32)
+            if (_file != nullptr)
+            {
+                std::fflush(_file);
+            }
+#endif
+        }
+
+        void Close()
+        {
+#if defined(_WIN32)
+            if (_file != nullptr)
+            {
+                std::fflush(_file);
+                std::fclose(_file);
+                _file = nullptr;
+            }
+#else
+            if (_fd >= 0)
+            {
+                ::close(_fd);
+                _fd = -1;
+            }
+#endif
+        }
+
+    private:
+#if defined(_WIN32)
+        FILE* _file = nullptr;
+#else
+        int _fd = -1;
+#endif
+    };
+}
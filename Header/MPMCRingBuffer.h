@@ -8,26 +8,66 @@
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
+#include "Instrumentation.h"
 
-template <typename T>
+// Bounded multi producer / multi consumer ring (Vyukov): every slot carries a sequence number that
+// tells producers and consumers of a given lap whether the slot is theirs.
+// HighThroughput rounds the capacity up to a power of two so a position maps to its slot with a mask
+// instead of a division, and pads every slot to its own cache line so threads working on neighbouring
+// slots do not false-share the sequence words. Capacity() then reports the rounded value.
+template <typename T, bool HighThroughput = false>
 class MPMCRingBuffer
 {
 private:
     using StorageType = std::aligned_storage_t<sizeof(T), alignof(T)>;
 
-    struct Slot
+    static constexpr std::size_t kSlotAlignment = HighThroughput
+        ? (alignof(StorageType) > 64 ? alignof(StorageType) : 64)
+        : (alignof(StorageType) > alignof(std::atomic<std::size_t>) ? alignof(StorageType) : alignof(std::atomic<std::size_t>));
+
+    struct alignas(kSlotAlignment) Slot
     {
         std::atomic<std::size_t> sequence;
         StorageType storage;
     };
 
     const std::size_t _capacity;
+    const std::size_t _mask;
     std::unique_ptr<Slot[]> _buffer;
 
     alignas(64) std::atomic<std::size_t> _enqueuePos;
     alignas(64) std::atomic<std::size_t> _dequeuePos;
 
 private:
+    static std::size_t SlotCount(std::size_t capacity)
+    {
+        if constexpr (HighThroughput)
+        {
+            std::size_t size = 1;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+            return size;
+        }
+        else
+        {
+            return capacity;
+        }
+    }
+
+    Slot& SlotAt(std::size_t pos)
+    {
+        if constexpr (HighThroughput)
+        {
+            return _buffer[pos & _mask];
+        }
+        else
+        {
+            return _buffer[pos % _capacity];
+        }
+    }
+
     T* Element(Slot& slot)
     {
         return std::launder(reinterpret_cast<T*>(&slot.storage));
@@ -40,12 +80,13 @@ private:
 
 public:
     explicit MPMCRingBuffer(std::size_t capacity)
-        : _capacity(capacity),
+        : _capacity(SlotCount(capacity)),
+          _mask(_capacity - 1),
           _buffer(std::make_unique<Slot[]>(_capacity)),
           _enqueuePos(0),
           _dequeuePos(0)
     {
-        if (_capacity == 0)
+        if (capacity == 0)
         {
             throw std::invalid_argument("MPMCRingBuffer capacity must be greater than 0");
         }
@@ -63,7 +104,7 @@ public:
 
         while (pos != tail)
         {
-            Slot& slot = _buffer[pos % _capacity];
+            Slot& slot = SlotAt(pos);
             if (slot.sequence.load(std::memory_order_acquire) == pos + 1)
             {
                 Element(slot)->~T();
@@ -83,7 +124,7 @@ public:
         std::size_t pos = _enqueuePos.load(std::memory_order_relaxed);
         while (true)
         {
-            Slot& slot = _buffer[pos % _capacity];
+            Slot& slot = SlotAt(pos);
             const std::size_t seq = slot.sequence.load(std::memory_order_acquire);
             const std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
 
@@ -98,9 +139,11 @@ public:
                     slot.sequence.store(pos + 1, std::memory_order_release);
                     return true;
                 }
+                INSTRUMENT_COUNT(RingCasFailures);
             }
             else if (dif < 0)
             {
+                INSTRUMENT_COUNT(RingFullRetries);
                 return false;
             }
             else
@@ -125,7 +168,7 @@ public:
         std::size_t pos = _dequeuePos.load(std::memory_order_relaxed);
         while (true)
         {
-            Slot& slot = _buffer[pos % _capacity];
+            Slot& slot = SlotAt(pos);
             const std::size_t seq = slot.sequence.load(std::memory_order_acquire);
             const std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
 
@@ -142,9 +185,11 @@ public:
                     slot.sequence.store(pos + _capacity, std::memory_order_release);
                     return true;
                 }
+                INSTRUMENT_COUNT(RingCasFailures);
             }
             else if (dif < 0)
             {
+                INSTRUMENT_COUNT(RingEmptyRetries);
                 return false;
             }
             else
@@ -154,6 +199,122 @@ public:
         }
     }
 
+    // Claims up to 'count' consecutive slots with a single CAS on _enqueuePos and fills them from
+    // *first, *(first + 1), ... Only the run of slots that is free when the claim is made is taken, so the
+    // result may be less than 'count'; 0 means the ring is full. Every slot still publishes its own
+    // sequence, consumers pick up the elements in order as they are written.
+    // The element constructor must not throw: claimed slots cannot be handed back.
+    template <typename InputIt>
+    std::size_t TryPushBulk(InputIt first, std::size_t count)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        std::size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        std::size_t claimed = 0;
+        while (true)
+        {
+            const std::size_t seq = SlotAt(pos).sequence.load(std::memory_order_acquire);
+            const std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+            if (dif == 0)
+            {
+                claimed = 1;
+                while (claimed < count && claimed < _capacity &&
+                       SlotAt(pos + claimed).sequence.load(std::memory_order_acquire) == pos + claimed)
+                {
+                    ++claimed;
+                }
+
+                if (_enqueuePos.compare_exchange_weak(
+                        pos, pos + claimed,
+                        std::memory_order_relaxed,
+                        std::memory_order_relaxed))
+                {
+                    break;
+                }
+                INSTRUMENT_COUNT(RingCasFailures);
+            }
+            else if (dif < 0)
+            {
+                INSTRUMENT_COUNT(RingFullRetries);
+                return 0;
+            }
+            else
+            {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        for (std::size_t i = 0; i < claimed; ++i, ++first)
+        {
+            Slot& slot = SlotAt(pos + i);
+            new (&slot.storage) T(*first);
+            slot.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return claimed;
+    }
+
+    // Claims up to 'maxCount' consecutive published elements with a single CAS on _dequeuePos and moves
+    // them to 'out' (an output iterator, e.g. a pointer or std::back_inserter). Returns how many were popped.
+    template <typename OutputIt>
+    std::size_t TryPopBulk(OutputIt out, std::size_t maxCount)
+    {
+        if (maxCount == 0)
+        {
+            return 0;
+        }
+
+        std::size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        std::size_t claimed = 0;
+        while (true)
+        {
+            const std::size_t seq = SlotAt(pos).sequence.load(std::memory_order_acquire);
+            const std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+
+            if (dif == 0)
+            {
+                claimed = 1;
+                while (claimed < maxCount && claimed < _capacity &&
+                       SlotAt(pos + claimed).sequence.load(std::memory_order_acquire) == pos + claimed + 1)
+                {
+                    ++claimed;
+                }
+
+                if (_dequeuePos.compare_exchange_weak(
+                        pos, pos + claimed,
+                        std::memory_order_relaxed,
+                        std::memory_order_relaxed))
+                {
+                    break;
+                }
+                INSTRUMENT_COUNT(RingCasFailures);
+            }
+            else if (dif < 0)
+            {
+                INSTRUMENT_COUNT(RingEmptyRetries);
+                return 0;
+            }
+            else
+            {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        for (std::size_t i = 0; i < claimed; ++i)
+        {
+            Slot& slot = SlotAt(pos + i);
+            T* element = Element(slot);
+            *out = std::move(*element);
+            ++out;
+            element->~T();
+            slot.sequence.store(pos + i + _capacity, std::memory_order_release);
+        }
+        return claimed;
+    }
+
     bool Empty() const
     {
         return _enqueuePos.load(std::memory_order_acquire) == _dequeuePos.load(std::memory_order_acquire);
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+#include "AppendOwned.h"
+
+// Chunked storage for fixed-size nodes owned by one container. Nodes are carved from chunks that
+// double in size up to kMaxChunkNodes, so consecutively allocated nodes sit next to each other in
+// memory, and freed nodes are reused through a free list before a new chunk is carved.
+// The chunks come from a std::pmr::memory_resource, the default resource unless one is given, e.g.
+// a MonotonicArena (Arena.h) for request or frame scoped containers.
+// Not thread safe; every chunk is released together with the pool (or by Release).
+template<typename T>
+class NodePool
+{
+	union Storage
+	{
+		Storage* nextFree;
+		alignas(T) unsigned char bytes[sizeof(T)];
+	};
+
+	struct Chunk
+	{
+		Storage* nodes;
+		size_t count;
+	};
+
+	static constexpr size_t kMinChunkNodes = 16;
+	static constexpr size_t kMaxChunkNodes = 4096;
+
+	std::pmr::memory_resource* _resource;
+	std::vector<Chunk> _chunks;
+	size_t _chunkNodes = 0;
+	size_t _chunkUsed = 0;
+	Storage* _freeNodes = nullptr;
+
+	void NewChunk(size_t nodes)
+	{
+		AppendOwned(_chunks, [&] {
+			return Chunk{ static_cast<Storage*>(_resource->allocate(nodes * sizeof(Storage), alignof(Storage))), nodes };
+		});
+		_chunkNodes = nodes;
+		_chunkUsed = 0;
+	}
+
+public:
+	explicit NodePool(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+		_resource(resource) {}
+
+	~NodePool()
+	{
+		Release();
+	}
+
+	NodePool(const NodePool&) = delete;
+	NodePool& operator= (const NodePool&) = delete;
+
+	// the moved-from pool keeps its resource and starts over empty
+	NodePool(NodePool&& other) noexcept :
+		_resource(other._resource),
+		_chunks(std::move(other._chunks)),
+		_chunkNodes(std::exchange(other._chunkNodes, 0)),
+		_chunkUsed(std::exchange(other._chunkUsed, 0)),
+		_freeNodes(std::exchange(other._freeNodes, nullptr))
+	{
+		other._chunks.clear();
+	}
+
+	// takes over the chunks and the resource they came from
+	NodePool& operator= (NodePool&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Release();
+			_resource = other._resource;
+			_chunks = std::move(other._chunks);
+			other._chunks.clear();
+			_chunkNodes = std::exchange(other._chunkNodes, 0);
+			_chunkUsed = std::exchange(other._chunkUsed, 0);
+			_freeNodes = std::exchange(other._freeNodes, nullptr);
+		}
+		return *this;
+	}
+
+	std::pmr::memory_resource* Resource() const { return _resource; }
+
+	// raw storage for one T, construct it with placement new
+	void* Allocate()
+	{
+		if (_freeNodes != nullptr)
+		{
+			Storage* storage = _freeNodes;
+			_freeNodes = storage->nextFree;
+			return storage->bytes;
+		}
+		if (_chunkUsed == _chunkNodes)
+		{
+			const size_t next = _chunkNodes == 0 ? kMinChunkNodes : _chunkNodes * 2;
+			NewChunk(next > kMaxChunkNodes ? kMaxChunkNodes : next);
+		}
+		return _chunks.back().nodes[_chunkUsed++].bytes;
+	}
+
+	// the T must already be destroyed
+	void Deallocate(void* bytes)
+	{
+		Storage* storage = reinterpret_cast<Storage*>(bytes);
+		storage->nextFree = _freeNodes;
+		_freeNodes = storage;
+	}
+
+	// makes sure the current chunk has 'count' unused nodes, so that (with an empty free list) the next
+	// 'count' allocations are one contiguous run
+	void Reserve(size_t count)
+	{
+		if (_chunkNodes - _chunkUsed < count)
+			NewChunk(count < kMinChunkNodes ? kMinChunkNodes : count);
+	}
+
+	// frees every chunk at once; all nodes must already be destroyed
+	void Release()
+	{
+		for (const Chunk& chunk : _chunks)
+			_resource->deallocate(chunk.nodes, chunk.count * sizeof(Storage), alignof(Storage));
+		_chunks.clear();
+		_chunkNodes = 0;
+		_chunkUsed = 0;
+		_freeNodes = nullptr;
+	}
+};
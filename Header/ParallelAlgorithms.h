@@ -0,0 +1,227 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include "ThreadPool.h"
+
+// ParallelFor / ParallelReduce / ParallelSort on top of ThreadPool.
+// The calling thread always takes part in the work. Chunks are only ever claimed by threads that are
+// running, the caller included, so once the range is used up every claimed chunk is being worked on;
+// the caller may then park in WaitAll, but only on those running chunks, never on a task still
+// queued behind it. That makes these safe to call from inside a pool worker as well, nested or not.
+// Work is handed out with guided self-scheduling: every claim takes remaining / (2 * participants)
+// items (never less than the grain), big chunks first and smaller ones towards the end to even out
+// the tail.
+
+namespace ParallelDetail
+{
+	template<typename Index>
+	struct Job
+	{
+		Index begin;
+		Index end;
+		size_t minGrain;
+		size_t participants;
+		std::atomic<Index> next;
+		std::atomic<size_t> done{ 0 };
+		std::atomic<bool> failed{ false };
+		std::exception_ptr error{};
+		std::mutex errorMutex;
+
+		Job(Index b, Index e, size_t grain, size_t people) :
+			begin(b), end(e), minGrain(grain), participants(people), next(b) {}
+
+		size_t Total() const { return static_cast<size_t>(end - begin); }
+
+		// claims the next chunk, returns false once the range is exhausted
+		bool Claim(Index& chunkBegin, Index& chunkEnd)
+		{
+			Index cur = next.load(std::memory_order_relaxed);
+			while (cur < end)
+			{
+				const size_t remaining = static_cast<size_t>(end - cur);
+				size_t size = remaining / (2 * participants);
+				if (size < minGrain) size = minGrain;
+				if (size > remaining) size = remaining;
+				if (next.compare_exchange_weak(cur, cur + static_cast<Index>(size), std::memory_order_relaxed))
+				{
+					chunkBegin = cur;
+					chunkEnd = cur + static_cast<Index>(size);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void Fail()
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+				error = std::current_exception();
+			failed.store(true, std::memory_order_release);
+		}
+
+		void Complete(size_t count)
+		{
+			if (done.fetch_add(count, std::memory_order_acq_rel) + count == Total())
+				done.notify_all();
+		}
+
+		void WaitAll()
+		{
+			size_t seen = done.load(std::memory_order_acquire);
+			while (seen != Total())
+			{
+				done.wait(seen, std::memory_order_acquire);
+				seen = done.load(std::memory_order_acquire);
+			}
+		}
+	};
+
+	inline size_t DefaultGrain(size_t count, size_t participants)
+	{
+		// aim for ~8 claims per participant on the first pass, the guided split refines from there
+		const size_t grain = count / (participants * 8);
+		return grain == 0 ? 1 : grain;
+	}
+
+	// runs 'worker(job)' on the caller and on up to WorkerCount() pool threads, then waits for the range
+	template<typename Index, typename Worker>
+	void Run(ThreadPool& pool, Index begin, Index end, size_t grain, Worker&& worker)
+	{
+		const size_t count = static_cast<size_t>(end - begin);
+		const size_t participants = pool.WorkerCount() + 1;
+		if (grain == 0)
+			grain = DefaultGrain(count, participants);
+
+		auto job = std::make_shared<Job<Index>>(begin, end, grain, participants);
+		const size_t chunks = (count + grain - 1) / grain;
+		const size_t helpers = std::min(pool.WorkerCount(), chunks - 1);
+		for (size_t i = 0; i < helpers; i++)
+			pool.Post([job, worker]() mutable { worker(*job); });
+
+		worker(*job);
+		job->WaitAll();
+		if (job->error)
+			std::rethrow_exception(job->error);
+	}
+}
+
+template<std::integral Index, typename F> requires std::invocable<F&, Index>
+void ParallelFor(ThreadPool& pool, Index begin, Index end, F&& body, size_t grain = 0)
+{
+	if (end <= begin)
+		return;
+
+	auto worker = [&body](ParallelDetail::Job<Index>& job) {
+		Index chunkBegin{}, chunkEnd{};
+		while (job.Claim(chunkBegin, chunkEnd))
+		{
+			if (!job.failed.load(std::memory_order_acquire))
+			{
+				try {
+					for (Index i = chunkBegin; i < chunkEnd; ++i)
+						body(i);
+				} catch (...) {
+					job.Fail();
+				}
+			}
+			job.Complete(static_cast<size_t>(chunkEnd - chunkBegin));
+		}
+	};
+	ParallelDetail::Run(pool, begin, end, grain, worker);
+}
+
+template<std::integral Index, typename F> requires std::invocable<F&, Index>
+void ParallelFor(Index begin, Index end, F&& body, size_t grain = 0)
+{
+	ParallelFor(ThreadPool::Inst(), begin, end, std::forward<F>(body), grain);
+}
+
+// 'reduce' must be associative and commutative: partial results are combined in completion order
+template<std::integral Index, typename T, typename Map, typename Reduce>
+	requires std::invocable<Map&, Index> && std::invocable<Reduce&, T, T>
+T ParallelReduce(ThreadPool& pool, Index begin, Index end, T identity, Map&& map, Reduce&& reduce, size_t grain = 0)
+{
+	if (end <= begin)
+		return identity;
+
+	T result = identity;
+	std::mutex resultMutex;
+	auto worker = [&](ParallelDetail::Job<Index>& job) {
+		Index chunkBegin{}, chunkEnd{};
+		while (job.Claim(chunkBegin, chunkEnd))
+		{
+			if (!job.failed.load(std::memory_order_acquire))
+			{
+				try {
+					T local = identity;
+					for (Index i = chunkBegin; i < chunkEnd; ++i)
+						local = reduce(std::move(local), map(i));
+
+					// fold before the chunk is reported done, the caller reads 'result' right after the last one
+					std::lock_guard<std::mutex> lock(resultMutex);
+					result = reduce(std::move(result), std::move(local));
+				} catch (...) {
+					job.Fail();
+				}
+			}
+			job.Complete(static_cast<size_t>(chunkEnd - chunkBegin));
+		}
+	};
+	ParallelDetail::Run(pool, begin, end, grain, worker);
+	return result;
+}
+
+template<std::integral Index, typename T, typename Map, typename Reduce>
+	requires std::invocable<Map&, Index> && std::invocable<Reduce&, T, T>
+T ParallelReduce(Index begin, Index end, T identity, Map&& map, Reduce&& reduce, size_t grain = 0)
+{
+	return ParallelReduce(ThreadPool::Inst(), begin, end, std::move(identity),
+		std::forward<Map>(map), std::forward<Reduce>(reduce), grain);
+}
+
+// sorts runs in parallel, then merges neighbouring runs pairwise in parallel rounds; not stable
+template<std::random_access_iterator It, typename Compare = std::less<>>
+void ParallelSort(ThreadPool& pool, It first, It last, Compare comp = Compare())
+{
+	constexpr size_t kSerialCutoff = 4096;
+	const size_t count = static_cast<size_t>(std::distance(first, last));
+	const size_t participants = pool.WorkerCount() + 1;
+	if (count <= kSerialCutoff || participants == 1)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+
+	size_t runs = 1;
+	while (runs < participants * 2 && count / (runs * 2) >= kSerialCutoff)
+		runs *= 2;
+
+	auto runBegin = [&](size_t run) { return first + static_cast<std::ptrdiff_t>(count * run / runs); };
+	ParallelFor(pool, size_t(0), runs, [&](size_t run) {
+		std::sort(runBegin(run), runBegin(run + 1), comp);
+	}, 1);
+
+	for (size_t width = 1; width < runs; width *= 2)
+	{
+		ParallelFor(pool, size_t(0), runs / (width * 2), [&](size_t pair) {
+			const size_t left = pair * width * 2;
+			std::inplace_merge(runBegin(left), runBegin(left + width), runBegin(left + width * 2), comp);
+		}, 1);
+	}
+}
+
+template<std::random_access_iterator It, typename Compare = std::less<>>
+void ParallelSort(It first, It last, Compare comp = Compare())
+{
+	ParallelSort(ThreadPool::Inst(), first, last, std::move(comp));
+}
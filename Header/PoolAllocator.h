@@ -0,0 +1,196 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+// Size-class block pool backing hot-path allocations (task storage, promise states, ...).
+// Every thread keeps its own free lists and only touches the shared list to refill or spill a
+// whole batch, so steady-state Allocate/Deallocate pairs never reach the global heap and rarely
+// take a lock. Blocks may be freed on a different thread than the one that allocated them.
+// Memory handed out by the pool is kept for the lifetime of the process.
+class SizeClassPool
+{
+public:
+	static constexpr size_t kMinBlockSize = 16;
+	static constexpr size_t kMaxBlockSize = 2048;
+	static constexpr size_t kClassCount = 8; // 16, 32, ... 2048
+	static constexpr size_t kBlockAlignment = 16;
+
+	static void* Allocate(size_t bytes)
+	{
+		if (bytes > kMaxBlockSize)
+			return ::operator new(bytes);
+
+		const size_t cls = ClassIndex(bytes);
+		LocalClass& local = Local().classes[cls];
+		if (!local.head)
+			Refill(cls, local);
+
+		FreeBlock* block = local.head;
+		local.head = block->next;
+		local.count--;
+		return block;
+	}
+
+	static void Deallocate(void* p, size_t bytes)
+	{
+		if (!p)
+			return;
+		if (bytes > kMaxBlockSize)
+		{
+			::operator delete(p);
+			return;
+		}
+
+		const size_t cls = ClassIndex(bytes);
+		LocalClass& local = Local().classes[cls];
+		FreeBlock* block = static_cast<FreeBlock*>(p);
+		block->next = local.head;
+		local.head = block;
+		local.count++;
+		if (local.count >= kBatchSize * 2)
+			Spill(cls, local, kBatchSize);
+	}
+
+	static constexpr size_t BlockSize(size_t cls) { return kMinBlockSize << cls; }
+
+private:
+	static constexpr size_t kBatchSize = 32;
+	static constexpr size_t kChunkBytes = 64 * 1024;
+
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	struct LocalClass
+	{
+		FreeBlock* head = nullptr;
+		size_t count = 0;
+	};
+
+	struct SharedClass
+	{
+		std::mutex mutex;
+		FreeBlock* head = nullptr;
+		size_t count = 0;
+	};
+
+	struct LocalCache
+	{
+		LocalClass classes[kClassCount]{};
+
+		~LocalCache()
+		{
+			// hand everything back so blocks freed by short-lived threads are not lost
+			for (size_t cls = 0; cls < kClassCount; cls++)
+				Spill(cls, classes[cls], classes[cls].count);
+		}
+	};
+
+	static size_t ClassIndex(size_t bytes)
+	{
+		if (bytes <= kMinBlockSize)
+			return 0;
+		return static_cast<size_t>(std::bit_width(bytes - 1)) - 4;
+	}
+
+	static LocalCache& Local()
+	{
+		static thread_local LocalCache cache;
+		return cache;
+	}
+
+	static SharedClass& Shared(size_t cls)
+	{
+		static SharedClass classes[kClassCount];
+		return classes[cls];
+	}
+
+	static void Refill(size_t cls, LocalClass& local)
+	{
+		SharedClass& shared = Shared(cls);
+		{
+			std::lock_guard<std::mutex> lock(shared.mutex);
+			size_t moved = 0;
+			while (shared.head && moved < kBatchSize)
+			{
+				FreeBlock* block = shared.head;
+				shared.head = block->next;
+				block->next = local.head;
+				local.head = block;
+				moved++;
+			}
+			shared.count -= moved;
+			local.count += moved;
+		}
+		if (local.head)
+			return;
+
+		// nothing cached anywhere, carve a fresh chunk straight into the local list
+		const size_t blockSize = BlockSize(cls);
+		const size_t blocks = kChunkBytes / blockSize < kBatchSize ? kBatchSize : kChunkBytes / blockSize;
+		unsigned char* chunk = static_cast<unsigned char*>(::operator new(blocks * blockSize));
+		for (size_t i = 0; i < blocks; i++)
+		{
+			FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + i * blockSize);
+			block->next = local.head;
+			local.head = block;
+		}
+		local.count += blocks;
+	}
+
+	static void Spill(size_t cls, LocalClass& local, size_t count)
+	{
+		if (count == 0)
+			return;
+
+		FreeBlock* first = local.head;
+		FreeBlock* last = first;
+		for (size_t i = 1; i < count; i++)
+			last = last->next;
+		local.head = last->next;
+		local.count -= count;
+
+		SharedClass& shared = Shared(cls);
+		std::lock_guard<std::mutex> lock(shared.mutex);
+		last->next = shared.head;
+		shared.head = first;
+		shared.count += count;
+	}
+};
+
+// std-compatible allocator on top of SizeClassPool, usable with allocate_shared, std::promise, containers...
+template<typename T>
+class PoolAllocator
+{
+public:
+	using value_type = T;
+
+	PoolAllocator() noexcept = default;
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+	T* allocate(size_t n)
+	{
+		if constexpr (alignof(T) > SizeClassPool::kBlockAlignment)
+			return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+		else
+			return static_cast<T*>(SizeClassPool::Allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t n) noexcept
+	{
+		if constexpr (alignof(T) > SizeClassPool::kBlockAlignment)
+			::operator delete(p, std::align_val_t(alignof(T)));
+		else
+			SizeClassPool::Deallocate(p, n * sizeof(T));
+	}
+
+	template<typename U>
+	bool operator== (const PoolAllocator<U>&) const noexcept { return true; }
+	template<typename U>
+	bool operator!= (const PoolAllocator<U>&) const noexcept { return false; }
+};
@@ -2,323 +2,181 @@
 #include <assert.h>
 #include <cstddef>
 #include <functional>
+#include <iterator>
+#include <memory_resource>
 #include <type_traits>
 #include <utility>
+#include "NodePool.h"
+
+// Red-black tree map (RBTree<KEY, VAL>) and set (RBTree<KEY, void>).
+// Both share RBTreeDetail::Tree: nodes live in a per-tree NodePool, iterators are bidirectional
+// and stay valid until their element is erased, and the rebalancing code only sees the untyped
+// link part of a node, so it is compiled once per Policy rather than per key type.
+// With OrderStatisticPolicy every node also counts its subtree, which adds At, RankOf and
+// CountInRange in O(log n) worst case; the default PlainTreePolicy keeps the nodes and the
+// rebalancing exactly as they are without it.
+// Map iterators dereference to RBTreeEntry { const KEY key; VAL value; }, set iterators to const KEY.
+
+template<typename KEY, typename VAL>
+struct RBTreeEntry
+{
+	const KEY key;
+	VAL value;
+};
 
-template<typename KEY, typename VAL, typename Compare = std::less<KEY>>
-class RBTree
+namespace RBTreeDetail
 {
-private:
 	enum class Color : unsigned char
 	{
 		Red,
 		Black
 	};
 
-	struct Node
+	struct NodeBase
 	{
-		KEY key;
-		VAL value;
-		Color color;
-		Node* parent;
-		Node* left;
-		Node* right;
-
-		Node(const KEY& k, const VAL& v) :
-			key(k), value(v), color(Color::Red), parent(nullptr), left(nullptr), right(nullptr) {}
-
-		Node(const KEY& k, VAL&& v) :
-			key(k), value(std::move(v)), color(Color::Red), parent(nullptr), left(nullptr), right(nullptr) {}
-
-		Node(KEY&& k, VAL&& v) :
-			key(std::move(k)), value(std::move(v)), color(Color::Red), parent(nullptr), left(nullptr), right(nullptr) {}
+		NodeBase* parent = nullptr;
+		NodeBase* left = nullptr;
+		NodeBase* right = nullptr;
+		Color color = Color::Red;
 	};
 
-	Node* _root;
-	std::size_t _size;
-	Compare _comp;
-
-public:
-	RBTree() :
-		_root(nullptr),
-		_size(0),
-		_comp(Compare()) {}
-
-	explicit RBTree(Compare comp) :
-		_root(nullptr),
-		_size(0),
-		_comp(std::move(comp)) {}
-
-	~RBTree()
-	{
-		Clear();
-	}
-
-	RBTree(const RBTree&) = delete;
-	RBTree& operator= (const RBTree&) = delete;
-
-	RBTree(RBTree&& other) noexcept :
-		_root(other._root),
-		_size(other._size),
-		_comp(std::move(other._comp))
+	struct SizedNodeBase : NodeBase
 	{
-		other._root = nullptr;
-		other._size = 0;
-	}
+		std::size_t size = 1; // nodes in the subtree rooted here
+	};
 
-	RBTree& operator= (RBTree&& other) noexcept
-	{
-		if (this != &other)
-		{
-			Clear();
-			_root = other._root;
-			_size = other._size;
-			_comp = std::move(other._comp);
-			other._root = nullptr;
-			other._size = 0;
-		}
-		return *this;
-	}
+	inline std::size_t SubtreeSize(const NodeBase* node) { return node ? static_cast<const SizedNodeBase*>(node)->size : 0; }
+}
 
-	std::size_t Size() const { return _size; }
-	bool Empty() const { return _size == 0; }
+// no augmentation
+struct PlainTreePolicy
+{
+	using NodeBase = RBTreeDetail::NodeBase;
+	static constexpr bool kCountsSubtrees = false;
 
-	void Clear()
-	{
-		DestroySubtree(_root);
-		_root = nullptr;
-		_size = 0;
-	}
+	static void Recompute(RBTreeDetail::NodeBase*) {}
+	static void AddToPath(RBTreeDetail::NodeBase*, std::ptrdiff_t) {}
+};
 
-	bool Contains(const KEY& key) const
-	{
-		return FindNode(key) != nullptr;
-	}
+// subtree sizes for positional access, one extra word per node
+struct OrderStatisticPolicy
+{
+	using NodeBase = RBTreeDetail::SizedNodeBase;
+	static constexpr bool kCountsSubtrees = true;
 
-	VAL* Find(const KEY& key)
+	// the node's children are up to date
+	static void Recompute(RBTreeDetail::NodeBase* node)
 	{
-		Node* node = FindNode(key);
-		return node ? &node->value : nullptr;
+		static_cast<NodeBase*>(node)->size = 1 + RBTreeDetail::SubtreeSize(node->left) + RBTreeDetail::SubtreeSize(node->right);
 	}
 
-	const VAL* Find(const KEY& key) const
+	// node and all of its ancestors gained (or lost) 'delta' descendants
+	static void AddToPath(RBTreeDetail::NodeBase* node, std::ptrdiff_t delta)
 	{
-		const Node* node = FindNode(key);
-		return node ? &node->value : nullptr;
+		for (; node; node = node->parent)
+			static_cast<NodeBase*>(node)->size += static_cast<std::size_t>(delta);
 	}
+};
 
-	template<typename K, typename V>
-	bool Insert(K&& key, V&& value)
-	{
-		static_assert(std::is_constructible_v<KEY, K&&>, "RedBlackTree: Invalid key type");
-		static_assert(std::is_constructible_v<VAL, V&&>, "RedBlackTree: Invalid value type");
-
-		Node* parent = nullptr;
-		Node* current = _root;
-		while (current)
-		{
-			parent = current;
-			if (_comp(key, current->key))
-			{
-				current = current->left;
-			}
-			else if (_comp(current->key, key))
-			{
-				current = current->right;
-			}
-			else
-			{
-				current->value = std::forward<V>(value);
-				return false;
-			}
-		}
-
-		Node* node = new Node(std::forward<K>(key), std::forward<V>(value));
-		node->parent = parent;
-		if (!parent)
-		{
-			_root = node;
-		}
-		else if (_comp(node->key, parent->key))
-		{
-			parent->left = node;
-		}
-		else
-		{
-			parent->right = node;
-		}
+namespace RBTreeDetail
+{
 
-		InsertFixup(node);
-		_size++;
-		return true;
-	}
+	inline bool IsRed(const NodeBase* node) { return node && node->color == Color::Red; }
+	inline bool IsBlack(const NodeBase* node) { return !node || node->color == Color::Black; }
 
-	bool Erase(const KEY& key)
+	inline NodeBase* Minimum(NodeBase* node)
 	{
-		Node* z = FindNode(key);
-		if (!z)
-		{
-			return false;
-		}
-
-		Node* y = z;
-		Color yOriginalColor = y->color;
-		Node* x = nullptr;
-		Node* xParent = nullptr;
-
-		if (!z->left)
-		{
-			x = z->right;
-			xParent = z->parent;
-			Transplant(z, z->right);
-		}
-		else if (!z->right)
-		{
-			x = z->left;
-			xParent = z->parent;
-			Transplant(z, z->left);
-		}
-		else
-		{
-			y = Minimum(z->right);
-			yOriginalColor = y->color;
-			x = y->right;
-			if (y->parent == z)
-			{
-				xParent = y;
-				if (x)
-					x->parent = y;
-			}
-			else
-			{
-				xParent = y->parent;
-				Transplant(y, y->right);
-				y->right = z->right;
-				y->right->parent = y;
-			}
-
-			Transplant(z, y);
-			y->left = z->left;
-			y->left->parent = y;
-			y->color = z->color;
-		}
-
-		delete z;
-		_size--;
-
-		if (yOriginalColor == Color::Black)
-		{
-			DeleteFixup(x, xParent);
-		}
-		return true;
+		assert(node);
+		while (node->left)
+			node = node->left;
+		return node;
 	}
 
-private:
-	static bool IsRed(const Node* node) { return node && node->color == Color::Red; }
-	static bool IsBlack(const Node* node) { return !node || node->color == Color::Black; }
-
-	void DestroySubtree(Node* node)
+	inline NodeBase* Maximum(NodeBase* node)
 	{
-		if (!node)
-			return;
-		DestroySubtree(node->left);
-		DestroySubtree(node->right);
-		delete node;
+		assert(node);
+		while (node->right)
+			node = node->right;
+		return node;
 	}
 
-	Node* FindNode(const KEY& key)
+	inline NodeBase* Successor(NodeBase* node)
 	{
-		Node* current = _root;
-		while (current)
+		if (node->right)
+			return Minimum(node->right);
+		NodeBase* parent = node->parent;
+		while (parent && node == parent->right)
 		{
-			if (_comp(key, current->key))
-			{
-				current = current->left;
-			}
-			else if (_comp(current->key, key))
-			{
-				current = current->right;
-			}
-			else
-			{
-				return current;
-			}
+			node = parent;
+			parent = parent->parent;
 		}
-		return nullptr;
+		return parent;
 	}
 
-	const Node* FindNode(const KEY& key) const
+	inline NodeBase* Predecessor(NodeBase* node)
 	{
-		const Node* current = _root;
-		while (current)
+		if (node->left)
+			return Maximum(node->left);
+		NodeBase* parent = node->parent;
+		while (parent && node == parent->left)
 		{
-			if (_comp(key, current->key))
-			{
-				current = current->left;
-			}
-			else if (_comp(current->key, key))
-			{
-				current = current->right;
-			}
-			else
-			{
-				return current;
-			}
+			node = parent;
+			parent = parent->parent;
 		}
-		return nullptr;
-	}
-
-	Node* Minimum(Node* node) const
-	{
-		assert(node);
-		while (node->left)
-			node = node->left;
-		return node;
+		return parent;
 	}
 
-	void RotateLeft(Node* x)
+	template<typename Policy>
+	inline void RotateLeft(NodeBase*& root, NodeBase* x)
 	{
-		Node* y = x->right;
+		NodeBase* y = x->right;
 		assert(y);
 		x->right = y->left;
 		if (y->left)
 			y->left->parent = x;
 		y->parent = x->parent;
 		if (!x->parent)
-			_root = y;
+			root = y;
 		else if (x == x->parent->left)
 			x->parent->left = y;
 		else
 			x->parent->right = y;
 		y->left = x;
 		x->parent = y;
+		Policy::Recompute(x);
+		Policy::Recompute(y);
 	}
 
-	void RotateRight(Node* y)
+	template<typename Policy>
+	inline void RotateRight(NodeBase*& root, NodeBase* y)
 	{
-		Node* x = y->left;
+		NodeBase* x = y->left;
 		assert(x);
 		y->left = x->right;
 		if (x->right)
 			x->right->parent = y;
 		x->parent = y->parent;
 		if (!y->parent)
-			_root = x;
+			root = x;
 		else if (y == y->parent->right)
 			y->parent->right = x;
 		else
 			y->parent->left = x;
 		x->right = y;
 		y->parent = x;
+		Policy::Recompute(y);
+		Policy::Recompute(x);
 	}
 
-	void InsertFixup(Node* z)
+	// sizes along z's path are already counted, the rotations keep them right
+	template<typename Policy>
+	inline void InsertFixup(NodeBase*& root, NodeBase* z)
 	{
 		while (IsRed(z->parent))
 		{
 			if (z->parent == z->parent->parent->left)
 			{
-				Node* y = z->parent->parent->right;
+				NodeBase* y = z->parent->parent->right;
 				if (IsRed(y))
 				{
 					z->parent->color = Color::Black;
@@ -331,16 +189,16 @@ private:
 					if (z == z->parent->right)
 					{
 						z = z->parent;
-						RotateLeft(z);
+						RotateLeft<Policy>(root, z);
 					}
 					z->parent->color = Color::Black;
 					z->parent->parent->color = Color::Red;
-					RotateRight(z->parent->parent);
+					RotateRight<Policy>(root, z->parent->parent);
 				}
 			}
 			else
 			{
-				Node* y = z->parent->parent->left;
+				NodeBase* y = z->parent->parent->left;
 				if (IsRed(y))
 				{
 					z->parent->color = Color::Black;
@@ -353,21 +211,21 @@ private:
 					if (z == z->parent->left)
 					{
 						z = z->parent;
-						RotateRight(z);
+						RotateRight<Policy>(root, z);
 					}
 					z->parent->color = Color::Black;
 					z->parent->parent->color = Color::Red;
-					RotateLeft(z->parent->parent);
+					RotateLeft<Policy>(root, z->parent->parent);
 				}
 			}
 		}
-		_root->color = Color::Black;
+		root->color = Color::Black;
 	}
 
-	void Transplant(Node* u, Node* v)
+	inline void Transplant(NodeBase*& root, NodeBase* u, NodeBase* v)
 	{
 		if (!u->parent)
-			_root = v;
+			root = v;
 		else if (u == u->parent->left)
 			u->parent->left = v;
 		else
@@ -376,16 +234,17 @@ private:
 			v->parent = u->parent;
 	}
 
-	void DeleteFixup(Node* x, Node* xParent)
+	template<typename Policy>
+	inline void DeleteFixup(NodeBase*& root, NodeBase* x, NodeBase* xParent)
 	{
-		while ((x != _root) && IsBlack(x))
+		while ((x != root) && IsBlack(x))
 		{
 			if (!xParent)
 				break;
 
 			if (x == xParent->left)
 			{
-				Node* w = xParent->right;
+				NodeBase* w = xParent->right;
 				if (!w)
 				{
 					x = xParent;
@@ -397,7 +256,7 @@ private:
 				{
 					w->color = Color::Black;
 					xParent->color = Color::Red;
-					RotateLeft(xParent);
+					RotateLeft<Policy>(root, xParent);
 					w = xParent->right;
 				}
 
@@ -414,20 +273,20 @@ private:
 						if (w->left)
 							w->left->color = Color::Black;
 						w->color = Color::Red;
-						RotateRight(w);
+						RotateRight<Policy>(root, w);
 						w = xParent->right;
 					}
 					w->color = xParent->color;
 					xParent->color = Color::Black;
 					if (w->right)
 						w->right->color = Color::Black;
-					RotateLeft(xParent);
-					x = _root;
+					RotateLeft<Policy>(root, xParent);
+					x = root;
 				}
 			}
 			else
 			{
-				Node* w = xParent->left;
+				NodeBase* w = xParent->left;
 				if (!w)
 				{
 					x = xParent;
@@ -439,7 +298,7 @@ private:
 				{
 					w->color = Color::Black;
 					xParent->color = Color::Red;
-					RotateRight(xParent);
+					RotateRight<Policy>(root, xParent);
 					w = xParent->left;
 				}
 
@@ -456,143 +315,47 @@ private:
 						if (w->right)
 							w->right->color = Color::Black;
 						w->color = Color::Red;
-						RotateLeft(w);
+						RotateLeft<Policy>(root, w);
 						w = xParent->left;
 					}
 					w->color = xParent->color;
 					xParent->color = Color::Black;
 					if (w->left)
 						w->left->color = Color::Black;
-					RotateRight(xParent);
-					x = _root;
+					RotateRight<Policy>(root, xParent);
+					x = root;
 				}
 			}
 		}
 		if (x)
 			x->color = Color::Black;
 	}
-};
-
-template<typename KEY, typename Compare>
-class RBTree<KEY, void, Compare>
-{
-private:
-	enum class Color : unsigned char
-	{
-		Red,
-		Black
-	};
-
-	struct Node
-	{
-		KEY key;
-		Color color;
-		Node* parent;
-		Node* left;
-		Node* right;
-
-		Node(const KEY& k) :
-			key(k), color(Color::Red), parent(nullptr), left(nullptr), right(nullptr) {}
-
-		Node(KEY&& k) :
-			key(std::move(k)), color(Color::Red), parent(nullptr), left(nullptr), right(nullptr) {}
-	};
-
-	Node* _root;
-	std::size_t _size;
-	Compare _comp;
-
-public:
-	RBTree() :
-		_root(nullptr),
-		_size(0),
-		_comp(Compare()) {}
-
-	explicit RBTree(Compare comp) :
-		_root(nullptr),
-		_size(0),
-		_comp(std::move(comp)) {}
-
-	~RBTree()
-	{
-		Clear();
-	}
 
-	RBTree(const RBTree&) = delete;
-	RBTree& operator= (const RBTree&) = delete;
-
-	RBTree(RBTree&& other) noexcept :
-		_root(other._root),
-		_size(other._size),
-		_comp(std::move(other._comp))
+	// unlinks z and rebalances, z itself is left to the caller
+	template<typename Policy>
+	inline void EraseAndRebalance(NodeBase*& root, NodeBase* z)
 	{
-		other._root = nullptr;
-		other._size = 0;
-	}
+		// the node that physically leaves its spot is z, or z's successor when z has two children;
+		// everything above that spot loses one descendant
+		if constexpr (Policy::kCountsSubtrees)
+			Policy::AddToPath(z->left && z->right ? Minimum(z->right)->parent : z->parent, -1);
 
-	RBTree& operator= (RBTree&& other) noexcept
-	{
-		if (this != &other)
-		{
-			Clear();
-			_root = other._root;
-			_size = other._size;
-			_comp = std::move(other._comp);
-			other._root = nullptr;
-			other._size = 0;
-		}
-		return *this;
-	}
-
-	std::size_t Size() const { return _size; }
-	bool Empty() const { return _size == 0; }
-
-	void Clear()
-	{
-		DestroySubtree(_root);
-		_root = nullptr;
-		_size = 0;
-	}
-
-	bool Contains(const KEY& key) const
-	{
-		return FindNode(key) != nullptr;
-	}
-
-	bool Insert(const KEY& key)
-	{
-		return EmplaceKey(key);
-	}
-
-	bool Insert(KEY&& key)
-	{
-		return EmplaceKey(std::move(key));
-	}
-
-	bool Erase(const KEY& key)
-	{
-		Node* z = FindNode(key);
-		if (!z)
-		{
-			return false;
-		}
-
-		Node* y = z;
+		NodeBase* y = z;
 		Color yOriginalColor = y->color;
-		Node* x = nullptr;
-		Node* xParent = nullptr;
+		NodeBase* x = nullptr;
+		NodeBase* xParent = nullptr;
 
 		if (!z->left)
 		{
 			x = z->right;
 			xParent = z->parent;
-			Transplant(z, z->right);
+			Transplant(root, z, z->right);
 		}
 		else if (!z->right)
 		{
 			x = z->left;
 			xParent = z->parent;
-			Transplant(z, z->left);
+			Transplant(root, z, z->left);
 		}
 		else
 		{
@@ -608,306 +371,608 @@ public:
 			else
 			{
 				xParent = y->parent;
-				Transplant(y, y->right);
+				Transplant(root, y, y->right);
 				y->right = z->right;
 				y->right->parent = y;
 			}
 
-			Transplant(z, y);
+			Transplant(root, z, y);
 			y->left = z->left;
 			y->left->parent = y;
 			y->color = z->color;
+			Policy::Recompute(y);
 		}
 
-		delete z;
-		_size--;
-
 		if (yOriginalColor == Color::Black)
 		{
-			DeleteFixup(x, xParent);
+			DeleteFixup<Policy>(root, x, xParent);
 		}
-		return true;
 	}
 
-private:
-	static bool IsRed(const Node* node) { return node && node->color == Color::Red; }
-	static bool IsBlack(const Node* node) { return !node || node->color == Color::Black; }
+	struct EntryKey
+	{
+		template<typename E>
+		const auto& operator() (const E& entry) const { return entry.key; }
+	};
 
-	void DestroySubtree(Node* node)
+	struct Identity
 	{
-		if (!node)
-			return;
-		DestroySubtree(node->left);
-		DestroySubtree(node->right);
-		delete node;
-	}
+		template<typename K>
+		const K& operator() (const K& key) const { return key; }
+	};
 
-	Node* FindNode(const KEY& key) const
+	// Value is what iterators expose, KeyOf extracts the ordering key from it
+	template<typename KEY, typename Value, typename KeyOf, typename Compare, typename Policy>
+	class Tree
 	{
-		Node* current = _root;
-		while (current)
+	protected:
+		struct Node : Policy::NodeBase
+		{
+			Value value;
+
+			template<typename... Args>
+			explicit Node(Args&&... args) : value{ std::forward<Args>(args)... } {}
+		};
+
+		NodeBase* _root;
+		std::size_t _size;
+		Compare _comp;
+		NodePool<Node> _pool;
+
+		static const KEY& KeyOfNode(const NodeBase* node) { return KeyOf()(static_cast<const Node*>(node)->value); }
+
+	public:
+		template<bool Const>
+		class Iterator
 		{
-			if (_comp(key, current->key))
+			friend class Tree;
+
+			using TreePtr = std::conditional_t<Const, const Tree*, Tree*>;
+
+			TreePtr _tree = nullptr;
+			NodeBase* _node = nullptr; // nullptr: end()
+
+			Iterator(TreePtr tree, NodeBase* node) : _tree(tree), _node(node) {}
+
+		public:
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = std::remove_const_t<Value>;
+			using difference_type = std::ptrdiff_t;
+			using pointer = std::conditional_t<Const, const Value*, Value*>;
+			using reference = std::conditional_t<Const, const Value&, Value&>;
+
+			Iterator() = default;
+
+			// iterator -> const_iterator
+			template<bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+			Iterator(const Iterator<OtherConst>& other) : _tree(other._tree), _node(other._node) {}
+
+			reference operator* () const { return static_cast<Node*>(_node)->value; }
+			pointer operator-> () const { return &static_cast<Node*>(_node)->value; }
+
+			Iterator& operator++ ()
 			{
-				current = current->left;
+				assert(_node);
+				_node = Successor(_node);
+				return *this;
 			}
-			else if (_comp(current->key, key))
+
+			Iterator operator++ (int)
 			{
-				current = current->right;
+				Iterator old = *this;
+				++*this;
+				return old;
 			}
-			else
+
+			// --end() is the last element
+			Iterator& operator-- ()
 			{
-				return current;
+				_node = _node ? Predecessor(_node) : Maximum(_tree->_root);
+				return *this;
 			}
-		}
-		return nullptr;
-	}
 
-	Node* Minimum(Node* node) const
-	{
-		assert(node);
-		while (node->left)
-			node = node->left;
-		return node;
-	}
+			Iterator operator-- (int)
+			{
+				Iterator old = *this;
+				--*this;
+				return old;
+			}
 
-	void RotateLeft(Node* x)
-	{
-		Node* y = x->right;
-		assert(y);
-		x->right = y->left;
-		if (y->left)
-			y->left->parent = x;
-		y->parent = x->parent;
-		if (!x->parent)
-			_root = y;
-		else if (x == x->parent->left)
-			x->parent->left = y;
-		else
-			x->parent->right = y;
-		y->left = x;
-		x->parent = y;
-	}
+			bool operator== (const Iterator& other) const { return _node == other._node; }
+			bool operator!= (const Iterator& other) const { return _node != other._node; }
 
-	void RotateRight(Node* y)
-	{
-		Node* x = y->left;
-		assert(x);
-		y->left = x->right;
-		if (x->right)
-			x->right->parent = y;
-		x->parent = y->parent;
-		if (!y->parent)
-			_root = x;
-		else if (y == y->parent->right)
-			y->parent->right = x;
-		else
-			y->parent->left = x;
-		x->right = y;
-		y->parent = x;
-	}
+			template<bool> friend class Iterator;
+		};
 
-	template<typename K>
-	bool EmplaceKey(K&& key)
-	{
-		static_assert(std::is_constructible_v<KEY, K&&>, "RBTree<void>: Invalid key type");
+		using iterator = Iterator<false>;
+		using const_iterator = Iterator<true>;
+
+		Tree() :
+			_root(nullptr),
+			_size(0),
+			_comp(Compare()) {}
+
+		explicit Tree(Compare comp) :
+			_root(nullptr),
+			_size(0),
+			_comp(std::move(comp)) {}
+
+		// nodes are carved from 'resource' (e.g. a MonotonicArena), which must outlive the tree
+		explicit Tree(std::pmr::memory_resource* resource, Compare comp = Compare()) :
+			_root(nullptr),
+			_size(0),
+			_comp(std::move(comp)),
+			_pool(resource) {}
 
-		Node* parent = nullptr;
-		Node* current = _root;
-		while (current)
+		~Tree()
 		{
-			parent = current;
-			if (_comp(key, current->key))
+			Clear();
+		}
+
+		Tree(const Tree&) = delete;
+		Tree& operator= (const Tree&) = delete;
+
+		Tree(Tree&& other) noexcept :
+			_root(other._root),
+			_size(other._size),
+			_comp(std::move(other._comp)),
+			_pool(std::move(other._pool))
+		{
+			other._root = nullptr;
+			other._size = 0;
+		}
+
+		Tree& operator= (Tree&& other) noexcept
+		{
+			if (this != &other)
 			{
-				current = current->left;
+				Clear();
+				_root = other._root;
+				_size = other._size;
+				_comp = std::move(other._comp);
+				_pool = std::move(other._pool);
+				other._root = nullptr;
+				other._size = 0;
 			}
-			else if (_comp(current->key, key))
+			return *this;
+		}
+
+		std::size_t Size() const { return _size; }
+		bool Empty() const { return _size == 0; }
+
+		void Clear()
+		{
+			if constexpr (!std::is_trivially_destructible_v<Value>)
+				DestroySubtree(_root);
+			_pool.Release();
+			_root = nullptr;
+			_size = 0;
+		}
+
+		bool Contains(const KEY& key) const
+		{
+			return FindNode(key) != nullptr;
+		}
+
+		iterator begin() { return iterator(this, _root ? Minimum(_root) : nullptr); }
+		iterator end() { return iterator(this, nullptr); }
+		const_iterator begin() const { return const_iterator(this, _root ? Minimum(_root) : nullptr); }
+		const_iterator end() const { return const_iterator(this, nullptr); }
+
+		// first element not ordered before key
+		iterator LowerBound(const KEY& key) { return iterator(this, LowerBoundNode(key)); }
+		const_iterator LowerBound(const KEY& key) const { return const_iterator(this, LowerBoundNode(key)); }
+
+		// first element ordered after key
+		iterator UpperBound(const KEY& key) { return iterator(this, UpperBoundNode(key)); }
+		const_iterator UpperBound(const KEY& key) const { return const_iterator(this, UpperBoundNode(key)); }
+
+		// element at position 'index' in key order, end() when out of range
+		iterator At(std::size_t index) requires Policy::kCountsSubtrees { return iterator(this, SelectNode(index)); }
+		const_iterator At(std::size_t index) const requires Policy::kCountsSubtrees { return const_iterator(this, SelectNode(index)); }
+
+		// number of elements ordered before key, whether or not key is present
+		std::size_t RankOf(const KEY& key) const requires Policy::kCountsSubtrees
+		{
+			std::size_t rank = 0;
+			NodeBase* current = _root;
+			while (current)
 			{
-				current = current->right;
+				if (_comp(KeyOfNode(current), key))
+				{
+					rank += SubtreeSize(current->left) + 1;
+					current = current->right;
+				}
+				else
+				{
+					current = current->left;
+				}
 			}
-			else
+			return rank;
+		}
+
+		// number of elements with lo <= key < hi
+		std::size_t CountInRange(const KEY& lo, const KEY& hi) const requires Policy::kCountsSubtrees
+		{
+			if (!_comp(lo, hi))
+				return 0;
+			return RankOf(hi) - RankOf(lo);
+		}
+
+		// Calls fn for every element with lo <= key < hi, in order. fn may return bool, false stops the scan.
+		template<typename Fn>
+		void RangeForEach(const KEY& lo, const KEY& hi, Fn&& fn)
+		{
+			ForEachFrom(*this, lo, hi, fn);
+		}
+
+		template<typename Fn>
+		void RangeForEach(const KEY& lo, const KEY& hi, Fn&& fn) const
+		{
+			ForEachFrom(*this, lo, hi, fn);
+		}
+
+		bool Erase(const KEY& key)
+		{
+			NodeBase* z = FindNode(key);
+			if (!z)
 			{
 				return false;
 			}
+			EraseNode(z);
+			return true;
 		}
 
-		Node* node = new Node(std::forward<K>(key));
-		node->parent = parent;
-		if (!parent)
+		// returns the iterator following the erased element
+		iterator Erase(const_iterator pos)
 		{
-			_root = node;
+			assert(pos._node);
+			NodeBase* next = Successor(pos._node);
+			EraseNode(pos._node);
+			return iterator(this, next);
 		}
-		else if (_comp(node->key, parent->key))
+
+	protected:
+		// Replaces the content with [first, last), which must be strictly increasing, in O(n): the tree is
+		// built perfectly balanced from the middle out and nodes are allocated in order in one run.
+		template<typename It, typename MakeNode>
+		void BuildFrom(It first, It last, MakeNode&& makeNode)
 		{
-			parent->left = node;
+			Clear();
+			const std::size_t count = static_cast<std::size_t>(std::distance(first, last));
+			if (count == 0)
+				return;
+
+			// levels [0, completeLevels) are full and black, the partial last level is red
+			std::size_t completeLevels = 0;
+			while ((std::size_t(2) << completeLevels) - 1 <= count)
+				completeLevels++;
+
+			_pool.Reserve(count);
+			NodeBase* previous = nullptr;
+			_root = BuildSubtree(first, count, 0, completeLevels, makeNode, previous);
+			_root->parent = nullptr;
+			_size = count;
 		}
-		else
+
+		template<typename It, typename MakeNode>
+		NodeBase* BuildSubtree(It& it, std::size_t count, std::size_t depth, std::size_t completeLevels, MakeNode& makeNode, NodeBase*& previous)
 		{
-			parent->right = node;
+			if (count == 0)
+				return nullptr;
+
+			const std::size_t leftCount = (count - 1) / 2;
+			NodeBase* left = BuildSubtree(it, leftCount, depth + 1, completeLevels, makeNode, previous);
+
+			NodeBase* node = makeNode(*it);
+			++it;
+			assert((!previous || _comp(KeyOfNode(previous), KeyOfNode(node))) && "RBTree::BuildFromSorted: input must be strictly increasing");
+			previous = node;
+			node->color = depth < completeLevels ? Color::Black : Color::Red;
+
+			NodeBase* right = BuildSubtree(it, count - 1 - leftCount, depth + 1, completeLevels, makeNode, previous);
+			node->left = left;
+			node->right = right;
+			if (left)
+				left->parent = node;
+			if (right)
+				right->parent = node;
+			Policy::Recompute(node);
+			return node;
 		}
 
-		InsertFixup(node);
-		_size++;
-		return true;
-	}
+		template<typename... Args>
+		Node* NewNode(Args&&... args)
+		{
+			void* storage = _pool.Allocate();
+			try
+			{
+				return ::new (storage) Node(std::forward<Args>(args)...);
+			}
+			catch (...)
+			{
+				_pool.Deallocate(storage);
+				throw;
+			}
+		}
 
-	void InsertFixup(Node* z)
-	{
-		while (IsRed(z->parent))
+		void FreeNode(NodeBase* node)
 		{
-			if (z->parent == z->parent->parent->left)
+			Node* typed = static_cast<Node*>(node);
+			typed->~Node();
+			_pool.Deallocate(typed);
+		}
+
+		// finds the node with a key equivalent to 'key', or the parent a new node would hang from
+		template<typename K>
+		NodeBase* FindInsertPosition(const K& key, NodeBase*& parent, bool& found) const
+		{
+			parent = nullptr;
+			NodeBase* current = _root;
+			while (current)
 			{
-				Node* y = z->parent->parent->right;
-				if (IsRed(y))
+				parent = current;
+				if (_comp(key, KeyOfNode(current)))
 				{
-					z->parent->color = Color::Black;
-					y->color = Color::Black;
-					z->parent->parent->color = Color::Red;
-					z = z->parent->parent;
+					current = current->left;
+				}
+				else if (_comp(KeyOfNode(current), key))
+				{
+					current = current->right;
 				}
 				else
 				{
-					if (z == z->parent->right)
-					{
-						z = z->parent;
-						RotateLeft(z);
-					}
-					z->parent->color = Color::Black;
-					z->parent->parent->color = Color::Red;
-					RotateRight(z->parent->parent);
+					found = true;
+					return current;
 				}
 			}
+			found = false;
+			return nullptr;
+		}
+
+		void LinkNode(NodeBase* parent, NodeBase* node)
+		{
+			node->parent = parent;
+			if (!parent)
+			{
+				_root = node;
+			}
+			else if (_comp(KeyOfNode(node), KeyOfNode(parent)))
+			{
+				parent->left = node;
+			}
 			else
 			{
-				Node* y = z->parent->parent->left;
-				if (IsRed(y))
+				parent->right = node;
+			}
+
+			Policy::AddToPath(parent, 1);
+			InsertFixup<Policy>(_root, node);
+			_size++;
+		}
+
+		void EraseNode(NodeBase* z)
+		{
+			EraseAndRebalance<Policy>(_root, z);
+			FreeNode(z);
+			_size--;
+		}
+
+		void DestroySubtree(NodeBase* node)
+		{
+			if (!node)
+				return;
+			DestroySubtree(node->left);
+			DestroySubtree(node->right);
+			static_cast<Node*>(node)->~Node();
+		}
+
+		NodeBase* FindNode(const KEY& key) const
+		{
+			NodeBase* current = _root;
+			while (current)
+			{
+				if (_comp(key, KeyOfNode(current)))
 				{
-					z->parent->color = Color::Black;
-					y->color = Color::Black;
-					z->parent->parent->color = Color::Red;
-					z = z->parent->parent;
+					current = current->left;
+				}
+				else if (_comp(KeyOfNode(current), key))
+				{
+					current = current->right;
 				}
 				else
 				{
-					if (z == z->parent->left)
-					{
-						z = z->parent;
-						RotateRight(z);
-					}
-					z->parent->color = Color::Black;
-					z->parent->parent->color = Color::Red;
-					RotateLeft(z->parent->parent);
+					return current;
 				}
 			}
+			return nullptr;
 		}
-		_root->color = Color::Black;
-	}
 
-	void Transplant(Node* u, Node* v)
-	{
-		if (!u->parent)
-			_root = v;
-		else if (u == u->parent->left)
-			u->parent->left = v;
-		else
-			u->parent->right = v;
-		if (v)
-			v->parent = u->parent;
-	}
-
-	void DeleteFixup(Node* x, Node* xParent)
-	{
-		while ((x != _root) && IsBlack(x))
+		NodeBase* LowerBoundNode(const KEY& key) const
 		{
-			if (!xParent)
-				break;
-
-			if (x == xParent->left)
+			NodeBase* result = nullptr;
+			NodeBase* current = _root;
+			while (current)
 			{
-				Node* w = xParent->right;
-				if (!w)
+				if (_comp(KeyOfNode(current), key))
 				{
-					x = xParent;
-					xParent = xParent->parent;
-					continue;
+					current = current->right;
 				}
-
-				if (IsRed(w))
+				else
 				{
-					w->color = Color::Black;
-					xParent->color = Color::Red;
-					RotateLeft(xParent);
-					w = xParent->right;
+					result = current;
+					current = current->left;
 				}
+			}
+			return result;
+		}
 
-				if (IsBlack(w->left) && IsBlack(w->right))
+		NodeBase* SelectNode(std::size_t index) const
+		{
+			NodeBase* current = _root;
+			while (current)
+			{
+				const std::size_t leftSize = SubtreeSize(current->left);
+				if (index < leftSize)
 				{
-					w->color = Color::Red;
-					x = xParent;
-					xParent = xParent->parent;
+					current = current->left;
+				}
+				else if (index == leftSize)
+				{
+					return current;
 				}
 				else
 				{
-					if (IsBlack(w->right))
-					{
-						if (w->left)
-							w->left->color = Color::Black;
-						w->color = Color::Red;
-						RotateRight(w);
-						w = xParent->right;
-					}
-					w->color = xParent->color;
-					xParent->color = Color::Black;
-					if (w->right)
-						w->right->color = Color::Black;
-					RotateLeft(xParent);
-					x = _root;
+					index -= leftSize + 1;
+					current = current->right;
 				}
 			}
-			else
+			return nullptr;
+		}
+
+		NodeBase* UpperBoundNode(const KEY& key) const
+		{
+			NodeBase* result = nullptr;
+			NodeBase* current = _root;
+			while (current)
 			{
-				Node* w = xParent->left;
-				if (!w)
+				if (_comp(key, KeyOfNode(current)))
 				{
-					x = xParent;
-					xParent = xParent->parent;
-					continue;
+					result = current;
+					current = current->left;
 				}
-
-				if (IsRed(w))
+				else
 				{
-					w->color = Color::Black;
-					xParent->color = Color::Red;
-					RotateRight(xParent);
-					w = xParent->left;
+					current = current->right;
 				}
+			}
+			return result;
+		}
 
-				if (IsBlack(w->left) && IsBlack(w->right))
+		// map callbacks take (key, value), set callbacks the key
+		template<typename Fn, typename V>
+		static decltype(auto) Visit(Fn& fn, V& value)
+		{
+			if constexpr (std::is_same_v<KeyOf, EntryKey>)
+				return fn(value.key, value.value);
+			else
+				return fn(value);
+		}
+
+		template<typename Self, typename Fn>
+		static void ForEachFrom(Self& self, const KEY& lo, const KEY& hi, Fn& fn)
+		{
+			using V = std::conditional_t<std::is_const_v<Self>, const Value, Value>;
+			for (NodeBase* node = self.LowerBoundNode(lo); node && self._comp(KeyOfNode(node), hi); node = Successor(node))
+			{
+				V& value = static_cast<Node*>(node)->value;
+				if constexpr (std::is_same_v<decltype(Visit(fn, value)), bool>)
 				{
-					w->color = Color::Red;
-					x = xParent;
-					xParent = xParent->parent;
+					if (!Visit(fn, value))
+						return;
 				}
 				else
 				{
-					if (IsBlack(w->left))
-					{
-						if (w->right)
-							w->right->color = Color::Black;
-						w->color = Color::Red;
-						RotateLeft(w);
-						w = xParent->left;
-					}
-					w->color = xParent->color;
-					xParent->color = Color::Black;
-					if (w->left)
-						w->left->color = Color::Black;
-					RotateRight(xParent);
-					x = _root;
+					Visit(fn, value);
 				}
 			}
 		}
-		if (x)
-			x->color = Color::Black;
+	};
+}
+
+template<typename KEY, typename VAL, typename Compare = std::less<KEY>, typename Policy = PlainTreePolicy>
+class RBTree : public RBTreeDetail::Tree<KEY, RBTreeEntry<KEY, VAL>, RBTreeDetail::EntryKey, Compare, Policy>
+{
+	using Base = RBTreeDetail::Tree<KEY, RBTreeEntry<KEY, VAL>, RBTreeDetail::EntryKey, Compare, Policy>;
+	using typename Base::Node;
+
+public:
+	using Base::Base;
+
+	VAL* Find(const KEY& key)
+	{
+		RBTreeDetail::NodeBase* node = this->FindNode(key);
+		return node ? &static_cast<Node*>(node)->value.value : nullptr;
+	}
+
+	const VAL* Find(const KEY& key) const
+	{
+		const RBTreeDetail::NodeBase* node = this->FindNode(key);
+		return node ? &static_cast<const Node*>(node)->value.value : nullptr;
+	}
+
+	template<typename K, typename V>
+	bool Insert(K&& key, V&& value)
+	{
+		static_assert(std::is_constructible_v<KEY, K&&>, "RedBlackTree: Invalid key type");
+		static_assert(std::is_constructible_v<VAL, V&&>, "RedBlackTree: Invalid value type");
+
+		RBTreeDetail::NodeBase* parent = nullptr;
+		bool found = false;
+		RBTreeDetail::NodeBase* existing = this->FindInsertPosition(key, parent, found);
+		if (found)
+		{
+			static_cast<Node*>(existing)->value.value = std::forward<V>(value);
+			return false;
+		}
+
+		this->LinkNode(parent, this->NewNode(KEY(std::forward<K>(key)), VAL(std::forward<V>(value))));
+		return true;
+	}
+
+	// Replaces the content with the (key, value) pairs of [first, last) (anything with .first/.second),
+	// which must be strictly increasing by key. O(n), and the nodes end up contiguous in key order.
+	template<typename It>
+	void BuildFromSorted(It first, It last)
+	{
+		this->BuildFrom(first, last, [this](auto&& item) {
+			return this->NewNode(KEY(item.first), VAL(item.second));
+		});
+	}
+};
+
+template<typename KEY, typename Compare, typename Policy>
+class RBTree<KEY, void, Compare, Policy> : public RBTreeDetail::Tree<KEY, const KEY, RBTreeDetail::Identity, Compare, Policy>
+{
+	using Base = RBTreeDetail::Tree<KEY, const KEY, RBTreeDetail::Identity, Compare, Policy>;
+
+	template<typename K>
+	bool EmplaceKey(K&& key)
+	{
+		static_assert(std::is_constructible_v<KEY, K&&>, "RBTree<void>: Invalid key type");
+
+		RBTreeDetail::NodeBase* parent = nullptr;
+		bool found = false;
+		this->FindInsertPosition(key, parent, found);
+		if (found)
+		{
+			return false;
+		}
+
+		this->LinkNode(parent, this->NewNode(std::forward<K>(key)));
+		return true;
+	}
+
+public:
+	using Base::Base;
+
+	bool Insert(const KEY& key)
+	{
+		return EmplaceKey(key);
+	}
+
+	bool Insert(KEY&& key)
+	{
+		return EmplaceKey(std::move(key));
+	}
+
+	// Replaces the content with the keys of [first, last), which must be strictly increasing.
+	// O(n), and the nodes end up contiguous in key order.
+	template<typename It>
+	void BuildFromSorted(It first, It last)
+	{
+		this->BuildFrom(first, last, [this](const auto& key) {
+			return this->NewNode(KEY(key));
+		});
 	}
 };
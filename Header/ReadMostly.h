@@ -0,0 +1,252 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "AppendOwned.h"
+
+// RCU-style holder for data that is read all the time and replaced now and then (configuration,
+// routing tables...). A reader takes a Snapshot: one hazard pointer store and a re-check, no shared
+// counter, no lock, and then reads an immutable T for as long as it holds the snapshot. A writer
+// copies the current value, changes the copy and publishes it with one pointer swap; the old value
+// is freed once no snapshot points at it any more, checked on the next publish and at destruction.
+// Hazard slots belong to threads, shared by every ReadMostly<T> of one T like in LockFreeQueue, each
+// thread with up to kSnapshotsPerThread snapshots alive. The records come in blocks of
+// kRecordsPerBlock; when every record is taken a new block is chained on, so any number of threads
+// may read, and a writer scans only as many records as were ever in use at once. Blocks are kept
+// for the life of the process. A Snapshot has to be released on the thread that took it.
+template<typename T>
+class ReadMostly
+{
+public:
+	static constexpr int kSnapshotsPerThread = 4;
+	static constexpr int kRecordsPerBlock = 64;
+
+private:
+	struct alignas(64) HazardRecord
+	{
+		std::atomic<const T*> slots[kSnapshotsPerThread]{};
+		std::atomic<bool> inUse{ false };
+	};
+
+	struct ThreadState
+	{
+		HazardRecord* record = nullptr;
+		uint32_t usedSlots = 0; // bit per slot taken by a live Snapshot
+
+		ThreadState() : record(AcquireRecord()) {}
+		~ThreadState()
+		{
+			assert(usedSlots == 0 && "ReadMostly: snapshot outlived its thread");
+			record->inUse.store(false, std::memory_order_release);
+		}
+	};
+
+	struct RecordBlock
+	{
+		HazardRecord records[kRecordsPerBlock]{};
+		std::atomic<RecordBlock*> next{ nullptr };
+	};
+
+	static inline RecordBlock _firstBlock{};
+	static inline std::atomic<int> _recordHighWater{ 0 }; // records (counted over the blocks in order) ever taken
+
+	static void RaiseHighWater(int count)
+	{
+		int highWater = _recordHighWater.load(std::memory_order_relaxed);
+		while (highWater < count &&
+			!_recordHighWater.compare_exchange_weak(highWater, count, std::memory_order_acq_rel))
+		{
+		}
+	}
+
+	static HazardRecord* AcquireRecord()
+	{
+		RecordBlock* block = &_firstBlock;
+		for (int first = 0;; first += kRecordsPerBlock)
+		{
+			for (int i = 0; i < kRecordsPerBlock; ++i)
+			{
+				HazardRecord& record = block->records[i];
+				bool expected = false;
+				if (!record.inUse.load(std::memory_order_relaxed) &&
+					record.inUse.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+				{
+					RaiseHighWater(first + i + 1);
+					return &record;
+				}
+			}
+
+			RecordBlock* next = block->next.load(std::memory_order_acquire);
+			if (next == nullptr)
+			{
+				// every record is taken: chain a block whose first record is already ours
+				auto fresh = std::make_unique<RecordBlock>();
+				fresh->records[0].inUse.store(true, std::memory_order_relaxed);
+				if (block->next.compare_exchange_strong(next, fresh.get(), std::memory_order_acq_rel))
+				{
+					RaiseHighWater(first + kRecordsPerBlock + 1);
+					return &fresh.release()->records[0];
+				}
+				// another thread chained one first, 'next' now points at it
+			}
+			block = next;
+		}
+	}
+
+	static ThreadState& Local()
+	{
+		static thread_local ThreadState state;
+		return state;
+	}
+
+	std::atomic<const T*> _current;
+	std::mutex _writeMutex{};
+	std::vector<const T*> _retired{}; // replaced values some snapshot may still read, under _writeMutex
+
+	// frees every retired value no hazard slot points at
+	void Reclaim()
+	{
+		size_t keep = 0;
+		const int records = _recordHighWater.load(std::memory_order_acquire);
+		for (const T* value : _retired)
+		{
+			bool protectedValue = false;
+			const RecordBlock* block = &_firstBlock;
+			for (int i = 0; i < records && !protectedValue; ++i)
+			{
+				if (i > 0 && i % kRecordsPerBlock == 0)
+					block = block->next.load(std::memory_order_acquire);
+				for (auto& slot : block->records[i % kRecordsPerBlock].slots)
+				{
+					if (slot.load(std::memory_order_seq_cst) == value)
+					{
+						protectedValue = true;
+						break;
+					}
+				}
+			}
+			if (protectedValue)
+				_retired[keep++] = value;
+			else
+				delete value;
+		}
+		_retired.resize(keep);
+	}
+
+	void Publish(std::unique_ptr<T> next)
+	{
+		AppendOwned(_retired, [&] { return _current.exchange(next.release(), std::memory_order_seq_cst); });
+		Reclaim();
+	}
+
+public:
+	// a pinned, immutable value; cheap to take, keep it only as long as needed since the value it
+	// pins cannot be freed meanwhile
+	class Snapshot
+	{
+		const T* _value = nullptr;
+		int _slot = -1;
+
+		friend class ReadMostly;
+		Snapshot(const T* value, int slot) : _value(value), _slot(slot) {}
+
+	public:
+		Snapshot(Snapshot&& other) noexcept : _value(std::exchange(other._value, nullptr)), _slot(std::exchange(other._slot, -1)) {}
+		Snapshot& operator= (Snapshot&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Release();
+				_value = std::exchange(other._value, nullptr);
+				_slot = std::exchange(other._slot, -1);
+			}
+			return *this;
+		}
+		Snapshot(const Snapshot&) = delete;
+		Snapshot& operator= (const Snapshot&) = delete;
+		~Snapshot() { Release(); }
+
+		void Release()
+		{
+			if (_slot < 0)
+				return;
+			ThreadState& local = Local();
+			local.record->slots[_slot].store(nullptr, std::memory_order_release);
+			local.usedSlots &= ~(uint32_t(1) << _slot);
+			_slot = -1;
+			_value = nullptr;
+		}
+
+		const T& operator* () const { return *_value; }
+		const T* operator-> () const { return _value; }
+		const T* Get() const { return _value; }
+	};
+
+	// a private copy of the current value, published when the guard goes out of scope; holds off
+	// other writers meanwhile
+	class WriteGuard
+	{
+		ReadMostly& _owner;
+		std::unique_lock<std::mutex> _hold;
+		std::unique_ptr<T> _next;
+
+	public:
+		explicit WriteGuard(ReadMostly& owner) :
+			_owner(owner),
+			_hold(owner._writeMutex),
+			_next(std::make_unique<T>(*owner._current.load(std::memory_order_acquire))) {}
+		~WriteGuard() { _owner.Publish(std::move(_next)); }
+		WriteGuard(const WriteGuard&) = delete;
+		WriteGuard& operator= (const WriteGuard&) = delete;
+
+		T& operator* () { return *_next; }
+		T* operator-> () { return _next.get(); }
+	};
+
+	template<typename ...Args>
+	explicit ReadMostly(Args&&... args) : _current(new T(std::forward<Args>(args)...)) {}
+
+	ReadMostly(const ReadMostly&) = delete;
+	ReadMostly& operator= (const ReadMostly&) = delete;
+
+	// no snapshot of this object may still be alive
+	~ReadMostly()
+	{
+		for (const T* value : _retired)
+			delete value;
+		delete _current.load(std::memory_order_relaxed);
+	}
+
+	Snapshot OnRead() const
+	{
+		ThreadState& local = Local();
+		assert(local.usedSlots != (uint32_t(1) << kSnapshotsPerThread) - 1 && "ReadMostly: too many snapshots on one thread");
+		const int slot = std::countr_one(local.usedSlots);
+		local.usedSlots |= uint32_t(1) << slot;
+
+		std::atomic<const T*>& hazard = local.record->slots[slot];
+		const T* value = _current.load(std::memory_order_acquire);
+		while (true)
+		{
+			hazard.store(value, std::memory_order_seq_cst);
+			const T* again = _current.load(std::memory_order_seq_cst);
+			if (again == value)
+				break;
+			value = again;
+		}
+		return Snapshot(value, slot);
+	}
+
+	WriteGuard OnWrite() { return WriteGuard(*this); }
+
+	void Store(T value)
+	{
+		std::lock_guard<std::mutex> hold(_writeMutex);
+		Publish(std::make_unique<T>(std::move(value)));
+	}
+};
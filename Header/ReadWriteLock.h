@@ -1,5 +1,15 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <shared_mutex>
+#include <thread>
+#include <type_traits>
 
 class ReadWriteLock
 {
@@ -13,4 +23,215 @@ public:
 	{
 		return std::shared_lock<std::shared_mutex>(_lock);
 	}
-};
\ No newline at end of file
+};
+
+// Reader-writer lock for read-mostly data on many cores. Readers count themselves in one of several
+// cache-line sized shards (picked per thread), so concurrent readers on different cores do not
+// bounce a shared counter; a writer raises a flag and waits for every shard to drain, which makes
+// writing O(shards) and much slower than with std::shared_mutex. Writers are preferred: readers that
+// find the flag raised step back and wait. Meets SharedLockable, a read lock has to be released on
+// the thread that took it.
+class ShardedReadWriteLock
+{
+	struct alignas(64) Shard
+	{
+		std::atomic<uint32_t> readers{ 0 };
+	};
+
+	std::unique_ptr<Shard[]> _shards;
+	size_t _mask = 0;
+	alignas(64) std::atomic<bool> _writer{ false };
+	std::mutex _writeMutex{};
+
+	// small dense per-thread numbers, so consecutive threads land on different shards
+	static size_t ThreadSlot()
+	{
+		static std::atomic<size_t> next{ 0 };
+		thread_local const size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+		return slot;
+	}
+
+	Shard& LocalShard() { return _shards[ThreadSlot() & _mask]; }
+
+	// the seq_cst pairs (reader: count up, then load the flag; writer: raise the flag, then load the
+	// counts) make sure that at least one side sees the other
+	static void LeaveShard(Shard& shard, const std::atomic<bool>& writer)
+	{
+		if (shard.readers.fetch_sub(1, std::memory_order_seq_cst) == 1 && writer.load(std::memory_order_seq_cst))
+			shard.readers.notify_all();
+	}
+
+public:
+	// shards 0: one per hardware thread; rounded up to a power of two
+	explicit ShardedReadWriteLock(size_t shards = 0)
+	{
+		if (shards == 0)
+			shards = std::thread::hardware_concurrency();
+		shards = std::bit_ceil(shards == 0 ? size_t(1) : shards);
+		_shards = std::make_unique<Shard[]>(shards);
+		_mask = shards - 1;
+	}
+
+	ShardedReadWriteLock(const ShardedReadWriteLock&) = delete;
+	ShardedReadWriteLock& operator= (const ShardedReadWriteLock&) = delete;
+
+	std::unique_lock<ShardedReadWriteLock> OnWrite()
+	{
+		return std::unique_lock<ShardedReadWriteLock>(*this);
+	}
+	std::shared_lock<ShardedReadWriteLock> OnRead()
+	{
+		return std::shared_lock<ShardedReadWriteLock>(*this);
+	}
+
+	void lock_shared()
+	{
+		Shard& shard = LocalShard();
+		while (true)
+		{
+			shard.readers.fetch_add(1, std::memory_order_seq_cst);
+			if (!_writer.load(std::memory_order_seq_cst))
+				return;
+			LeaveShard(shard, _writer);
+			_writer.wait(true, std::memory_order_acquire);
+		}
+	}
+
+	bool try_lock_shared()
+	{
+		Shard& shard = LocalShard();
+		shard.readers.fetch_add(1, std::memory_order_seq_cst);
+		if (!_writer.load(std::memory_order_seq_cst))
+			return true;
+		LeaveShard(shard, _writer);
+		return false;
+	}
+
+	void unlock_shared()
+	{
+		LeaveShard(LocalShard(), _writer);
+	}
+
+	void lock()
+	{
+		_writeMutex.lock();
+		_writer.store(true, std::memory_order_seq_cst);
+		for (size_t i = 0; i <= _mask; i++)
+		{
+			uint32_t readers = _shards[i].readers.load(std::memory_order_seq_cst);
+			while (readers != 0)
+			{
+				_shards[i].readers.wait(readers, std::memory_order_acquire);
+				readers = _shards[i].readers.load(std::memory_order_seq_cst);
+			}
+		}
+	}
+
+	bool try_lock()
+	{
+		if (!_writeMutex.try_lock())
+			return false;
+		_writer.store(true, std::memory_order_seq_cst);
+		for (size_t i = 0; i <= _mask; i++)
+		{
+			if (_shards[i].readers.load(std::memory_order_seq_cst) != 0)
+			{
+				unlock();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void unlock()
+	{
+		_writer.store(false, std::memory_order_release);
+		_writer.notify_all();
+		_writeMutex.unlock();
+	}
+};
+
+// Sequence lock for small trivially copyable values: readers never write shared memory, they copy
+// the value and retry if a writer was active meanwhile, so reads scale with cores but may spin while
+// a write is in progress. The value is kept as relaxed atomic words, which keeps the optimistic copy
+// free of data races. Writers are serialized by a mutex.
+template<typename T>
+class SeqLock
+{
+	static_assert(std::is_trivially_copyable_v<T>, "SeqLock: T must be trivially copyable");
+
+	static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	alignas(64) std::atomic<uint64_t> _sequence{ 0 }; // odd while a write is in progress
+	std::atomic<uint64_t> _words[kWords]{};
+	std::mutex _writeMutex{};
+
+	void Publish(const T& value)
+	{
+		uint64_t words[kWords]{};
+		std::memcpy(words, &value, sizeof(T));
+
+		const uint64_t sequence = _sequence.load(std::memory_order_relaxed);
+		_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < kWords; i++)
+			_words[i].store(words[i], std::memory_order_relaxed);
+		_sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+public:
+	// publishes the copy it hands out when it goes out of scope; holds off other writers meanwhile
+	class WriteGuard
+	{
+		SeqLock& _owner;
+		std::unique_lock<std::mutex> _hold;
+		T _value;
+
+	public:
+		explicit WriteGuard(SeqLock& owner) : _owner(owner), _hold(owner._writeMutex), _value(owner.Load()) {}
+		~WriteGuard() { _owner.Publish(_value); }
+		WriteGuard(const WriteGuard&) = delete;
+		WriteGuard& operator= (const WriteGuard&) = delete;
+
+		T& operator* () { return _value; }
+		T* operator-> () { return &_value; }
+	};
+
+	SeqLock() requires std::is_default_constructible_v<T> : SeqLock(T{}) {}
+	explicit SeqLock(const T& value) { Publish(value); }
+
+	SeqLock(const SeqLock&) = delete;
+	SeqLock& operator= (const SeqLock&) = delete;
+
+	T Load() const
+	{
+		uint64_t words[kWords];
+		while (true)
+		{
+			const uint64_t before = _sequence.load(std::memory_order_acquire);
+			if (before & 1)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			for (size_t i = 0; i < kWords; i++)
+				words[i] = _words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (_sequence.load(std::memory_order_relaxed) == before)
+				break;
+		}
+		std::array<unsigned char, sizeof(T)> bytes;
+		std::memcpy(bytes.data(), words, sizeof(T));
+		return std::bit_cast<T>(bytes);
+	}
+
+	void Store(const T& value)
+	{
+		std::lock_guard<std::mutex> hold(_writeMutex);
+		Publish(value);
+	}
+
+	// a consistent copy
+	T OnRead() const { return Load(); }
+	WriteGuard OnWrite() { return WriteGuard(*this); }
+};
@@ -3,33 +3,57 @@
 #include <atomic>
 #include <cstddef>
 #include <memory>
+#include <iterator>
 #include <new>
+#include <span>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
+#include "Instrumentation.h"
 
-template <typename T>
+// Single producer / single consumer ring. Each side keeps a private copy of the other side's index and
+// only reloads it (an acquire load that pulls the other side's cache line) when the copy says the ring
+// is full, or empty, for the request at hand.
+// HighThroughput rounds the slot count up to a power of two so index wrapping is a mask; Capacity()
+// then reports the rounded value.
+template <typename T, bool HighThroughput = false>
 class SPSCRingBuffer
 {
 private:
     using StorageType = std::aligned_storage_t<sizeof(T), alignof(T)>;
+    static_assert(sizeof(StorageType) == sizeof(T), "slots must be addressable as a T array");
 
     const std::size_t _capacity;
     const std::size_t _bufferSize;
+    const std::size_t _mask;
     std::unique_ptr<StorageType[]> _buffer;
 
     alignas(64) std::atomic<std::size_t> _head;
+    std::size_t _cachedTail; // producer only
     alignas(64) std::atomic<std::size_t> _tail;
+    std::size_t _cachedHead; // consumer only
 
 private:
-    std::size_t NextIndex(std::size_t index) const
+    static std::size_t SlotCount(std::size_t capacity)
     {
-        ++index;
-        if (index == _bufferSize)
+        if constexpr (HighThroughput)
+        {
+            std::size_t size = 2;
+            while (size < capacity + 1)
+            {
+                size <<= 1;
+            }
+            return size;
+        }
+        else
         {
-            index = 0;
+            return capacity + 1;
         }
-        return index;
+    }
+
+    std::size_t NextIndex(std::size_t index) const
+    {
+        return Advance(index, 1);
     }
 
     T* Slot(std::size_t index)
@@ -42,15 +66,80 @@ private:
         return std::launder(reinterpret_cast<const T*>(&_buffer[index]));
     }
 
+    // uninitialized slots; only placement new may touch them
+    T* RawSlot(std::size_t index)
+    {
+        return reinterpret_cast<T*>(&_buffer[index]);
+    }
+
+    // free slots from 'head' up to the wrap point, at most 'count'
+    std::size_t ContiguousFree(std::size_t head, std::size_t tail, std::size_t count) const
+    {
+        const std::size_t limit = tail > head ? tail - 1 - head : _bufferSize - head - (tail == 0 ? 1 : 0);
+        return limit < count ? limit : count;
+    }
+
+    // filled slots from 'tail' up to the wrap point, at most 'count'
+    std::size_t ContiguousFilled(std::size_t head, std::size_t tail, std::size_t count) const
+    {
+        const std::size_t limit = head >= tail ? head - tail : _bufferSize - tail;
+        return limit < count ? limit : count;
+    }
+
+    std::size_t Advance(std::size_t index, std::size_t count) const
+    {
+        index += count;
+        if constexpr (HighThroughput)
+        {
+            return index & _mask;
+        }
+        else
+        {
+            if (index >= _bufferSize)
+            {
+                index -= _bufferSize;
+            }
+            return index;
+        }
+    }
+
+    std::size_t Filled(std::size_t head, std::size_t tail) const
+    {
+        return head >= tail ? head - tail : _bufferSize - (tail - head);
+    }
+
+    // producer side view of the consumer index, reloaded only when fewer than 'needed' slots look free
+    std::size_t TailFor(std::size_t head, std::size_t needed)
+    {
+        if (_bufferSize - 1 - Filled(head, _cachedTail) < needed)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+        }
+        return _cachedTail;
+    }
+
+    // consumer side view of the producer index, reloaded only when fewer than 'needed' elements look available
+    std::size_t HeadFor(std::size_t tail, std::size_t needed)
+    {
+        if (Filled(_cachedHead, tail) < needed)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+        }
+        return _cachedHead;
+    }
+
 public:
     explicit SPSCRingBuffer(std::size_t capacity)
-        : _capacity(capacity),
-          _bufferSize(capacity + 1),
+        : _capacity(SlotCount(capacity) - 1),
+          _bufferSize(_capacity + 1),
+          _mask(_bufferSize - 1),
           _buffer(std::make_unique<StorageType[]>(_bufferSize)),
           _head(0),
-          _tail(0)
+          _cachedTail(0),
+          _tail(0),
+          _cachedHead(0)
     {
-        if (_capacity == 0)
+        if (capacity == 0)
         {
             throw std::invalid_argument("SPSCRingBuffer capacity must be greater than 0");
         }
@@ -78,8 +167,9 @@ public:
     {
         const std::size_t head = _head.load(std::memory_order_relaxed);
         const std::size_t next = NextIndex(head);
-        if (next == _tail.load(std::memory_order_acquire))
+        if (next == TailFor(head, 1))
         {
+            INSTRUMENT_COUNT(RingFullRetries);
             return false;
         }
 
@@ -101,8 +191,9 @@ public:
     bool TryPop(T& out)
     {
         const std::size_t tail = _tail.load(std::memory_order_relaxed);
-        if (tail == _head.load(std::memory_order_acquire))
+        if (tail == HeadFor(tail, 1))
         {
+            INSTRUMENT_COUNT(RingEmptyRetries);
             return false;
         }
 
@@ -113,6 +204,127 @@ public:
         return true;
     }
 
+    // Pushes up to 'count' elements constructed from *first, *(first + 1), ... and publishes them with a
+    // single store, so the consumer sees the whole run at once. Returns how many were pushed, which is
+    // less than 'count' when the ring fills up. Pass a move iterator to move the elements in.
+    template <typename InputIt>
+    std::size_t TryPushBulk(InputIt first, std::size_t count)
+    {
+        const std::size_t head = _head.load(std::memory_order_relaxed);
+        const std::size_t tail = TailFor(head, count);
+
+        std::size_t pushed = 0;
+        std::size_t index = head;
+        for (int part = 0; part < 2 && pushed < count; ++part)
+        {
+            const std::size_t run = ContiguousFree(index, tail, count - pushed);
+            for (std::size_t i = 0; i < run; ++i, ++first)
+            {
+                new (&_buffer[index + i]) T(*first);
+            }
+            pushed += run;
+            index = Advance(index, run);
+            if (run == 0 || index != 0)
+            {
+                break;
+            }
+        }
+
+        if (pushed > 0)
+        {
+            _head.store(index, std::memory_order_release);
+        }
+        else if (count > 0)
+        {
+            INSTRUMENT_COUNT(RingFullRetries);
+        }
+        return pushed;
+    }
+
+    // Moves up to 'maxCount' elements to 'out' (an output iterator, e.g. a pointer or std::back_inserter)
+    // and frees their slots with a single store. Returns how many were popped.
+    template <typename OutputIt>
+    std::size_t TryPopBulk(OutputIt out, std::size_t maxCount)
+    {
+        const std::size_t tail = _tail.load(std::memory_order_relaxed);
+        const std::size_t head = HeadFor(tail, maxCount);
+
+        std::size_t popped = 0;
+        std::size_t index = tail;
+        for (int part = 0; part < 2 && popped < maxCount; ++part)
+        {
+            const std::size_t run = ContiguousFilled(head, index, maxCount - popped);
+            for (std::size_t i = 0; i < run; ++i)
+            {
+                T* element = Slot(index + i);
+                *out = std::move(*element);
+                ++out;
+                element->~T();
+            }
+            popped += run;
+            index = Advance(index, run);
+            if (run == 0 || index != 0)
+            {
+                break;
+            }
+        }
+
+        if (popped > 0)
+        {
+            _tail.store(index, std::memory_order_release);
+        }
+        else if (maxCount > 0)
+        {
+            INSTRUMENT_COUNT(RingEmptyRetries);
+        }
+        return popped;
+    }
+
+    // Producer side zero-copy write: returns up to 'count' contiguous free slots, possibly fewer (or none)
+    // when the ring is nearly full or the free space wraps around. The slots are raw storage; construct
+    // elements in place with new (&span[i]) T(...) and publish the first n of them with Commit(n).
+    std::span<T> Reserve(std::size_t count)
+    {
+        const std::size_t head = _head.load(std::memory_order_relaxed);
+        if (ContiguousFree(head, _cachedTail, count) < count)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+        }
+        return std::span<T>(RawSlot(head), ContiguousFree(head, _cachedTail, count));
+    }
+
+    // publishes 'count' elements constructed in the span returned by the last Reserve
+    void Commit(std::size_t count)
+    {
+        const std::size_t head = _head.load(std::memory_order_relaxed);
+        _head.store(Advance(head, count), std::memory_order_release);
+    }
+
+    // Consumer side zero-copy read: returns up to 'maxCount' contiguous elements without removing them.
+    // When the filled part wraps around only the run up to the end of the buffer is returned; Release
+    // it and Peek again for the rest.
+    std::span<T> Peek(std::size_t maxCount = static_cast<std::size_t>(-1))
+    {
+        const std::size_t tail = _tail.load(std::memory_order_relaxed);
+        if (ContiguousFilled(_cachedHead, tail, maxCount) < maxCount)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+        }
+        const std::size_t run = ContiguousFilled(_cachedHead, tail, maxCount);
+        return std::span<T>(run > 0 ? Slot(tail) : RawSlot(tail), run);
+    }
+
+    // destroys the first 'count' elements of the span returned by the last Peek and frees their slots
+    void Release(std::size_t count)
+    {
+        const std::size_t tail = _tail.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            Slot(tail + i)->~T();
+        }
+        _tail.store(Advance(tail, count), std::memory_order_release);
+    }
+
     bool Empty() const
     {
         return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
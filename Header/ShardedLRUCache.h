@@ -0,0 +1,189 @@
+#pragma once
+#include <assert.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "LRUCache.h"
+
+// Thread-safe LRUCache: keys are hashed over a power-of-two number of shards, every shard is an
+// independent LRUCache behind its own mutex, so Get on different shards never contends.
+// Handles keep the LRUCache pinning semantics: a pinned entry is never evicted, and releasing the
+// handle re-locks its shard. Accessing the value through a handle is not synchronized, exactly like
+// sharing a value of a plain LRUCache between threads.
+// TTLs are not offered here: TimerWheel is single threaded and would need its own lock per shard.
+template<typename KEY, typename VAL, class ValueDeleter = DefaultValueDeleter<VAL>, class Hash = std::hash<KEY>,
+	class Policy = LRUPolicy, class Weigher = UnitWeigher>
+class ShardedLRUCache
+{
+	using Cache = LRUCache<KEY, VAL, ValueDeleter, Hash, std::equal_to<KEY>, Policy, Weigher>;
+
+	struct alignas(64) Shard
+	{
+		std::mutex mutex;
+		Cache cache;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+
+		explicit Shard(size_t capacity) : cache(capacity) {}
+	};
+
+public:
+	struct Stats
+	{
+		size_t size = 0;
+		size_t weight = 0;
+		size_t capacity = 0;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+	};
+
+	class Handle
+	{
+		friend class ShardedLRUCache;
+
+		Shard* _shard = nullptr;
+		std::optional<typename Cache::Handle> _inner{};
+
+		Handle() = default;
+		Handle(Shard* shard, typename Cache::Handle&& inner) : _shard(shard)
+		{
+			if (inner.IsValid())
+				_inner.emplace(std::move(inner));
+		}
+
+		void Reset()
+		{
+			if (_inner.has_value())
+			{
+				std::lock_guard<std::mutex> lock(_shard->mutex);
+				_inner.reset(); // unpins the node, which relinks the shard lists
+			}
+			_shard = nullptr;
+		}
+
+	public:
+		~Handle()
+		{
+			Reset();
+		}
+
+		Handle(const Handle&) = delete;
+		Handle& operator= (const Handle&) = delete;
+		Handle& operator= (Handle&&) noexcept = delete;
+
+		Handle(Handle&& other) noexcept :
+			_shard(std::exchange(other._shard, nullptr)), _inner(std::move(other._inner))
+		{
+			other._inner.reset();
+		}
+
+		bool IsValid() const { return _inner.has_value() && _inner->IsValid(); }
+
+		VAL& Get()
+		{
+			assert(IsValid());
+			return _inner->Get();
+		}
+	};
+
+private:
+	std::vector<std::unique_ptr<Shard>> _shards;
+	size_t _shardShift;
+	size_t _shardCapacity;
+	Hash _hash;
+
+	static size_t RoundUpPow2(size_t n)
+	{
+		size_t p = 1;
+		while (p < n) p <<= 1;
+		return p;
+	}
+
+	// std::hash is the identity for integers on the usual standard libraries, so mix before taking the top bits
+	Shard& ShardFor(const KEY& k) const
+	{
+		const uint64_t mixed = static_cast<uint64_t>(_hash(k)) * 0x9E3779B97F4A7C15ull;
+		const size_t index = _shardShift >= 64 ? 0 : static_cast<size_t>(mixed >> _shardShift);
+		return *_shards[index];
+	}
+
+public:
+	// totalCapacity is split evenly (rounded up), shardCount is rounded up to a power of two
+	ShardedLRUCache(size_t totalCapacity, size_t shardCount = 16)
+	{
+		const size_t count = RoundUpPow2(shardCount == 0 ? 1 : shardCount);
+		size_t bits = 0;
+		while ((size_t(1) << bits) < count) bits++;
+		_shardShift = 64 - bits;
+		_shardCapacity = (totalCapacity + count - 1) / count;
+		for (size_t i = 0; i < count; i++)
+			_shards.emplace_back(std::make_unique<Shard>(_shardCapacity));
+	}
+
+	ShardedLRUCache(const ShardedLRUCache&) = delete;
+	ShardedLRUCache& operator= (const ShardedLRUCache&) = delete;
+	ShardedLRUCache& operator= (ShardedLRUCache&&) noexcept = delete;
+	ShardedLRUCache(ShardedLRUCache&& other) noexcept = delete;
+
+	Handle Get(const KEY& k)
+	{
+		Shard& shard = ShardFor(k);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		typename Cache::Handle inner = shard.cache.Get(k);
+		if (inner.IsValid())
+			shard.hits++;
+		else
+			shard.misses++;
+		return Handle(&shard, std::move(inner));
+	}
+
+	template <typename V>
+	Handle Put(const KEY& k, V&& v)
+	{
+		static_assert(std::is_constructible_v<VAL, V&&>, "ShardedLRUCache: Invalid Put Arg Type");
+
+		Shard& shard = ShardFor(k);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		return Handle(&shard, shard.cache.Put(k, std::forward<V>(v)));
+	}
+
+	size_t ShardCount() const { return _shards.size(); }
+	size_t Capacity() const { return _shardCapacity * _shards.size(); }
+	size_t ShardCapacity() const { return _shardCapacity; }
+
+	Stats GetShardStats(size_t index) const
+	{
+		Shard& shard = *_shards[index];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		return Stats{
+			static_cast<size_t>(shard.cache.Size()),
+			shard.cache.Weight(),
+			shard.cache.Capacity(),
+			shard.hits,
+			shard.misses,
+			shard.cache.EvictionCount() };
+	}
+
+	// sum over all shards, each shard is read under its own lock so the total is not one atomic snapshot
+	Stats GetStats() const
+	{
+		Stats total;
+		for (size_t i = 0; i < _shards.size(); i++)
+		{
+			const Stats s = GetShardStats(i);
+			total.size += s.size;
+			total.weight += s.weight;
+			total.capacity += s.capacity;
+			total.hits += s.hits;
+			total.misses += s.misses;
+			total.evictions += s.evictions;
+		}
+		return total;
+	}
+};
@@ -1,7 +1,9 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <future>
+#include <memory>
 #include <vector>
-#include <queue>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -9,45 +11,113 @@
 #include <stdexcept>
 #include <type_traits>
 #include <assert.h>
+#include "InplaceFunction.h"
+#include "Instrumentation.h"
+#include "PoolAllocator.h"
+#include "WaitableQueue.h"
 
 class ThreadPool
 {
+public:
+	enum class Mode : uint8_t
+	{
+		GlobalQueue,	// every worker shares one queue behind one lock
+		WorkStealing	// one deque per worker, idle workers steal from the others
+	};
+
+	// move-only, callables up to kTaskInlineBytes are stored inline, bigger ones go to SizeClassPool
+	static constexpr size_t kTaskInlineBytes = 48;
+	using Task = InplaceFunction<void(), kTaskInlineBytes>;
+
+private:
+	// growable circular buffer: once it reached its high-water mark, push/pop never allocate
+	class TaskRing
+	{
+		std::vector<Task> _slots = std::vector<Task>(kInitialCapacity);
+		size_t _head = 0;
+		size_t _count = 0;
+
+		static constexpr size_t kInitialCapacity = 64;
+
+		size_t Mask() const { return _slots.size() - 1; }
+
+		void Grow()
+		{
+			std::vector<Task> slots(_slots.size() * 2);
+			for (size_t i = 0; i < _count; i++)
+				slots[i] = std::move(_slots[(_head + i) & Mask()]);
+			_slots.swap(slots);
+			_head = 0;
+		}
+
+	public:
+		bool Empty() const { return _count == 0; }
+		size_t Size() const { return _count; }
+
+		void PushBack(Task&& task)
+		{
+			if (_count == _slots.size())
+				Grow();
+			_slots[(_head + _count) & Mask()] = std::move(task);
+			_count++;
+		}
+
+		Task PopFront()
+		{
+			assert(_count > 0);
+			Task task = std::move(_slots[_head]);
+			_head = (_head + 1) & Mask();
+			_count--;
+			return task;
+		}
+
+		Task PopBack()
+		{
+			assert(_count > 0);
+			_count--;
+			return std::move(_slots[(_head + _count) & Mask()]);
+		}
+	};
+
+	// owner pushes/pops at the back (LIFO, cache friendly), thieves take from the front
+	struct alignas(64) WorkerQueue
+	{
+		std::mutex mutex;
+		TaskRing tasks;
+	};
+
 	// jthread is better, it is more "RAII", but since this code runs OK, I will not upgrade for now...
 	std::vector<std::thread> _threads{};
-	std::queue<std::function<void()>> _tasks{};
+	TaskRing _tasks{};
+	std::vector<std::unique_ptr<WorkerQueue>> _localQueues{};
+	std::atomic<size_t> _pendingTasks{ 0 };
+	std::atomic<size_t> _nextQueue{ 0 };
+	EventCount _workAvailable{}; // idle WorkStealing workers park here
 	std::mutex _mutex;
 	std::condition_variable _cond;
-	bool _isDead = false;
+	std::atomic<bool> _isDead{ false };
+	Mode _mode;
+
+	static inline thread_local ThreadPool* _currentPool = nullptr;
+	static inline thread_local size_t _currentWorker = 0;
+
 public:
 	static ThreadPool& Inst() { static ThreadPool inst(3); return inst; }
-	ThreadPool(size_t threadMax)
+	// threadMax 0 starts no thread, Post and EnqueueTask then run the task on the calling thread
+	ThreadPool(size_t threadMax, Mode mode = Mode::GlobalQueue) : _mode(mode)
 	{
-		for (int i = 0; i < threadMax; i++)
+		if (_mode == Mode::WorkStealing)
 		{
-			_threads.emplace_back(std::thread([this]()
-				{
-					while (true)
-					{
-						std::function<void()> task;
-						{
-							std::unique_lock<std::mutex> lock(_mutex);
-							_cond.wait(lock, [this]() { return _isDead || !_tasks.empty(); });
-							if (_isDead && _tasks.empty()) return;
-							task = std::move(_tasks.front());
-							_tasks.pop();
-						}
-						try {
-							if (task) {
-								task(); // operate packaged_task; store exception to std::future if any
-							}
-						} catch (const std::exception& e) {
-							// thread pool failure, not task failure
-							fprintf(stderr, "ThreadPool Task Exception: %s\n", e.what());
-						} catch (...) {
-							fprintf(stderr, "ThreadPool Unknown Exception occurred.\n");
-						}
-					}
-				}));
+			for (size_t i = 0; i < threadMax; i++)
+				_localQueues.emplace_back(std::make_unique<WorkerQueue>());
+		}
+
+		for (size_t i = 0; i < threadMax; i++)
+		{
+			if (_mode == Mode::WorkStealing)
+				_threads.emplace_back(std::thread([this, i]() { StealingWorkerLoop(i); }));
+			else
+				_threads.emplace_back(std::thread([this]() { GlobalWorkerLoop(); }));
 		}
 	}
 
@@ -58,41 +128,176 @@ public:
 			_isDead = true;
 		}
 		_cond.notify_all();
+		_workAvailable.NotifyAll();
 		for (auto& t : _threads) t.join();
 	}
 
+	Mode GetMode() const { return _mode; }
+	size_t WorkerCount() const { return _threads.size(); }
+
 	//template<class F, class ...Args>
 	//std::future<typename std::invoke_result_t<F, Args...>> EnqueueTask(
 	//F&& f, Args&&... args) // old fashion
-	template<class F, class ...Args> requires std::invocable<F, Args...> 
+	template<class F, class ...Args> requires std::invocable<F, Args...>
 	auto EnqueueTask(F&& f, Args&&... args)
 	{
 		using RetType = typename std::invoke_result_t<F, Args...>;
-		std::shared_ptr<std::packaged_task<RetType()>> task = std::make_shared<std::packaged_task<RetType()>>(
-			//std::bind(std::forward<F>(f), std::forward<Args>(args)...) // old fashion
-			std::bind_front(std::forward<F>(f), std::forward<Args>(args)...)
-			);
-		std::future<RetType> ret = task->get_future();
+		// packaged_task lost its allocator support, a pooled promise gives the same future without the heap
+		std::promise<RetType> promise(std::allocator_arg, PoolAllocator<char>());
+		std::future<RetType> ret = promise.get_future();
+		PushTask(Task([promise = std::move(promise),
+			//fn = std::bind(std::forward<F>(f), std::forward<Args>(args)...) // old fashion
+			fn = std::bind_front(std::forward<F>(f), std::forward<Args>(args)...)]() mutable
+			{
+				try {
+					if constexpr (std::is_void_v<RetType>) {
+						fn();
+						promise.set_value();
+					} else {
+						promise.set_value(fn());
+					}
+				} catch (...) {
+					promise.set_exception(std::current_exception()); // store exception to std::future
+				}
+			}));
+		return ret;
+	}
+
+	// fire-and-forget: no future, no shared state, small callables make zero heap allocations
+	template<class F, class ...Args> requires std::invocable<F, Args...>
+	void Post(F&& f, Args&&... args)
+	{
+		if constexpr (sizeof...(Args) == 0)
 		{
-			std::unique_lock<std::mutex> lock(_mutex);
-			if (_isDead) assert(false && "ThreadPool::EnqueueTask error: this should never happen!");
-			_tasks.emplace([task = std::move(task)]() { (*task)(); });
-		}
-		
-		/*
-		// another way of doing this, same as bind
-		auto task = [f = std::forward<F>(f), ...args = std::forward<Args>(args)]() mutable {
-			std::invoke(std::move(f), std::move(args)...);
-		};
-		std::future<RetType> ret = task->get_future();
+			PushTask(Task(std::forward<F>(f)));
+		}
+		else
 		{
-			std::unique_lock<std::mutex> lock(_mutex);
-			_tasks.emplace();
+			PushTask(Task([f = std::forward<F>(f), ...args = std::forward<Args>(args)]() mutable {
+				std::invoke(std::move(f), std::move(args)...);
+			}));
+		}
+	}
+
+private:
+	static void RunTask(Task& task)
+	{
+		try {
+			if (task) {
+				task(); // EnqueueTask stores its exception to std::future, only Post tasks can throw here
+			}
+		} catch (const std::exception& e) {
+			// thread pool failure, not task failure
+			fprintf(stderr, "ThreadPool Task Exception: %s\n", e.what());
+		} catch (...) {
+			fprintf(stderr, "ThreadPool Unknown Exception occurred.\n");
+		}
+	}
+
+	void PushTask(Task&& task)
+	{
+		// a pool without workers (threadMax 0) runs every task on the caller
+		if (_threads.empty())
+		{
+			assert(!_isDead && "ThreadPool::EnqueueTask error: this should never happen!");
+			RunTask(task);
+			return;
+		}
+
+		if (_mode == Mode::GlobalQueue)
+		{
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				if (_isDead) assert(false && "ThreadPool::EnqueueTask error: this should never happen!");
+				_tasks.PushBack(std::move(task));
+			}
+			_cond.notify_one();
+			return;
+		}
+
+		assert(!_isDead && "ThreadPool::EnqueueTask error: this should never happen!");
+		// tasks spawned by a worker stay on its own deque, outside submissions are spread round robin
+		const size_t target = (_currentPool == this) ?
+			_currentWorker :
+			_nextQueue.fetch_add(1, std::memory_order_relaxed) % _localQueues.size();
+		{
+			WorkerQueue& queue = *_localQueues[target];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.PushBack(std::move(task));
+		}
+
+		// no syscall, and no lock, unless a worker is parked
+		_pendingTasks.fetch_add(1, std::memory_order_release);
+		_workAvailable.NotifyOne();
+	}
+
+	void GlobalWorkerLoop()
+	{
+		while (true)
+		{
+			Task task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_cond.wait(lock, [this]() { return _isDead || !_tasks.Empty(); });
+				if (_isDead && _tasks.Empty()) return;
+				task = _tasks.PopFront();
+			}
+			RunTask(task);
+		}
+	}
+
+	bool TryPopLocal(size_t index, Task& out)
+	{
+		WorkerQueue& queue = *_localQueues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.Empty()) return false;
+		out = queue.tasks.PopBack();
+		return true;
+	}
+
+	bool TrySteal(size_t thief, Task& out)
+	{
+		const size_t count = _localQueues.size();
+		for (size_t offset = 1; offset < count; offset++)
+		{
+			WorkerQueue& victim = *_localQueues[(thief + offset) % count];
+			std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+			if (!lock.owns_lock() || victim.tasks.Empty()) continue;
+			out = victim.tasks.PopFront();
+			INSTRUMENT_COUNT(ThreadPoolSteals);
+			return true;
+		}
+		return false;
+	}
+
+	void StealingWorkerLoop(size_t index)
+	{
+		_currentPool = this;
+		_currentWorker = index;
+		while (true)
+		{
+			Task task;
+			if (TryPopLocal(index, task) || TrySteal(index, task))
+			{
+				_pendingTasks.fetch_sub(1, std::memory_order_relaxed);
+				RunTask(task);
+				continue;
+			}
+
+			// a task may be pushed between the failed scan and the park, re-check after registering
+			const EventCount::Key key = _workAvailable.PrepareWait();
+			if (_pendingTasks.load(std::memory_order_acquire) > 0)
+			{
+				_workAvailable.CancelWait();
+				continue;
+			}
+			if (_isDead)
+			{
+				_workAvailable.CancelWait();
+				return;
+			}
+			_workAvailable.Wait(key);
 		}
-		*/
-			
-		_cond.notify_one();
-		return ret;
 	}
 };
 
@@ -1,13 +1,42 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <coroutine>
+#include <cstddef>
 #include <cstdint>
-#include <functional>
-#include <list>
-#include <unordered_map>
+#include <limits>
+#include <memory>
+#include <memory_resource>
 #include <utility>
 #include <vector>
-
+#include "AppendOwned.h"
+#include "InplaceFunction.h"
+#include "MPMCRingBuffer.h"
+#include "PoolAllocator.h"
+#include "ThreadPool.h"
+
+// Single threaded timer wheel driven by AdvanceByElapsedMs.
+// With one level (the default) a timer further away than one revolution waits in its slot and is
+// looked at once per revolution until it is due. With more levels the wheel is hierarchical: level L
+// has the same slotCount slots, each covering slotCount^L ticks, a timer is placed on the coarsest
+// level its delay needs and cascades one level down each time the wheel reaches its slot, so it is
+// touched at most once per level. Delays beyond the top level's span wait there as in the flat wheel.
+// AdvanceByElapsedMs jumps straight over ticks in which no slot holds a timer.
+// Timers live in pooled nodes linked into their slot by index, and a handle is the node index plus a
+// generation that changes whenever the node is released, so scheduling, cancelling and firing do not
+// allocate once the pool has grown to the peak number of pending timers, and a stale handle is
+// rejected in O(1). A repeating timer keeps its node and its callback for its whole life. The node
+// chunks come from the std::pmr::memory_resource given at construction.
+// Everything above belongs to the thread that drives the wheel. Other threads use the Post* calls,
+// which push a command into a bounded lock-free inbox (given a capacity at construction) that the
+// owner drains at the start of every AdvanceByElapsedMs; a posted delay counts from that drain.
+// A posted timer is found by its handle through an open addressing table of node indices whose keys
+// live in the nodes, so it costs no allocation of its own either.
+// With SetCallbackDispatch, due callbacks of timers scheduled with the *Dispatched calls are handed to
+// a ThreadPool in batches instead of running on the tick thread; every other callback still runs on
+// the tick thread, so owner-thread code such as the LRUCache TTL expiry is never moved off it.
 class TimerWheel
 {
 public:
@@ -34,130 +63,321 @@ public:
 		uint32_t _delayMs = 0;
 	};
 
-	using Callback = std::function<void()>;
+	// move-only; captures up to 48 bytes are stored in the timer node itself
+	using Callback = InplaceFunction<void()>;
 
 	TimerWheel() = delete;
-	TimerWheel(uint32_t tickMs, uint32_t slotCount);
+	// levels is capped where slotCount^levels ticks would overflow 64 bits; inboxCapacity 0 leaves
+	// the Post* calls disabled
+	TimerWheel(uint32_t tickMs, uint32_t slotCount, uint32_t levels = 1, size_t inboxCapacity = 0,
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+	~TimerWheel();
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator= (const TimerWheel&) = delete;
 
 	TimerHandle ScheduleOnce(uint32_t delayMs, Callback cb);
+	// the callback runs on the SetCallbackDispatch pool (inline while none is set), so it must not
+	// touch state that belongs to the tick thread
+	TimerHandle ScheduleOnceDispatched(uint32_t delayMs, Callback cb);
 	TimerHandle ScheduleEvery(uint32_t intervalMs, Callback cb);
+	// a timer may cancel itself, or any other timer, from inside a callback
 	void Cancel(TimerHandle handle);
 
+	// any thread; an invalid handle means the inbox is full (or disabled) and nothing was posted.
+	// The handle works with Cancel and PostCancel once this call returned.
+	TimerHandle PostScheduleOnce(uint32_t delayMs, Callback cb) { return PostSchedule(CommandKind::ScheduleOnce, delayMs, std::move(cb)); }
+	TimerHandle PostScheduleOnceDispatched(uint32_t delayMs, Callback cb) { return PostSchedule(CommandKind::ScheduleOnceDispatched, delayMs, std::move(cb)); }
+	TimerHandle PostScheduleEvery(uint32_t intervalMs, Callback cb) { return PostSchedule(CommandKind::ScheduleEvery, intervalMs, std::move(cb)); }
+	// any thread; false when the inbox is full (or disabled)
+	bool PostCancel(TimerHandle handle);
+
+	// callbacks of *Dispatched timers that come due are moved into batches of batchSize and posted to
+	// the pool, each batch as one task, the last partial batch when AdvanceByElapsedMs returns; other
+	// timers, repeating ones and coroutines still run inline. nullptr runs everything inline again.
+	// The pool has to outlive the wheel.
+	void SetCallbackDispatch(ThreadPool* pool, size_t batchSize = 32);
+
 	void AdvanceByElapsedMs(uint32_t elapsedMs);
 	SleepAwaiter SleepFor(uint32_t delayMs) { return SleepAwaiter(*this, delayMs); }
 
 	uint32_t GetTickMs() const { return _tickMs; }
-	uint32_t GetSlotCount() const { return static_cast<uint32_t>(_slots.size()); }
+	uint32_t GetSlotCount() const { return _slotCount; }
+	uint32_t GetLevelCount() const { return _levels; }
+	size_t GetPendingCount() const { return _pending; }
 
 private:
+	static constexpr uint32_t kNil = std::numeric_limits<uint32_t>::max();
+	static constexpr uint32_t kChunkShift = 10;
+	static constexpr uint32_t kChunkNodes = uint32_t(1) << kChunkShift;
+	static constexpr uint32_t kMaxGeneration = (uint32_t(1) << 31) - 1;
+	static constexpr uint64_t kPostedIdBit = uint64_t(1) << 63; // ids handed out by PostSchedule*
+
 	enum class TaskKind : uint8_t
 	{
 		Callback,
 		Coroutine
 	};
 
-	struct TimerTask
+	struct TimerNode
 	{
-		uint64_t id = 0;
-		uint32_t rounds = 0;
+		Callback callback{};
+		std::coroutine_handle<> handle{};
+		uint64_t expireTick = 0;
 		uint32_t intervalTicks = 0;
-		bool repeating = false;
+		uint32_t generation = 1;
+		uint32_t prev = kNil;
+		uint32_t next = kNil; // also links the free list
+		uint32_t list = kNil; // slot index (level * slotCount + slot), _dueList, or kNil when unlinked
+		uint64_t postedId = 0; // the id PostSchedule* returned, 0 for timers scheduled by the owner
 		TaskKind kind = TaskKind::Callback;
+		bool repeating = false;
+		bool dispatched = false; // callback goes to _dispatchPool when one is set
+		bool firing = false;    // its callback is running; a Cancel now only unlinks it
+		bool cancelled = false; // cancelled while firing, released once the callback returns
+	};
+
+	struct NodeList
+	{
+		uint32_t head = kNil;
+		uint32_t tail = kNil;
+	};
+
+	enum class CommandKind : uint8_t
+	{
+		ScheduleOnce,
+		ScheduleOnceDispatched,
+		ScheduleEvery,
+		Cancel
+	};
+
+	struct Command
+	{
 		Callback callback{};
-		std::coroutine_handle<> handle{};
+		uint64_t id = 0;
+		uint32_t delayMs = 0;
+		CommandKind kind = CommandKind::Cancel;
 	};
 
-	struct TaskLocation
+	// a Cancel that came before its posted timer got out of the inbox
+	struct PendingCancel
 	{
-		uint32_t slotIndex = 0;
-		std::list<TimerTask>::iterator it;
+		uint64_t postedId = 0;
+		size_t inboxEnd = 0; // commands ever pushed when it was cancelled; once as many are popped, the timer is gone
 	};
 
+	using CallbackBatch = std::vector<Callback, PoolAllocator<Callback>>;
+
 	uint32_t ToTicks(uint32_t delayMs) const;
-	void InsertTask(TimerTask&& task, uint32_t delayTicks);
+	uint32_t SlotFor(uint64_t expireTick) const;
+	TimerNode& NodeAt(uint32_t index) { return _chunks[index >> kChunkShift][index & (kChunkNodes - 1)]; }
+	const TimerNode& NodeAt(uint32_t index) const { return _chunks[index >> kChunkShift][index & (kChunkNodes - 1)]; }
+	uint32_t AcquireNode();
+	void ReleaseNode(uint32_t index);
+	bool Resolve(TimerHandle handle, uint32_t& index);
+	TimerHandle HandleOf(uint32_t index) { return { (static_cast<uint64_t>(NodeAt(index).generation) << 32) | (index + 1) }; }
+	void Link(uint32_t list, uint32_t index);
+	void Unlink(uint32_t index);
+	uint32_t TakeList(uint32_t list);
+	void Place(uint32_t index) { Link(SlotFor(NodeAt(index).expireTick), index); }
 	void AdvanceOneTick();
+	void Fire(uint32_t index);
+	uint64_t TicksUntilNextSlot() const;
 	void ScheduleCoroutine(uint32_t delayMs, std::coroutine_handle<> handle);
-	void RescheduleRepeat(const TimerTask& task);
+	TimerHandle PostSchedule(CommandKind kind, uint32_t delayMs, Callback&& cb);
+	void DrainInbox();
+	void CancelNode(uint32_t index);
+	size_t PostedSlotOf(uint64_t postedId) const { return static_cast<size_t>((postedId * 0x9E3779B97F4A7C15ull) >> 32) & (_postedSlots.size() - 1); }
+	uint32_t FindPosted(uint64_t postedId) const;
+	void InsertPosted(uint32_t index);
+	void ErasePosted(uint64_t postedId);
+	void FlushDispatch();
+
+	void MarkOccupied(uint32_t slotIndex) { _occupied[slotIndex / 64] |= uint64_t(1) << (slotIndex % 64); }
+	void MarkEmpty(uint32_t slotIndex) { _occupied[slotIndex / 64] &= ~(uint64_t(1) << (slotIndex % 64)); }
+	uint32_t NextOccupied(uint32_t first, uint32_t last) const;
 
 	uint32_t _tickMs = 0;
-	uint32_t _cursor = 0;
+	uint32_t _slotCount = 0;
+	uint32_t _levels = 0;
+	uint32_t _dueList = 0; // the list after the slots, holding the timers of the tick being processed
+	uint64_t _now = 0; // ticks since construction
 	uint64_t _accumMs = 0;
-	uint64_t _nextId = 1;
-	std::vector<std::list<TimerTask>> _slots{};
-	std::unordered_map<uint64_t, TaskLocation> _index{};
+	size_t _pending = 0;
+	std::vector<uint64_t> _granularity{}; // ticks covered by one slot of each level
+	std::vector<NodeList> _lists{};
+	std::vector<uint64_t> _occupied{}; // one bit per slot holding tasks, for skipping idle ticks
+	std::pmr::memory_resource* _resource = nullptr; // where the node chunks come from
+	std::vector<TimerNode*> _chunks{}; // kChunkNodes nodes each, never moved
+	uint32_t _freeHead = kNil;
+
+	std::unique_ptr<MPMCRingBuffer<Command>> _inbox{};
+	std::atomic<uint64_t> _nextPostedId{ 1 };
+	// posted timers can't know their node when the handle is made: linear probing table of the
+	// indices of nodes with a postedId, kNil when free, at most half full
+	std::vector<uint32_t> _postedSlots{};
+	size_t _postedCount = 0;
+	size_t _inboxPopped = 0; // commands drained so far, only the owner pops
+	std::vector<PendingCancel> _pendingCancels{};
+
+	ThreadPool* _dispatchPool = nullptr;
+	size_t _dispatchBatchSize = 0;
+	CallbackBatch _dispatchBatch{};
 };
 
-inline TimerWheel::TimerWheel(uint32_t tickMs, uint32_t slotCount)
+inline TimerWheel::TimerWheel(uint32_t tickMs, uint32_t slotCount, uint32_t levels, size_t inboxCapacity,
+	std::pmr::memory_resource* resource)
 	: _tickMs(tickMs == 0 ? 1 : tickMs),
-	_cursor(0),
+	_slotCount(slotCount == 0 ? 1 : slotCount),
+	_levels(0),
+	_now(0),
 	_accumMs(0),
-	_nextId(1),
-	_slots(slotCount == 0 ? 1 : slotCount)
+	_pending(0),
+	_resource(resource),
+	_inbox(inboxCapacity == 0 ? nullptr : std::make_unique<MPMCRingBuffer<Command>>(inboxCapacity))
 {
+	// every level's span (granularity * slotCount) has to fit in 64 bits
+	uint64_t granularity = 1;
+	const uint32_t wanted = levels == 0 ? 1 : levels;
+	while (_levels < wanted && (_levels == 0 || _slotCount > 1) &&
+		granularity <= std::numeric_limits<uint64_t>::max() / _slotCount)
+	{
+		_granularity.push_back(granularity);
+		granularity *= _slotCount;
+		_levels++;
+	}
+	if (_levels == 0)
+	{
+		_granularity.push_back(1);
+		_levels = 1;
+	}
+	_dueList = _levels * _slotCount;
+	_lists.resize(static_cast<size_t>(_dueList) + 1);
+	_occupied.resize((static_cast<size_t>(_dueList) + 63) / 64);
+}
+
+inline TimerWheel::~TimerWheel()
+{
+	for (TimerNode* chunk : _chunks)
+	{
+		std::destroy_n(chunk, kChunkNodes);
+		_resource->deallocate(chunk, sizeof(TimerNode) * kChunkNodes, alignof(TimerNode));
+	}
 }
 
 inline TimerWheel::TimerHandle TimerWheel::ScheduleOnce(uint32_t delayMs, Callback cb)
 {
-	if (!cb || _slots.empty())
+	if (!cb)
 		return {};
 
-	uint64_t id = _nextId++;
-	TimerTask task{};
-	task.id = id;
-	task.repeating = false;
-	task.kind = TaskKind::Callback;
-	task.callback = std::move(cb);
+	const uint32_t index = AcquireNode();
+	TimerNode& node = NodeAt(index);
+	node.kind = TaskKind::Callback;
+	node.callback = std::move(cb);
+	node.expireTick = _now + ToTicks(delayMs);
+	Place(index);
+	return HandleOf(index);
+}
 
-	uint32_t delayTicks = ToTicks(delayMs);
-	InsertTask(std::move(task), delayTicks);
-	return { id };
+inline TimerWheel::TimerHandle TimerWheel::ScheduleOnceDispatched(uint32_t delayMs, Callback cb)
+{
+	const TimerHandle handle = ScheduleOnce(delayMs, std::move(cb));
+	if (handle.IsValid())
+		NodeAt(static_cast<uint32_t>(handle.id & std::numeric_limits<uint32_t>::max()) - 1).dispatched = true;
+	return handle;
 }
 
 inline TimerWheel::TimerHandle TimerWheel::ScheduleEvery(uint32_t intervalMs, Callback cb)
 {
-	if (!cb || _slots.empty())
+	if (!cb)
 		return {};
 
-	uint32_t intervalTicks = ToTicks(intervalMs);
-
-	uint64_t id = _nextId++;
-	TimerTask task{};
-	task.id = id;
-	task.repeating = true;
-	task.intervalTicks = intervalTicks;
-	task.kind = TaskKind::Callback;
-	task.callback = std::move(cb);
-
-	InsertTask(std::move(task), intervalTicks);
-	return { id };
+	const uint32_t index = AcquireNode();
+	TimerNode& node = NodeAt(index);
+	node.kind = TaskKind::Callback;
+	node.callback = std::move(cb);
+	node.repeating = true;
+	node.intervalTicks = ToTicks(intervalMs);
+	node.expireTick = _now + node.intervalTicks;
+	Place(index);
+	return HandleOf(index);
 }
 
 inline void TimerWheel::Cancel(TimerHandle handle)
 {
-	if (!handle.IsValid())
-		return;
+	uint32_t index = 0;
+	if (!Resolve(handle, index))
+	{
+		// a posted timer may still sit in the inbox. A drain can stop short of it, behind a command
+		// another thread has not finished pushing, so what is still missing afterwards is remembered
+		// and dropped when it is popped. Everything pushed before now is popped by _inboxPopped ==
+		// inboxEnd; a timer not seen by then had already fired or been cancelled.
+		if (!(handle.id & kPostedIdBit) || !_inbox)
+			return;
+		const size_t inboxEnd = _inboxPopped + _inbox->Size();
+		DrainInbox();
+		if (!Resolve(handle, index))
+		{
+			if (_inboxPopped < inboxEnd)
+				_pendingCancels.push_back(PendingCancel{ handle.id, inboxEnd });
+			return;
+		}
+	}
+	CancelNode(index);
+}
 
-	auto it = _index.find(handle.id);
-	if (it == _index.end())
-		return;
+inline void TimerWheel::CancelNode(uint32_t index)
+{
+	TimerNode& node = NodeAt(index);
+	if (node.list != kNil)
+		Unlink(index);
+	if (node.firing)
+		node.cancelled = true;
+	else
+		ReleaseNode(index);
+}
 
-	auto slotIndex = it->second.slotIndex;
-	if (slotIndex < _slots.size())
-		_slots[slotIndex].erase(it->second.it);
-	_index.erase(it);
+inline bool TimerWheel::PostCancel(TimerHandle handle)
+{
+	if (!_inbox)
+		return false;
+	Command command{};
+	command.id = handle.id;
+	command.kind = CommandKind::Cancel;
+	return _inbox->TryPush(std::move(command));
+}
+
+inline void TimerWheel::SetCallbackDispatch(ThreadPool* pool, size_t batchSize)
+{
+	FlushDispatch();
+	_dispatchPool = pool;
+	_dispatchBatchSize = batchSize == 0 ? 1 : batchSize;
+	_dispatchBatch = CallbackBatch{};
+	if (_dispatchPool)
+		_dispatchBatch.reserve(_dispatchBatchSize);
 }
 
 inline void TimerWheel::AdvanceByElapsedMs(uint32_t elapsedMs)
 {
-	if (_slots.empty() || _tickMs == 0)
-		return;
+	DrainInbox();
 
 	_accumMs += elapsedMs;
-	while (_accumMs >= _tickMs)
+	uint64_t ticks = _accumMs / _tickMs;
+	_accumMs %= _tickMs;
+	while (ticks > 0)
 	{
-		_accumMs -= _tickMs;
+		// ticks before the next slot with tasks are skipped in one step; a callback may schedule
+		// earlier timers, so this is recomputed after every processed tick
+		const uint64_t idle = _pending == 0 ? ticks : TicksUntilNextSlot() - 1;
+		if (idle >= ticks)
+		{
+			_now += ticks;
+			break;
+		}
+		_now += idle;
+		ticks -= idle + 1;
 		AdvanceOneTick();
 	}
+	FlushDispatch();
 }
 
 inline uint32_t TimerWheel::ToTicks(uint32_t delayMs) const
@@ -168,93 +388,404 @@ inline uint32_t TimerWheel::ToTicks(uint32_t delayMs) const
 	return ticks == 0 ? 1 : static_cast<uint32_t>(ticks);
 }
 
-inline void TimerWheel::InsertTask(TimerTask&& task, uint32_t delayTicks)
+// The coarsest level whose slots are finer than the remaining delay. A level L slot is processed
+// when the wheel enters the granularity[L] ticks it covers, which for such a delay is still ahead
+// and is less than one revolution away, so the slot cannot be mistaken for an earlier pass.
+inline uint32_t TimerWheel::SlotFor(uint64_t expireTick) const
 {
-	if (_slots.empty())
-		return;
+	const uint64_t delta = expireTick > _now ? expireTick - _now : 0;
+	uint32_t level = 0;
+	while (level + 1 < _levels && delta >= _granularity[level + 1])
+		level++;
+
+	// further away than the top level reaches: wait in the last slot it does reach and get placed again from there
+	const uint64_t span = _granularity[level] * _slotCount;
+	const uint64_t target = delta >= span ? _now + span - 1 : expireTick;
+	return level * _slotCount + static_cast<uint32_t>((target / _granularity[level]) % _slotCount);
+}
+
+inline uint32_t TimerWheel::AcquireNode()
+{
+	if (_freeHead == kNil)
+	{
+		// a new chunk goes onto the free list back to front, so it is handed out in address order
+		const uint32_t first = static_cast<uint32_t>(_chunks.size()) << kChunkShift;
+		AppendOwned(_chunks, [&] {
+			TimerNode* chunk = static_cast<TimerNode*>(_resource->allocate(sizeof(TimerNode) * kChunkNodes, alignof(TimerNode)));
+			std::uninitialized_default_construct_n(chunk, kChunkNodes);
+			return chunk;
+		});
+		for (uint32_t i = kChunkNodes; i > 0; i--)
+		{
+			NodeAt(first + i - 1).next = _freeHead;
+			_freeHead = first + i - 1;
+		}
+	}
 
-	uint32_t slotCount = static_cast<uint32_t>(_slots.size());
-	uint32_t slotIndex = (_cursor + delayTicks) % slotCount;
-	task.rounds = delayTicks / slotCount;
+	const uint32_t index = _freeHead;
+	TimerNode& node = NodeAt(index);
+	_freeHead = node.next;
+	node.next = kNil;
+	return index;
+}
 
-	auto& slot = _slots[slotIndex];
-	slot.push_back(std::move(task));
-	auto it = std::prev(slot.end());
-	_index[it->id] = { slotIndex, it };
+// invalidates every handle to the node and returns it to the free list
+inline void TimerWheel::ReleaseNode(uint32_t index)
+{
+	TimerNode& node = NodeAt(index);
+	node.callback.Reset();
+	node.handle = {};
+	node.intervalTicks = 0;
+	node.repeating = false;
+	node.dispatched = false;
+	node.firing = false;
+	node.cancelled = false;
+	node.generation = node.generation == kMaxGeneration ? 1 : node.generation + 1;
+	if (node.postedId != 0)
+	{
+		ErasePosted(node.postedId);
+		node.postedId = 0;
+	}
+	node.next = _freeHead;
+	_freeHead = index;
 }
 
-inline void TimerWheel::AdvanceOneTick()
+// the node a handle refers to, if that timer is still pending or running
+inline bool TimerWheel::Resolve(TimerHandle handle, uint32_t& index)
 {
-	if (_slots.empty())
-		return;
+	if (handle.id & kPostedIdBit)
+	{
+		const uint32_t posted = FindPosted(handle.id);
+		if (posted == kNil)
+			return false;
+		handle = HandleOf(posted);
+	}
 
-	_cursor = (_cursor + 1) % static_cast<uint32_t>(_slots.size());
-	auto& slot = _slots[_cursor];
+	const uint64_t slot = handle.id & std::numeric_limits<uint32_t>::max();
+	if (slot == 0 || slot > (static_cast<uint64_t>(_chunks.size()) << kChunkShift))
+		return false;
+	index = static_cast<uint32_t>(slot - 1);
+	const TimerNode& node = NodeAt(index);
+	return node.generation == (handle.id >> 32) && (node.list != kNil || (node.firing && !node.cancelled));
+}
 
-	std::vector<TimerTask> due{};
-	due.reserve(slot.size());
+// appends to a list, keeping the order in which timers landed in a slot
+inline void TimerWheel::Link(uint32_t list, uint32_t index)
+{
+	TimerNode& node = NodeAt(index);
+	NodeList& nodes = _lists[list];
+	node.list = list;
+	node.next = kNil;
+	node.prev = nodes.tail;
+	if (nodes.tail != kNil)
+		NodeAt(nodes.tail).next = index;
+	else
+		nodes.head = index;
+	nodes.tail = index;
+
+	if (list != _dueList)
+	{
+		MarkOccupied(list);
+		_pending++;
+	}
+}
 
-	for (auto it = slot.begin(); it != slot.end();)
+inline void TimerWheel::Unlink(uint32_t index)
+{
+	TimerNode& node = NodeAt(index);
+	NodeList& nodes = _lists[node.list];
+	if (node.prev != kNil)
+		NodeAt(node.prev).next = node.next;
+	else
+		nodes.head = node.next;
+	if (node.next != kNil)
+		NodeAt(node.next).prev = node.prev;
+	else
+		nodes.tail = node.prev;
+
+	if (node.list != _dueList)
 	{
-		if (it->rounds > 0)
-		{
-			it->rounds--;
-			++it;
+		if (nodes.head == kNil)
+			MarkEmpty(node.list);
+		_pending--;
+	}
+	node.list = kNil;
+	node.prev = kNil;
+	node.next = kNil;
+}
+
+// empties a slot and returns its chain; the nodes keep their next links but belong to no list,
+// so each one has to be linked again (or released) by the caller
+inline uint32_t TimerWheel::TakeList(uint32_t list)
+{
+	NodeList& nodes = _lists[list];
+	const uint32_t head = nodes.head;
+	for (uint32_t index = head; index != kNil; index = NodeAt(index).next)
+	{
+		NodeAt(index).list = kNil;
+		_pending--;
+	}
+	nodes = {};
+	MarkEmpty(list);
+	return head;
+}
+
+inline void TimerWheel::AdvanceOneTick()
+{
+	_now++;
+
+	// cascade every level whose slot boundary this tick crosses, coarsest first, so that tasks
+	// falling through several levels arrive before the finer level is processed
+	for (uint32_t level = _levels - 1; level > 0; level--)
+	{
+		if (_now % _granularity[level] != 0)
+			continue;
+		const uint32_t slotIndex = level * _slotCount + static_cast<uint32_t>((_now / _granularity[level]) % _slotCount);
+		if (_lists[slotIndex].head == kNil)
 			continue;
+		for (uint32_t index = TakeList(slotIndex); index != kNil;)
+		{
+			const uint32_t next = NodeAt(index).next;
+			Place(index);
+			index = next;
 		}
+	}
+
+	// the due timers move to a list of their own, so that a callback cancelling one of them (or
+	// scheduling into this slot) finds every node linked somewhere
+	const uint32_t slotIndex = static_cast<uint32_t>(_now % _slotCount);
+	for (uint32_t index = TakeList(slotIndex); index != kNil;)
+	{
+		const uint32_t next = NodeAt(index).next;
+		if (NodeAt(index).expireTick > _now)
+			Place(index); // parked beyond the wheel's span, only with a single level
+		else
+			Link(_dueList, index);
+		index = next;
+	}
+
+	while (_lists[_dueList].head != kNil)
+	{
+		const uint32_t index = _lists[_dueList].head;
+		Unlink(index);
+		Fire(index);
+	}
+}
 
-		due.push_back(std::move(*it));
-		_index.erase(it->id);
-		it = slot.erase(it);
+// a repeating timer is linked for its next expiry before the callback runs, exactly as if it had
+// been scheduled again, but keeps its node, handle and callback
+inline void TimerWheel::Fire(uint32_t index)
+{
+	TimerNode& node = NodeAt(index); // chunks never move, so this survives scheduling in the callback
+	node.firing = true;
+	if (node.repeating)
+	{
+		node.expireTick = _now + node.intervalTicks;
+		Place(index);
 	}
 
-	for (auto& task : due)
+	if (node.kind == TaskKind::Callback && _dispatchPool && node.dispatched)
+	{
+		_dispatchBatch.push_back(std::move(node.callback));
+		if (_dispatchBatch.size() >= _dispatchBatchSize)
+			FlushDispatch();
+	}
+	else if (node.kind == TaskKind::Callback)
+	{
+		node.callback();
+	}
+	else if (node.handle && !node.handle.done())
 	{
-		if (task.repeating)
-			RescheduleRepeat(task);
+		node.handle.resume();
+	}
 
-		if (task.kind == TaskKind::Callback)
+	node.firing = false;
+	if (!node.repeating || node.cancelled)
+		ReleaseNode(index);
+}
+
+// first set bit in [first, last), or last
+inline uint32_t TimerWheel::NextOccupied(uint32_t first, uint32_t last) const
+{
+	while (first < last)
+	{
+		const uint64_t word = _occupied[first / 64] >> (first % 64);
+		if (word != 0)
 		{
-			if (task.callback)
-				task.callback();
-			continue;
+			const uint32_t found = first + static_cast<uint32_t>(std::countr_zero(word));
+			return found < last ? found : last;
 		}
+		first = (first / 64 + 1) * 64;
+	}
+	return last;
+}
 
-		if (task.kind == TaskKind::Coroutine)
+// ticks from now to the closest tick that processes a slot holding tasks (at least 1)
+inline uint64_t TimerWheel::TicksUntilNextSlot() const
+{
+	uint64_t best = std::numeric_limits<uint64_t>::max();
+	for (uint32_t level = 0; level < _levels; level++)
+	{
+		// the slots of this level come up in order from the one after the current position
+		const uint64_t position = _now / _granularity[level];
+		const uint32_t begin = level * _slotCount;
+		const uint32_t start = static_cast<uint32_t>((position + 1) % _slotCount);
+		uint32_t found = NextOccupied(begin + start, begin + _slotCount);
+		uint64_t steps = 0;
+		if (found < begin + _slotCount)
+		{
+			steps = found - (begin + start) + 1;
+		}
+		else
 		{
-			if (task.handle && !task.handle.done())
-				task.handle.resume();
+			found = NextOccupied(begin, begin + start);
+			if (found == begin + start)
+				continue;
+			steps = (_slotCount - start) + (found - begin) + 1;
 		}
+
+		const uint64_t tick = (position + steps) * _granularity[level];
+		if (tick - _now < best)
+			best = tick - _now;
 	}
+	return best;
 }
 
 inline void TimerWheel::ScheduleCoroutine(uint32_t delayMs, std::coroutine_handle<> handle)
 {
-	if (!handle || handle.done() || _slots.empty())
+	if (!handle || handle.done())
 		return;
 
-	uint64_t id = _nextId++;
-	TimerTask task{};
-	task.id = id;
-	task.repeating = false;
-	task.kind = TaskKind::Coroutine;
-	task.handle = handle;
+	const uint32_t index = AcquireNode();
+	TimerNode& node = NodeAt(index);
+	node.kind = TaskKind::Coroutine;
+	node.handle = handle;
+	node.expireTick = _now + ToTicks(delayMs);
+	Place(index);
+}
 
-	uint32_t delayTicks = ToTicks(delayMs);
-	InsertTask(std::move(task), delayTicks);
+inline TimerWheel::TimerHandle TimerWheel::PostSchedule(CommandKind kind, uint32_t delayMs, Callback&& cb)
+{
+	if (!_inbox || !cb)
+		return {};
+	Command command{};
+	command.callback = std::move(cb);
+	command.id = kPostedIdBit | _nextPostedId.fetch_add(1, std::memory_order_relaxed);
+	command.delayMs = delayMs;
+	command.kind = kind;
+	const uint64_t id = command.id;
+	return _inbox->TryPush(std::move(command)) ? TimerHandle{ id } : TimerHandle{};
 }
 
-inline void TimerWheel::RescheduleRepeat(const TimerTask& task)
+// bounded by the inbox capacity, so producers that keep posting cannot hold the tick back forever
+inline void TimerWheel::DrainInbox()
 {
-	if (!task.repeating || task.kind != TaskKind::Callback || !task.callback)
+	if (!_inbox)
 		return;
 
-	TimerTask next{};
-	next.id = task.id;
-	next.repeating = true;
-	next.intervalTicks = task.intervalTicks;
-	next.kind = TaskKind::Callback;
-	next.callback = task.callback;
+	Command command{};
+	for (size_t budget = _inbox->Capacity(); budget > 0 && _inbox->TryPop(command); budget--)
+	{
+		_inboxPopped++;
+		if (command.kind == CommandKind::Cancel)
+		{
+			uint32_t index = 0;
+			if (Resolve(TimerHandle{ command.id }, index))
+				CancelNode(index);
+			continue;
+		}
+
+		const auto cancelled = std::find_if(_pendingCancels.begin(), _pendingCancels.end(),
+			[&command](const PendingCancel& pending) { return pending.postedId == command.id; });
+		if (cancelled != _pendingCancels.end())
+		{
+			*cancelled = _pendingCancels.back();
+			_pendingCancels.pop_back();
+			command.callback.Reset();
+			continue;
+		}
+
+		TimerHandle handle{};
+		if (command.kind == CommandKind::ScheduleOnce)
+			handle = ScheduleOnce(command.delayMs, std::move(command.callback));
+		else if (command.kind == CommandKind::ScheduleOnceDispatched)
+			handle = ScheduleOnceDispatched(command.delayMs, std::move(command.callback));
+		else
+			handle = ScheduleEvery(command.delayMs, std::move(command.callback));
+		const uint32_t index = static_cast<uint32_t>(handle.id & std::numeric_limits<uint32_t>::max()) - 1;
+		NodeAt(index).postedId = command.id;
+		InsertPosted(index);
+	}
+
+	std::erase_if(_pendingCancels, [this](const PendingCancel& pending) { return pending.inboxEnd <= _inboxPopped; });
+}
+
+inline uint32_t TimerWheel::FindPosted(uint64_t postedId) const
+{
+	if (_postedSlots.empty())
+		return kNil;
+	const size_t mask = _postedSlots.size() - 1;
+	for (size_t slot = PostedSlotOf(postedId);; slot = (slot + 1) & mask)
+	{
+		const uint32_t index = _postedSlots[slot];
+		if (index == kNil || NodeAt(index).postedId == postedId)
+			return index;
+	}
+}
+
+inline void TimerWheel::InsertPosted(uint32_t index)
+{
+	if ((_postedCount + 1) * 2 > _postedSlots.size())
+	{
+		std::vector<uint32_t> old(_postedSlots.empty() ? 16 : _postedSlots.size() * 2, kNil);
+		old.swap(_postedSlots);
+		_postedCount = 0;
+		for (const uint32_t moved : old)
+		{
+			if (moved != kNil)
+				InsertPosted(moved);
+		}
+	}
+
+	const size_t mask = _postedSlots.size() - 1;
+	size_t slot = PostedSlotOf(NodeAt(index).postedId);
+	while (_postedSlots[slot] != kNil)
+		slot = (slot + 1) & mask;
+	_postedSlots[slot] = index;
+	_postedCount++;
+}
 
-	InsertTask(std::move(next), task.intervalTicks);
+// backward shift deletion: entries behind the hole that could live in it move up, so lookups
+// can still stop at the first free slot
+inline void TimerWheel::ErasePosted(uint64_t postedId)
+{
+	const size_t mask = _postedSlots.size() - 1;
+	size_t hole = PostedSlotOf(postedId);
+	while (NodeAt(_postedSlots[hole]).postedId != postedId)
+		hole = (hole + 1) & mask;
+
+	for (size_t slot = (hole + 1) & mask; _postedSlots[slot] != kNil; slot = (slot + 1) & mask)
+	{
+		const size_t home = PostedSlotOf(NodeAt(_postedSlots[slot]).postedId);
+		// the entry may move into the hole unless its home lies cyclically in (hole, slot]
+		if (((slot - home) & mask) >= ((slot - hole) & mask))
+		{
+			_postedSlots[hole] = _postedSlots[slot];
+			hole = slot;
+		}
+	}
+	_postedSlots[hole] = kNil;
+	_postedCount--;
+}
+
+inline void TimerWheel::FlushDispatch()
+{
+	if (_dispatchBatch.empty())
+		return;
+	_dispatchPool->Post([batch = std::move(_dispatchBatch)]() mutable {
+		for (Callback& callback : batch)
+			callback();
+	});
+	_dispatchBatch = CallbackBatch{};
+	_dispatchBatch.reserve(_dispatchBatchSize);
 }
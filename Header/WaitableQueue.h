@@ -0,0 +1,388 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "Instrumentation.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "Synchronization.lib")
+#endif
+#elif defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Blocking on top of the lock-free queues without putting a lock back on the fast path.
+//
+// EventCount is the parking primitive: a waiter registers with PrepareWait, re-checks its condition
+// and only then sleeps on the epoch word (futex on Linux, WaitOnAddress on Windows). A notifier that
+// changed the condition pays a fence and one load while nobody sleeps; the syscall only happens when
+// a waiter is registered.
+//
+//     EventCount::Key key = events.PrepareWait();
+//     if (ConditionHolds()) { events.CancelWait(); } else { events.Wait(key); }
+class EventCount
+{
+public:
+    using Key = uint32_t;
+
+private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+        "the epoch word is handed to the OS as a plain 32-bit integer");
+
+    std::atomic<uint32_t> _epoch{ 0 };
+    std::atomic<uint32_t> _waiters{ 0 };
+
+    // sleeps while the epoch still equals 'key', may return early; timeout < 0 means no timeout
+    void PlatformWait(Key key, std::chrono::nanoseconds timeout)
+    {
+#if defined(_WIN32)
+        const DWORD ms = timeout.count() < 0
+            ? INFINITE
+            : static_cast<DWORD>(std::chrono::ceil<std::chrono::milliseconds>(timeout).count());
+        ::WaitOnAddress(&_epoch, &key, sizeof(key), ms);
+#elif defined(__linux__)
+        timespec ts{};
+        ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+        ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_epoch), FUTEX_WAIT_PRIVATE, key,
+            timeout.count() < 0 ? nullptr : &ts, nullptr, 0);
+#else
+        if (timeout.count() < 0)
+        {
+            _epoch.wait(key, std::memory_order_acquire);
+        }
+        else
+        {
+            // std::atomic::wait has no timeout, poll instead
+            std::this_thread::sleep_for(timeout < std::chrono::milliseconds(1) ? timeout : std::chrono::milliseconds(1));
+        }
+#endif
+    }
+
+    void PlatformWake(bool all)
+    {
+#if defined(_WIN32)
+        if (all)
+        {
+            ::WakeByAddressAll(&_epoch);
+        }
+        else
+        {
+            ::WakeByAddressSingle(&_epoch);
+        }
+#elif defined(__linux__)
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_epoch), FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+#else
+        if (all)
+        {
+            _epoch.notify_all();
+        }
+        else
+        {
+            _epoch.notify_one();
+        }
+#endif
+    }
+
+    void Notify(bool all)
+    {
+        // pairs with the seq_cst increment in PrepareWait: either we see the waiter, or it sees our change
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waiters.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+        _epoch.fetch_add(1, std::memory_order_release);
+        PlatformWake(all);
+    }
+
+public:
+    EventCount() = default;
+    EventCount(const EventCount&) = delete;
+    EventCount& operator=(const EventCount&) = delete;
+
+    Key PrepareWait()
+    {
+        _waiters.fetch_add(1, std::memory_order_seq_cst);
+        return _epoch.load(std::memory_order_seq_cst);
+    }
+
+    void CancelWait()
+    {
+        _waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // blocks until a Notify issued after PrepareWait returned 'key'
+    void Wait(Key key)
+    {
+        while (_epoch.load(std::memory_order_acquire) == key)
+        {
+            PlatformWait(key, std::chrono::nanoseconds(-1));
+        }
+        _waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // false when the timeout expired without a Notify
+    template <typename Rep, typename Period>
+    bool WaitFor(Key key, std::chrono::duration<Rep, Period> timeout)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        bool notified = true;
+        while (_epoch.load(std::memory_order_acquire) == key)
+        {
+            const auto remaining = deadline - std::chrono::steady_clock::now();
+            if (remaining <= std::chrono::steady_clock::duration::zero())
+            {
+                notified = false;
+                break;
+            }
+            PlatformWait(key, std::chrono::duration_cast<std::chrono::nanoseconds>(remaining));
+        }
+        _waiters.fetch_sub(1, std::memory_order_relaxed);
+        return notified;
+    }
+
+    void NotifyOne()
+    {
+        Notify(false);
+    }
+
+    void NotifyAll()
+    {
+        Notify(true);
+    }
+};
+
+inline void CpuRelax()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Blocking adaptor for SPSCRingBuffer, MPMCRingBuffer and LockFreeQueue (anything with TryPush/TryPop
+// or Enqueue/Dequeue). The try operations stay lock-free and are forwarded untouched; Push and the
+// Pop variants spin for kSpinCount attempts first, so a busy consumer never reaches the kernel, then
+// park on an EventCount.
+//
+// Close() wakes everyone. After it, Push fails and the Pop variants keep returning elements until
+// the queue is drained, then return false. Elements pushed concurrently with Close may or may not be
+// delivered; close after the producers are done when every element matters.
+// Over an SPSC ring the single producer / single consumer rule still applies to the wrapper.
+template <typename T, typename Queue>
+class WaitableQueue
+{
+private:
+    static constexpr int kSpinCount = 128;
+    static constexpr bool kBounded = requires(Queue& q, T& value) { q.TryPush(std::move(value)); };
+    static constexpr bool kHasTryPop = requires(Queue& q, T& value) { q.TryPop(value); };
+
+    Queue _queue;
+    EventCount _notEmpty;
+    EventCount _notFull; // only used when the queue is bounded
+    std::atomic<bool> _closed{ false };
+
+    template <typename U>
+    bool QueueTryPush(U&& value)
+    {
+        if constexpr (kBounded)
+        {
+            return _queue.TryPush(std::forward<U>(value));
+        }
+        else
+        {
+            _queue.Enqueue(std::forward<U>(value));
+            return true;
+        }
+    }
+
+    bool QueueTryPop(T& out)
+    {
+        bool popped = false;
+        if constexpr (kHasTryPop)
+        {
+            popped = _queue.TryPop(out);
+        }
+        else
+        {
+            popped = _queue.Dequeue(out);
+        }
+
+        if constexpr (kBounded)
+        {
+            if (popped)
+            {
+                _notFull.NotifyOne();
+            }
+        }
+        return popped;
+    }
+
+    // spin-then-park pop; timeout < 0 waits forever
+    bool PopImpl(T& out, std::chrono::nanoseconds timeout)
+    {
+        for (int spin = 0; spin < kSpinCount; ++spin)
+        {
+            if (QueueTryPop(out))
+            {
+                return true;
+            }
+            if (_closed.load(std::memory_order_acquire))
+            {
+                return QueueTryPop(out);
+            }
+            CpuRelax();
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true)
+        {
+            const EventCount::Key key = _notEmpty.PrepareWait();
+            if (QueueTryPop(out))
+            {
+                _notEmpty.CancelWait();
+                return true;
+            }
+            if (_closed.load(std::memory_order_acquire))
+            {
+                _notEmpty.CancelWait();
+                return QueueTryPop(out);
+            }
+
+            INSTRUMENT_COUNT(WaitableQueueParks);
+            if (timeout.count() < 0)
+            {
+                _notEmpty.Wait(key);
+                continue;
+            }
+
+            const auto remaining = deadline - std::chrono::steady_clock::now();
+            if (remaining <= std::chrono::steady_clock::duration::zero() || !_notEmpty.WaitFor(key, remaining))
+            {
+                return QueueTryPop(out);
+            }
+        }
+    }
+
+public:
+    template <typename... Args>
+    explicit WaitableQueue(Args&&... args)
+        : _queue(std::forward<Args>(args)...)
+    {
+    }
+
+    WaitableQueue(const WaitableQueue&) = delete;
+    WaitableQueue& operator=(const WaitableQueue&) = delete;
+
+    // false when the queue is full (bounded queues only) or closed
+    template <typename U>
+    bool TryPush(U&& value)
+    {
+        if (_closed.load(std::memory_order_acquire) || !QueueTryPush(std::forward<U>(value)))
+        {
+            return false;
+        }
+        _notEmpty.NotifyOne();
+        return true;
+    }
+
+    // waits for space on bounded queues, false only when the queue is closed
+    template <typename U>
+    bool Push(U&& value)
+    {
+        if constexpr (!kBounded)
+        {
+            return TryPush(std::forward<U>(value));
+        }
+        else
+        {
+            // TryPush only consumes 'value' when it succeeds
+            for (int spin = 0; spin < kSpinCount; ++spin)
+            {
+                if (TryPush(std::forward<U>(value)))
+                {
+                    return true;
+                }
+                if (_closed.load(std::memory_order_acquire))
+                {
+                    return false;
+                }
+                CpuRelax();
+            }
+
+            while (true)
+            {
+                const EventCount::Key key = _notFull.PrepareWait();
+                if (TryPush(std::forward<U>(value)))
+                {
+                    _notFull.CancelWait();
+                    return true;
+                }
+                if (_closed.load(std::memory_order_acquire))
+                {
+                    _notFull.CancelWait();
+                    return false;
+                }
+                INSTRUMENT_COUNT(WaitableQueueParks);
+                _notFull.Wait(key);
+            }
+        }
+    }
+
+    bool TryPop(T& out)
+    {
+        return QueueTryPop(out);
+    }
+
+    // blocks until an element arrives; false once the queue is closed and drained
+    bool Pop(T& out)
+    {
+        return PopImpl(out, std::chrono::nanoseconds(-1));
+    }
+
+    // false on timeout, or once the queue is closed and drained
+    template <typename Rep, typename Period>
+    bool PopFor(T& out, std::chrono::duration<Rep, Period> timeout)
+    {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout);
+        return PopImpl(out, ns.count() < 0 ? std::chrono::nanoseconds(0) : ns);
+    }
+
+    void Close()
+    {
+        _closed.store(true, std::memory_order_release);
+        _notEmpty.NotifyAll();
+        _notFull.NotifyAll();
+    }
+
+    bool IsClosed() const
+    {
+        return _closed.load(std::memory_order_acquire);
+    }
+
+    // the wrapped queue, for its size queries and bulk operations; bypasses the wake-ups
+    Queue& Underlying()
+    {
+        return _queue;
+    }
+};
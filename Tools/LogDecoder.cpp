@@ -0,0 +1,147 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../Header/LogFormat.h"
+
+// Turns a Logger OutputFormat::Binary file back into the text layout Logger writes.
+// usage: LogDecoder <binary log> [text output]
+
+namespace
+{
+    class Reader
+    {
+        std::string_view _data;
+        size_t _pos = 0;
+
+    public:
+        explicit Reader(std::string_view data) : _data(data) {}
+
+        bool AtEnd() const { return _pos >= _data.size(); }
+
+        template<typename T>
+        bool Read(T& out)
+        {
+            if (_data.size() - _pos < sizeof(T))
+                return false;
+            std::memcpy(&out, _data.data() + _pos, sizeof(T));
+            _pos += sizeof(T);
+            return true;
+        }
+
+        bool ReadBytes(size_t size, std::string_view& out)
+        {
+            if (_data.size() - _pos < size)
+                return false;
+            out = _data.substr(_pos, size);
+            _pos += size;
+            return true;
+        }
+    };
+
+    bool Decode(std::string_view data, std::ostream& out)
+    {
+        if (data.size() < sizeof(LogFormat::kBinaryMagic) ||
+            std::memcmp(data.data(), LogFormat::kBinaryMagic, sizeof(LogFormat::kBinaryMagic)) != 0)
+        {
+            std::cerr << "LogDecoder: not a binary Logger file\n";
+            return false;
+        }
+
+        // a reopened file restarts string ids at 1, later definitions simply replace the earlier ones
+        std::unordered_map<uint32_t, std::string_view> strings;
+        Reader reader(data.substr(sizeof(LogFormat::kBinaryMagic)));
+        std::string line;
+        std::string message;
+        while (!reader.AtEnd())
+        {
+            char kind = 0;
+            if (!reader.Read(kind))
+                break;
+
+            if (kind == LogFormat::kStringEntry)
+            {
+                uint32_t id = 0, size = 0;
+                std::string_view text;
+                if (!reader.Read(id) || !reader.Read(size) || !reader.ReadBytes(size, text))
+                {
+                    std::cerr << "LogDecoder: truncated string entry\n";
+                    return false;
+                }
+                strings[id] = text;
+                continue;
+            }
+
+            if (kind != LogFormat::kRecordEntry)
+            {
+                std::cerr << "LogDecoder: unknown entry type " << static_cast<int>(kind) << "\n";
+                return false;
+            }
+
+            uint64_t seq = 0, ticks = 0;
+            uint8_t level = 0;
+            uint32_t threadId = 0, fileId = 0, formatId = 0, payloadSize = 0;
+            int32_t lineNo = 0;
+            std::string_view payload;
+            if (!reader.Read(seq) || !reader.Read(ticks) || !reader.Read(level) || !reader.Read(threadId) ||
+                !reader.Read(lineNo) || !reader.Read(fileId) || !reader.Read(formatId) ||
+                !reader.Read(payloadSize) || !reader.ReadBytes(payloadSize, payload))
+            {
+                std::cerr << "LogDecoder: truncated record\n";
+                return false;
+            }
+
+            message.clear();
+            if (formatId == 0)
+                message.assign(payload);
+            else
+                LogFormat::FormatTo(message, strings[formatId], payload);
+
+            const LogFormat::CivilTime utc = LogFormat::TicksToCivil(ticks);
+            line.clear();
+            std::format_to(std::back_inserter(line),
+                "[{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}] [{}] [T{}] [{}:{}] {}\n",
+                utc.year, utc.month, utc.day, utc.hour, utc.minute, utc.second, utc.millisecond,
+                LogFormat::LevelText(level), threadId, strings[fileId], lineNo, message);
+            out << line;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** args)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: LogDecoder <binary log> [text output]\n";
+        return 2;
+    }
+
+    std::ifstream in(args[1], std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "LogDecoder: cannot open " << args[1] << "\n";
+        return 1;
+    }
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    if (argc > 2)
+    {
+        std::ofstream out(args[2], std::ios::binary);
+        if (!out)
+        {
+            std::cerr << "LogDecoder: cannot open " << args[2] << "\n";
+            return 1;
+        }
+        return Decode(data, out) ? 0 : 1;
+    }
+    return Decode(data, std::cout) ? 0 : 1;
+}